@@ -23,14 +23,18 @@
 #include <glib/gstdio.h>
 
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 
 
 // Mime types
-GList *_supported_mime_types;
-static GList* _mime_types_get_supported();
-static gint _compare_quarks(gconstpointer a, gconstpointer b);
+static GHashTable *_supported_mime_types;
+static GHashTable* _mime_types_get_supported();
+
+// Extensions
+static GHashTable *_supported_extensions;
+static GHashTable* _extensions_get_supported();
 
 // From libtinyc
 static const char* path_sep(const char *path);
@@ -45,70 +49,148 @@ static int file_copy(const char *from, const char *to);
 
 gboolean mime_type_is_supported(const char *mime_type)
 {
-    GList *result;
-    GQuark quark;
-
     if (mime_type == NULL)
     {
         return FALSE;
     }
 
-    _supported_mime_types = _mime_types_get_supported();
+    return g_hash_table_contains(_mime_types_get_supported(), mime_type);
+}
+
+static GHashTable* _mime_types_get_supported()
+{
+    // Modified version of eog's eog_image_get_supported_mime_types, built
+    // once as a set since it's queried for every file of a directory.
+    // Also called from the directory scanning thread, see list.c.
+
+    static gsize initialized = 0;
+
+    if (!g_once_init_enter(&initialized))
+        return _supported_mime_types;
+
+    _supported_mime_types = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                  g_free, NULL);
+
+    GSList *format_list = gdk_pixbuf_get_formats();
+
+    for (GSList *it = format_list; it != NULL; it = it->next)
+    {
+        gchar **mime_types =
+            gdk_pixbuf_format_get_mime_types((GdkPixbufFormat *)it->data);
+
+        for (int i = 0; mime_types[i] != NULL; ++i)
+        {
+            g_hash_table_add(_supported_mime_types,
+                             g_strdup(mime_types[i]));
+        }
+
+        g_strfreev(mime_types);
+    }
+
+    g_hash_table_add(_supported_mime_types,
+                     g_strdup("image/vnd.microsoft.icon"));
 
-    quark = g_quark_from_string(mime_type);
+    g_slist_free(format_list);
 
-    result = g_list_find_custom(_supported_mime_types,
-                                GINT_TO_POINTER(quark),
-                                (GCompareFunc) _compare_quarks);
+    g_once_init_leave(&initialized, 1);
 
-    return (result != NULL);
+    return _supported_mime_types;
 }
 
-static GList* _mime_types_get_supported()
+
+// Extensions -----------------------------------------------------------------
+
+#define FILE_SNIFF_SIZE 4096
+
+gboolean file_name_is_supported(const char *filepath)
 {
-    // Modified version of eog's eog_image_get_supported_mime_types
+    // Decides from the name alone whenever possible, the contents are
+    // only read for files the name says nothing certain about.
+
+    if (filepath == NULL)
+        return FALSE;
 
-    GSList *format_list;
-    GSList *it;
+    const char *ext = path_ext(filepath, false);
 
-    if (!_supported_mime_types)
+    if (ext)
     {
-        format_list = gdk_pixbuf_get_formats();
+        // lowered in place, no image format has a longer extension
+        char lower[16];
+        int i = 0;
 
-        for (it = format_list; it != NULL; it = it->next)
-        {
-            gchar **mime_types =
-                gdk_pixbuf_format_get_mime_types((GdkPixbufFormat *)it->data);
+        for (++ext; ext[i] && i < (int) sizeof(lower) - 1; ++i)
+            lower[i] = g_ascii_tolower(ext[i]);
 
-            for (int i = 0; mime_types[i] != NULL; ++i)
-            {
-                _supported_mime_types =
-                    g_list_prepend(_supported_mime_types,
-                                   g_strdup(mime_types[i]));
-            }
+        lower[i] = '\0';
 
-            g_strfreev(mime_types);
-        }
+        if (ext[i] == '\0'
+            && g_hash_table_contains(_extensions_get_supported(), lower))
+            return TRUE;
+    }
+
+    gboolean uncertain = FALSE;
+    gchar *type = g_content_type_guess(filepath, NULL, 0, &uncertain);
+
+    if (uncertain)
+    {
+        g_free(type);
+
+        guchar head[FILE_SNIFF_SIZE];
+        ssize_t length = 0;
 
-        _supported_mime_types = g_list_prepend(_supported_mime_types,
-                                              "image/vnd.microsoft.icon");
+        int fd = open(filepath, O_RDONLY);
+        if (fd < 0)
+            return FALSE;
 
-        _supported_mime_types = g_list_sort(_supported_mime_types,
-                                           (GCompareFunc) _compare_quarks);
+        length = read(fd, head, sizeof(head));
+        close(fd);
 
-        g_slist_free(format_list);
+        if (length < 0)
+            length = 0;
+
+        type = g_content_type_guess(filepath, head, length, NULL);
     }
 
-    return _supported_mime_types;
+    gboolean result = mime_type_is_supported(type);
+    g_free(type);
+
+    return result;
 }
 
-static gint _compare_quarks(gconstpointer a, gconstpointer b)
+static GHashTable* _extensions_get_supported()
 {
-    GQuark quark;
+    // Lowercase extension -> GdkPixbufFormat.
+
+    static gsize initialized = 0;
+
+    if (!g_once_init_enter(&initialized))
+        return _supported_extensions;
+
+    _supported_extensions = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                  g_free, NULL);
 
-    quark = g_quark_from_string((const gchar *)a);
+    GSList *format_list = gdk_pixbuf_get_formats();
 
-    return quark - GPOINTER_TO_INT(b);
+    for (GSList *it = format_list; it != NULL; it = it->next)
+    {
+        gchar **extensions =
+            gdk_pixbuf_format_get_extensions((GdkPixbufFormat *)it->data);
+
+        for (int i = 0; extensions[i] != NULL; ++i)
+        {
+            g_hash_table_insert(_supported_extensions,
+                                g_ascii_strdown(extensions[i], -1),
+                                it->data);
+        }
+
+        g_strfreev(extensions);
+    }
+
+    g_slist_free(format_list);
+
+    g_once_init_leave(&initialized, 1);
+
+    return _supported_extensions;
 }
 
 
@@ -291,42 +373,149 @@ out_error:
 }
 
 
-// VnrFile --------------------------------------------------------------------
+// VnrFileStore --------------------------------------------------------------
+
+// Records are carved from blocks of this many.
+#define FILE_STORE_BLOCK 256
 
-G_DEFINE_TYPE(VnrFile, vnr_file, G_TYPE_OBJECT)
+struct _VnrFileStore
+{
+    gint ref_count;
 
-static void vnr_file_finalize(GObject *object);
+    GStringChunk *strings;
+    GSList *blocks;
+    guint block_used;
+
+    // holds the strings of the files made by vnr_file_new_static
+    GBytes *data;
+};
+
+static VnrFile* _vnr_file_alloc(VnrFileStore *store);
+static void _vnr_file_set_names(VnrFile *file, const gchar *filepath,
+                                const gchar *display_name);
 static gboolean _vnr_file_set_path(VnrFile *file, const gchar *filepath);
 
-static void vnr_file_class_init(VnrFileClass *klass)
+VnrFileStore* vnr_file_store_new()
+{
+    VnrFileStore *store = g_slice_new0(VnrFileStore);
+
+    store->ref_count = 1;
+    store->strings = g_string_chunk_new(64 * 1024);
+    store->block_used = FILE_STORE_BLOCK;
+
+    return store;
+}
+
+VnrFileStore* vnr_file_store_new_for_data(GBytes *data)
+{
+    VnrFileStore *store = vnr_file_store_new();
+
+    store->data = g_bytes_ref(data);
+
+    return store;
+}
+
+VnrFileStore* vnr_file_store_ref(VnrFileStore *store)
+{
+    g_atomic_int_inc(&store->ref_count);
+
+    return store;
+}
+
+void vnr_file_store_unref(VnrFileStore *store)
+{
+    if (!store || !g_atomic_int_dec_and_test(&store->ref_count))
+        return;
+
+    g_string_chunk_free(store->strings);
+    g_slist_free_full(store->blocks, g_free);
+
+    if (store->data)
+        g_bytes_unref(store->data);
+
+    g_slice_free(VnrFileStore, store);
+}
+
+
+// VnrFile --------------------------------------------------------------------
+
+VnrFile* vnr_file_new(VnrFileStore *store, const gchar *filepath,
+                      const gchar *display_name)
 {
-    GObjectClass *object_class = G_OBJECT_CLASS(klass);
-    object_class->finalize = vnr_file_finalize;
+    // The record stays in the store until the store itself is released,
+    // each file keeps a reference on it.
+
+    g_return_val_if_fail(store != NULL && filepath != NULL, NULL);
+
+    VnrFile *file = _vnr_file_alloc(store);
+    _vnr_file_set_names(file, filepath, display_name);
+
+    return file;
 }
 
-static void vnr_file_init(VnrFile *file)
+VnrFile* vnr_file_new_static(VnrFileStore *store, const gchar *filepath,
+                             const gchar *display_name,
+                             const gchar *display_name_collate)
 {
-    //g_assert(file->display_name == NULL);
-    //file->display_name = NULL;
+    // The strings are not copied, they must live as long as the store,
+    // see vnr_file_store_new_for_data.
+
+    g_return_val_if_fail(store != NULL && filepath != NULL, NULL);
+
+    VnrFile *file = _vnr_file_alloc(store);
+
+    file->path = filepath;
+    file->display_name = display_name;
+    file->display_name_collate = display_name_collate;
+
+    return file;
 }
 
-static void vnr_file_finalize(GObject *object)
+static VnrFile* _vnr_file_alloc(VnrFileStore *store)
 {
-    VnrFile *file = VNR_FILE(object);
+    if (store->block_used == FILE_STORE_BLOCK)
+    {
+        store->blocks = g_slist_prepend(store->blocks,
+                                        g_new0(VnrFile, FILE_STORE_BLOCK));
+        store->block_used = 0;
+    }
 
-    g_free(file->display_name);
-    g_free(file->display_name_collate);
-    g_free(file->path);
+    VnrFile *file = (VnrFile*) store->blocks->data + store->block_used++;
+    file->store = vnr_file_store_ref(store);
 
-    G_OBJECT_CLASS(vnr_file_parent_class)->finalize(object);
+    return file;
 }
 
-VnrFile* vnr_file_new()
+void vnr_file_free(VnrFile *file)
 {
-    return VNR_FILE(g_object_new(VNR_TYPE_FILE, NULL));
+    if (!file)
+        return;
+
+    vnr_file_store_unref(file->store);
 }
 
-VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden)
+static void _vnr_file_set_names(VnrFile *file, const gchar *filepath,
+                                const gchar *display_name)
+{
+    GStringChunk *strings = file->store->strings;
+
+    file->path = g_string_chunk_insert(strings, filepath);
+
+    const gchar *name = strrchr(file->path, G_DIR_SEPARATOR);
+    name = name ? name + 1 : file->path;
+
+    if (g_strcmp0(name, display_name) == 0)
+        file->display_name = name;
+    else
+        file->display_name = g_string_chunk_insert(strings, display_name);
+
+    gchar *collate = g_utf8_collate_key_for_filename(file->display_name, -1);
+    file->display_name_collate = g_string_chunk_insert(strings, collate);
+    g_free(collate);
+}
+
+VnrFile* vnr_file_new_for_path(VnrFileStore *store, const gchar *filepath,
+                               gboolean include_hidden)
 {
     if (!filepath)
         return NULL;
@@ -340,6 +529,7 @@ VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden)
                             G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
                             G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE ","
                             G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
                             G_FILE_ATTRIBUTE_TIME_MODIFIED,
                             0, NULL, NULL);
 
@@ -359,7 +549,6 @@ VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden)
         return NULL;
     }
 
-    VnrFile *vnrfile = vnr_file_new();
     const char *mimetype = g_file_info_get_content_type(fileinfo);
 
     if (mimetype == NULL)
@@ -375,20 +564,18 @@ VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden)
     {
         g_object_unref(file);
         g_object_unref(fileinfo);
-        g_object_unref(vnrfile);
 
         return NULL;
     }
 
-    vnr_file_set_display_name(
-                        vnrfile,
-                        (char*) g_file_info_get_display_name(fileinfo));
+    VnrFile *vnrfile = vnr_file_new(store, filepath,
+                                    g_file_info_get_display_name(fileinfo));
 
     vnrfile->mtime = g_file_info_get_attribute_uint64(
                         fileinfo,
                         G_FILE_ATTRIBUTE_TIME_MODIFIED);
 
-    vnrfile->path = g_strdup(filepath);
+    vnrfile->size = g_file_info_get_size(fileinfo);
 
     g_object_unref(file);
     g_object_unref(fileinfo);
@@ -396,17 +583,6 @@ VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden)
     return vnrfile;
 }
 
-void vnr_file_set_display_name(VnrFile *vnr_file,
-                                       const gchar *display_name)
-{
-    g_free(vnr_file->display_name);
-    vnr_file->display_name = g_strdup(display_name);
-
-    g_free(vnr_file->display_name_collate);
-    vnr_file->display_name_collate =
-            g_utf8_collate_key_for_filename(display_name, -1);
-}
-
 gboolean vnr_file_copy(VnrFile *file, const gchar *filepath, gchar **outpath)
 {
     if (!file || !filepath)
@@ -446,12 +622,16 @@ gboolean vnr_file_rename(VnrFile *file, const gchar *filepath)
 
 static gboolean _vnr_file_set_path(VnrFile *file, const gchar *filepath)
 {
+    // The previous strings remain in the store, so that the old path can
+    // still be looked up in a list index until it is updated.
+
     GFile *gfile = g_file_new_for_path(filepath);
 
     GFileInfo *fileinfo = g_file_query_info(
         gfile,
         G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-        G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
+        G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
+        G_FILE_ATTRIBUTE_TIME_MODIFIED,
         0, NULL, NULL);
 
     if (fileinfo == NULL)
@@ -460,15 +640,8 @@ static gboolean _vnr_file_set_path(VnrFile *file, const gchar *filepath)
         return false;
     }
 
-    g_free(file->path);
-    file->path = g_strdup(filepath);
-
-    g_free(file->display_name);
-    file->display_name = g_strdup(g_file_info_get_display_name(fileinfo));
-
-    g_free(file->display_name_collate);
-    file->display_name_collate =
-            g_utf8_collate_key_for_filename(file->display_name, -1);
+    _vnr_file_set_names(file, filepath,
+                        g_file_info_get_display_name(fileinfo));
 
     file->mtime = g_file_info_get_attribute_uint64(
                                     fileinfo,
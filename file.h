@@ -28,29 +28,48 @@ G_BEGIN_DECLS
 // Mime types -----------------------------------------------------------------
 
 gboolean mime_type_is_supported(const char *mime_type);
+gboolean file_name_is_supported(const char *filepath);
 
-// VnrFile -------------------------------------------------------------------
+// VnrFileStore --------------------------------------------------------------
 
-#define VNR_TYPE_FILE (vnr_file_get_type())
-G_DECLARE_FINAL_TYPE(VnrFile, vnr_file, VNR, FILE, GObject)
+// Arena holding the records and strings of VnrFiles, released at once when
+// its last file is freed. Files must be created from one thread at a time.
+typedef struct _VnrFileStore VnrFileStore;
+
+VnrFileStore* vnr_file_store_new();
+VnrFileStore* vnr_file_store_new_for_data(GBytes *data);
+VnrFileStore* vnr_file_store_ref(VnrFileStore *store);
+void vnr_file_store_unref(VnrFileStore *store);
+
+// VnrFile --------------------------------------------------------------------
 
 typedef struct _VnrFile VnrFile;
 
 struct _VnrFile
 {
-    GObject __parent__;
+    VnrFileStore *store;
+
+    // strings of the store, display_name points into path when it is the
+    // file name itself
+    const gchar *path;
+    const gchar *display_name;
+    const gchar *display_name_collate;
 
-    gchar *display_name;
-    gchar *display_name_collate;
-    gchar *path;
     time_t mtime;
-};
+    goffset size;
 
-GType vnr_file_get_type() G_GNUC_CONST;
+    // capture date from Exif, 0 until read and -1 when there is none
+    gint64 taken;
+};
 
-VnrFile* vnr_file_new();
-VnrFile* vnr_file_new_for_path(const gchar *filepath, gboolean include_hidden);
-void vnr_file_set_display_name(VnrFile *vnr_file, const gchar *display_name);
+VnrFile* vnr_file_new(VnrFileStore *store, const gchar *filepath,
+                      const gchar *display_name);
+VnrFile* vnr_file_new_static(VnrFileStore *store, const gchar *filepath,
+                             const gchar *display_name,
+                             const gchar *display_name_collate);
+VnrFile* vnr_file_new_for_path(VnrFileStore *store, const gchar *filepath,
+                               gboolean include_hidden);
+void vnr_file_free(VnrFile *file);
 gboolean vnr_file_copy(VnrFile *file, const gchar *filepath, gchar **newpath);
 gboolean vnr_file_rename(VnrFile *file, const gchar *filepath);
 
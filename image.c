@@ -0,0 +1,529 @@
+
+#include "image.h"
+#include "config.h"
+#include "vnr-tools.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+// Size of the blocks fed to the loader, cancellation is checked in between.
+#define IMAGE_CHUNK_SIZE (256 * 1024)
+
+// Bytes kept from the start of the file to guess the content type.
+#define IMAGE_SNIFF_SIZE 4096
+
+// Streamed files up to this size are kept to parse their metadata, larger
+// ones have it read again from the file.
+#define IMAGE_METADATA_SIZE (1024 * 1024)
+
+// Only images at least this many times larger than the requested size are
+// decoded at a lower resolution.
+#define IMAGE_REDUCE_FACTOR 2
+
+typedef struct _ImageLoad ImageLoad;
+
+struct _ImageLoad
+{
+    GdkPixbufLoader *loader;
+
+    gint max_size;
+    gint width;
+    gint height;
+
+    VnrImageProgressFunc progress;
+    gpointer user_data;
+
+    guchar head[IMAGE_SNIFF_SIZE];
+    gsize head_length;
+};
+
+G_DEFINE_TYPE(VnrImage, vnr_image, G_TYPE_OBJECT)
+
+static void vnr_image_finalize(GObject *object);
+
+static void _image_load_init(ImageLoad *load, gint max_size,
+                             VnrImageProgressFunc progress,
+                             gpointer user_data);
+static void _image_load_on_size_prepared(GdkPixbufLoader *loader,
+                                         gint width, gint height,
+                                         ImageLoad *load);
+static void _image_load_on_area_prepared(GdkPixbufLoader *loader,
+                                         ImageLoad *load);
+static void _image_load_on_area_updated(GdkPixbufLoader *loader,
+                                        gint x, gint y,
+                                        gint width, gint height,
+                                        ImageLoad *load);
+static gboolean _image_load_write(ImageLoad *load,
+                                  const guchar *data, gsize count,
+                                  GCancellable *cancellable, GError **error);
+static VnrImage* _image_load_finish(ImageLoad *load,
+                                    const gchar *path, time_t mtime,
+                                    GBytes *data, GError **error);
+static void _image_load_abort(ImageLoad *load);
+static void _image_set_orientation(VnrImage *image);
+static gboolean _image_can_map(const gchar *path);
+
+
+static void vnr_image_class_init(VnrImageClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->finalize = vnr_image_finalize;
+}
+
+static void vnr_image_init(VnrImage *image)
+{
+    (void) image;
+}
+
+static void vnr_image_finalize(GObject *object)
+{
+    VnrImage *image = VNR_IMAGE(object);
+
+    if (image->anim)
+        g_object_unref(image->anim);
+
+    uni_exiv2_metadata_unref(image->metadata);
+
+    g_free(image->path);
+    g_free(image->format_name);
+    g_free(image->content_type);
+
+    G_OBJECT_CLASS(vnr_image_parent_class)->finalize(object);
+}
+
+VnrImage* vnr_image_new_for_path(const gchar *path, time_t mtime,
+                                 gint max_size,
+                                 GCancellable *cancellable, GError **error)
+{
+    g_return_val_if_fail(path != NULL, NULL);
+
+    GBytes *data = vnr_image_map_file(path);
+
+    if (data)
+    {
+        VnrImage *image = vnr_image_new_from_data(path, mtime, data,
+                                                  max_size, NULL, NULL,
+                                                  cancellable, error);
+        g_bytes_unref(data);
+
+        return image;
+    }
+
+    // not mapped, or the error is reported from here
+    GFile *file = g_file_new_for_path(path);
+    GFileInputStream *stream = g_file_read(file, cancellable, error);
+    g_object_unref(file);
+
+    if (!stream)
+        return NULL;
+
+    VnrImage *image = vnr_image_new_from_stream(path, mtime,
+                                                G_INPUT_STREAM(stream),
+                                                max_size, NULL, NULL,
+                                                cancellable, error);
+    g_object_unref(stream);
+
+    return image;
+}
+
+GBytes* vnr_image_map_file(const gchar *path)
+{
+    // Files of local disks are decoded and their metadata parsed from a
+    // mapping, without copies into read buffers, and read ahead is told
+    // they are read once from start to end. NULL for the others, to be
+    // read through a stream.
+    //
+    // Reading a mapped file truncated meanwhile kills the process with
+    // SIGBUS. Files that may change or vanish under the mapping, on
+    // network shares and removable media, aren't mapped, nor are those
+    // whose size changed while they were being mapped. A local file
+    // truncated in place during the decode remains a risk, most programs
+    // write a new file and rename it over the old one.
+
+    if (!_image_can_map(path))
+        return NULL;
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped)
+        return NULL;
+
+    gchar *contents = g_mapped_file_get_contents(mapped);
+    gsize length = g_mapped_file_get_length(mapped);
+
+    struct stat st;
+
+    if (stat(path, &st) != 0 || (gsize) st.st_size != length)
+    {
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+
+#ifdef POSIX_MADV_SEQUENTIAL
+    if (contents && length > 0)
+        posix_madvise(contents, length, POSIX_MADV_SEQUENTIAL);
+#endif
+
+    GBytes *data = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    return data;
+}
+
+static gboolean _image_can_map(const gchar *path)
+{
+    // Only the filesystems of local disks. Removable media mostly use
+    // FAT, exFAT or NTFS through FUSE, which are left out along with the
+    // network filesystems.
+
+#ifdef __linux__
+    struct statfs sfs;
+
+    if (statfs(path, &sfs) != 0)
+        return FALSE;
+
+    switch ((guint32) sfs.f_type)
+    {
+    case 0xEF53:        // ext2, ext3, ext4
+    case 0x58465342:    // xfs
+    case 0x9123683E:    // btrfs
+    case 0xF2F52010:    // f2fs
+    case 0x2FC12FC1:    // zfs
+    case 0x01021994:    // tmpfs
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+#else
+    (void) path;
+
+    return FALSE;
+#endif
+}
+
+VnrImage* vnr_image_new_from_data(const gchar *path, time_t mtime,
+                                  GBytes *data, gint max_size,
+                                  VnrImageProgressFunc progress,
+                                  gpointer user_data,
+                                  GCancellable *cancellable, GError **error)
+{
+    g_return_val_if_fail(path != NULL && data != NULL, NULL);
+
+    ImageLoad load;
+    _image_load_init(&load, max_size, progress, user_data);
+
+    gsize size = 0;
+    const guchar *contents = g_bytes_get_data(data, &size);
+
+    // fed in chunks all the same, for cancellation and progress
+    for (gsize offset = 0; offset < size; offset += IMAGE_CHUNK_SIZE)
+    {
+        gsize count = MIN(size - offset, IMAGE_CHUNK_SIZE);
+
+        if (!_image_load_write(&load, contents + offset, count,
+                               cancellable, error))
+        {
+            _image_load_abort(&load);
+
+            return NULL;
+        }
+    }
+
+    return _image_load_finish(&load, path, mtime, data, error);
+}
+
+VnrImage* vnr_image_new_from_stream(const gchar *path, time_t mtime,
+                                    GInputStream *stream, gint max_size,
+                                    VnrImageProgressFunc progress,
+                                    gpointer user_data,
+                                    GCancellable *cancellable, GError **error)
+{
+    g_return_val_if_fail(path != NULL && G_IS_INPUT_STREAM(stream), NULL);
+
+    // Small files are kept for the metadata, so that they are read once.
+    // Larger ones aren't buffered whole, Exiv2 reads only the parts
+    // holding the metadata from the file afterwards.
+
+    ImageLoad load;
+    _image_load_init(&load, max_size, progress, user_data);
+
+    GByteArray *contents = g_byte_array_new();
+    guchar *buffer = g_malloc(IMAGE_CHUNK_SIZE);
+
+    while (true)
+    {
+        gssize count = g_input_stream_read(stream, buffer, IMAGE_CHUNK_SIZE,
+                                           cancellable, error);
+        if (count == 0)
+            break;
+
+        if (count < 0
+            || !_image_load_write(&load, buffer, count, cancellable, error))
+        {
+            g_free(buffer);
+            if (contents)
+                g_byte_array_unref(contents);
+            _image_load_abort(&load);
+
+            return NULL;
+        }
+
+        if (contents && contents->len + count > IMAGE_METADATA_SIZE)
+            g_clear_pointer(&contents, g_byte_array_unref);
+
+        if (contents)
+            g_byte_array_append(contents, buffer, count);
+    }
+
+    g_free(buffer);
+
+    GBytes *data = contents ? g_byte_array_free_to_bytes(contents) : NULL;
+    VnrImage *image = _image_load_finish(&load, path, mtime, data, error);
+    if (data)
+        g_bytes_unref(data);
+
+    return image;
+}
+
+// Whether the pixels are enough to show the image fitted in a box of
+// max_size x max_size, or at full resolution when max_size is 0.
+gboolean vnr_image_covers(VnrImage *image, gint max_size)
+{
+    g_return_val_if_fail(image != NULL, FALSE);
+
+    if (image->scale >= 1.0)
+        return true;
+
+    if (max_size <= 0)
+        return false;
+
+    return MAX(image->width, image->height) * image->scale + 0.5 >= max_size;
+}
+
+
+// Chunked loading ------------------------------------------------------------
+
+static void _image_load_init(ImageLoad *load, gint max_size,
+                             VnrImageProgressFunc progress,
+                             gpointer user_data)
+{
+    load->loader = gdk_pixbuf_loader_new();
+    load->max_size = max_size;
+    load->width = 0;
+    load->height = 0;
+    load->progress = progress;
+    load->user_data = user_data;
+    load->head_length = 0;
+
+    g_signal_connect(load->loader, "size-prepared",
+                     G_CALLBACK(_image_load_on_size_prepared), load);
+
+    if (!progress)
+        return;
+
+    g_signal_connect(load->loader, "area-prepared",
+                     G_CALLBACK(_image_load_on_area_prepared), load);
+    g_signal_connect(load->loader, "area-updated",
+                     G_CALLBACK(_image_load_on_area_updated), load);
+}
+
+static void _image_load_on_size_prepared(GdkPixbufLoader *loader,
+                                         gint width, gint height,
+                                         ImageLoad *load)
+{
+    load->width = width;
+    load->height = height;
+
+    if (load->max_size <= 0
+        || MAX(width, height) < load->max_size * IMAGE_REDUCE_FACTOR)
+        return;
+
+    // the JPEG decoder scales in the DCT, others would decode everything
+    // and resample afterwards
+    GdkPixbufFormat *format = gdk_pixbuf_loader_get_format(loader);
+    if (!format)
+        return;
+
+    gchar *name = gdk_pixbuf_format_get_name(format);
+    gboolean is_jpeg = g_strcmp0(name, "jpeg") == 0;
+    g_free(name);
+
+    if (!is_jpeg)
+        return;
+
+    gdouble scale = (gdouble) load->max_size / MAX(width, height);
+
+    gdk_pixbuf_loader_set_size(loader,
+                               MAX(1, (gint) (width * scale + 0.5)),
+                               MAX(1, (gint) (height * scale + 0.5)));
+}
+
+static void _image_load_on_area_prepared(GdkPixbufLoader *loader,
+                                         ImageLoad *load)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+
+    // the final image will be rotated, a partial one would jump around
+    const gchar *orientation = gdk_pixbuf_get_option(pixbuf, "orientation");
+
+    if (orientation && g_strcmp0(orientation, "1") != 0)
+    {
+        load->progress = NULL;
+        return;
+    }
+
+    // rows not decoded yet are shown as background
+    gdk_pixbuf_fill(pixbuf, 0x00000000);
+}
+
+static void _image_load_on_area_updated(GdkPixbufLoader *loader,
+                                        gint x, gint y,
+                                        gint width, gint height,
+                                        ImageLoad *load)
+{
+    if (!load->progress)
+        return;
+
+    GdkRectangle area = {x, y, width, height};
+
+    load->progress(gdk_pixbuf_loader_get_pixbuf(loader), &area,
+                   load->user_data);
+}
+
+static gboolean _image_load_write(ImageLoad *load,
+                                  const guchar *data, gsize count,
+                                  GCancellable *cancellable, GError **error)
+{
+    if (g_cancellable_set_error_if_cancelled(cancellable, error))
+        return false;
+
+    if (load->head_length < IMAGE_SNIFF_SIZE)
+    {
+        gsize n = MIN(count, IMAGE_SNIFF_SIZE - load->head_length);
+
+        memcpy(load->head + load->head_length, data, n);
+        load->head_length += n;
+    }
+
+    return gdk_pixbuf_loader_write(load->loader, data, count, error);
+}
+
+static VnrImage* _image_load_finish(ImageLoad *load,
+                                    const gchar *path, time_t mtime,
+                                    GBytes *data, GError **error)
+{
+    GdkPixbufLoader *loader = load->loader;
+
+    if (!gdk_pixbuf_loader_close(loader, error))
+    {
+        g_object_unref(loader);
+        return NULL;
+    }
+
+    GdkPixbufAnimation *anim = gdk_pixbuf_loader_get_animation(loader);
+
+    if (!anim)
+    {
+        g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED,
+                    _("Failed to load image \"%s\""), path);
+        g_object_unref(loader);
+
+        return NULL;
+    }
+
+    VnrImage *image = VNR_IMAGE(g_object_new(VNR_TYPE_IMAGE, NULL));
+
+    image->path = g_strdup(path);
+    image->mtime = mtime;
+    image->anim = g_object_ref(anim);
+
+    gint decoded_width = gdk_pixbuf_animation_get_width(anim);
+
+    image->width = load->width;
+    image->height = load->height;
+    image->scale = 1.0;
+
+    if (decoded_width > 0 && load->width > decoded_width)
+        image->scale = (gdouble) decoded_width / load->width;
+
+    // read once here for the properties, the orientation and saving, from
+    // the same bytes as the pixels when they were kept
+    if (data)
+        image->metadata = uni_exiv2_metadata_new_for_data(
+                                            g_bytes_get_data(data, NULL),
+                                            g_bytes_get_size(data));
+    else
+        image->metadata = uni_exiv2_metadata_new(path);
+
+    _image_set_orientation(image);
+    vnr_tools_apply_embedded_orientation(&image->anim);
+
+    // rotated by 90 or 270 degrees
+    if (gdk_pixbuf_animation_get_width(image->anim) != decoded_width)
+    {
+        image->width = load->height;
+        image->height = load->width;
+    }
+
+    if (image->width <= 0 || image->height <= 0)
+    {
+        image->width = gdk_pixbuf_animation_get_width(image->anim);
+        image->height = gdk_pixbuf_animation_get_height(image->anim);
+    }
+
+    GdkPixbufFormat *format = gdk_pixbuf_loader_get_format(loader);
+
+    if (format)
+    {
+        image->format_name = gdk_pixbuf_format_get_name(format);
+        image->writable = gdk_pixbuf_format_is_writable(format);
+    }
+
+    image->content_type = g_content_type_guess(path,
+                                               load->head, load->head_length,
+                                               NULL);
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_animation_get_static_image(image->anim);
+    if (pixbuf)
+        image->size = gdk_pixbuf_get_byte_length(pixbuf);
+
+    g_object_unref(loader);
+
+    return image;
+}
+
+static void _image_load_abort(ImageLoad *load)
+{
+    gdk_pixbuf_loader_close(load->loader, NULL);
+    g_object_unref(load->loader);
+}
+
+static void _image_set_orientation(VnrImage *image)
+{
+    // Not every decoder reports the Exif orientation, PNG and WebP ones
+    // don't, it's taken from the metadata then.
+
+    if (!image->metadata
+        || !gdk_pixbuf_animation_is_static_image(image->anim))
+        return;
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_animation_get_static_image(image->anim);
+
+    if (gdk_pixbuf_get_option(pixbuf, "orientation"))
+        return;
+
+    gint orientation = uni_exiv2_metadata_get_orientation(image->metadata);
+    if (orientation <= 1 || orientation > 8)
+        return;
+
+    gchar value[8];
+    g_snprintf(value, sizeof(value), "%d", orientation);
+    gdk_pixbuf_set_option(pixbuf, "orientation", value);
+}
+
+
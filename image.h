@@ -0,0 +1,66 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <gtk/gtk.h>
+#include "uni-exiv2.hpp"
+
+G_BEGIN_DECLS
+
+// VnrImage -------------------------------------------------------------------
+
+#define VNR_TYPE_IMAGE (vnr_image_get_type())
+G_DECLARE_FINAL_TYPE(VnrImage, vnr_image, VNR, IMAGE, GObject)
+
+typedef struct _VnrImage VnrImage;
+
+struct _VnrImage
+{
+    GObject __parent__;
+
+    gchar *path;
+    time_t mtime;
+    GdkPixbufAnimation *anim;
+    gchar *format_name;
+    gboolean writable;
+    gchar *content_type;
+    gsize size;
+
+    // size of the image in the file, the pixels may have been decoded
+    // at a lower resolution, see vnr_image_covers()
+    gint width;
+    gint height;
+    gdouble scale;
+
+    // parsed with the pixels, NULL when the file has none
+    UniExiv2Metadata *metadata;
+};
+
+GType vnr_image_get_type() G_GNUC_CONST;
+
+// Called on the decoding thread each time rows of @pixbuf are decoded.
+typedef void (*VnrImageProgressFunc)(GdkPixbuf *pixbuf,
+                                     const GdkRectangle *area,
+                                     gpointer user_data);
+
+VnrImage* vnr_image_new_for_path(const gchar *path, time_t mtime,
+                                 gint max_size,
+                                 GCancellable *cancellable, GError **error);
+GBytes* vnr_image_map_file(const gchar *path);
+VnrImage* vnr_image_new_from_data(const gchar *path, time_t mtime,
+                                  GBytes *data, gint max_size,
+                                  VnrImageProgressFunc progress,
+                                  gpointer user_data,
+                                  GCancellable *cancellable, GError **error);
+VnrImage* vnr_image_new_from_stream(const gchar *path, time_t mtime,
+                                    GInputStream *stream, gint max_size,
+                                    VnrImageProgressFunc progress,
+                                    gpointer user_data,
+                                    GCancellable *cancellable, GError **error);
+
+gboolean vnr_image_covers(VnrImage *image, gint max_size);
+
+G_END_DECLS
+
+#endif // IMAGE_H
+
+
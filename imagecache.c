@@ -0,0 +1,194 @@
+
+#include "imagecache.h"
+#include "config.h"
+
+// Least recently used images are at the tail of the queue and are dropped
+// first once the decoded pixels exceed the budget. The cache is shared
+// with the prefetch workers, every function takes the lock.
+
+struct _VnrImageCache
+{
+    GMutex mutex;
+    GQueue queue;
+    GHashTable *links;
+    gsize total_size;
+    gsize budget;
+};
+
+static void _cache_remove_link(VnrImageCache *cache, GList *link);
+static void _cache_enforce_budget(VnrImageCache *cache);
+
+
+VnrImageCache* vnr_image_cache_new(gsize budget)
+{
+    VnrImageCache *cache = g_slice_new0(VnrImageCache);
+
+    g_mutex_init(&cache->mutex);
+    g_queue_init(&cache->queue);
+
+    // keys are owned by the images
+    cache->links = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->budget = budget;
+
+    return cache;
+}
+
+void vnr_image_cache_free(VnrImageCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_hash_table_destroy(cache->links);
+    g_queue_foreach(&cache->queue, (GFunc) g_object_unref, NULL);
+    g_queue_clear(&cache->queue);
+    g_mutex_clear(&cache->mutex);
+
+    g_slice_free(VnrImageCache, cache);
+}
+
+void vnr_image_cache_set_budget(VnrImageCache *cache, gsize budget)
+{
+    g_return_if_fail(cache != NULL);
+
+    g_mutex_lock(&cache->mutex);
+
+    cache->budget = budget;
+    _cache_enforce_budget(cache);
+
+    g_mutex_unlock(&cache->mutex);
+}
+
+gsize vnr_image_cache_get_budget(VnrImageCache *cache)
+{
+    g_return_val_if_fail(cache != NULL, 0);
+
+    g_mutex_lock(&cache->mutex);
+    gsize budget = cache->budget;
+    g_mutex_unlock(&cache->mutex);
+
+    return budget;
+}
+
+VnrImage* vnr_image_cache_lookup(VnrImageCache *cache,
+                                 const gchar *path, time_t mtime)
+{
+    g_return_val_if_fail(cache != NULL, NULL);
+    g_return_val_if_fail(path != NULL, NULL);
+
+    g_mutex_lock(&cache->mutex);
+
+    GList *link = g_hash_table_lookup(cache->links, path);
+    VnrImage *image = NULL;
+
+    if (link && VNR_IMAGE(link->data)->mtime != mtime)
+    {
+        _cache_remove_link(cache, link);
+    }
+    else if (link)
+    {
+        g_queue_unlink(&cache->queue, link);
+        g_queue_push_head_link(&cache->queue, link);
+
+        image = g_object_ref(link->data);
+    }
+
+    g_mutex_unlock(&cache->mutex);
+
+    return image;
+}
+
+gboolean vnr_image_cache_contains(VnrImageCache *cache,
+                                  const gchar *path, time_t mtime,
+                                  gint max_size)
+{
+    g_return_val_if_fail(cache != NULL, FALSE);
+    g_return_val_if_fail(path != NULL, FALSE);
+
+    g_mutex_lock(&cache->mutex);
+
+    GList *link = g_hash_table_lookup(cache->links, path);
+    gboolean ret = link && VNR_IMAGE(link->data)->mtime == mtime
+                   && vnr_image_covers(VNR_IMAGE(link->data), max_size);
+
+    g_mutex_unlock(&cache->mutex);
+
+    return ret;
+}
+
+void vnr_image_cache_insert(VnrImageCache *cache, VnrImage *image)
+{
+    g_return_if_fail(cache != NULL);
+    g_return_if_fail(image != NULL && image->path != NULL);
+
+    g_mutex_lock(&cache->mutex);
+
+    GList *link = g_hash_table_lookup(cache->links, image->path);
+    VnrImage *cached = link ? VNR_IMAGE(link->data) : NULL;
+
+    // don't replace pixels of a higher resolution by a reduced decode
+    if (cached && (cached == image
+                   || (cached->mtime == image->mtime
+                       && cached->scale > image->scale)))
+    {
+        g_queue_unlink(&cache->queue, link);
+        g_queue_push_head_link(&cache->queue, link);
+
+        g_mutex_unlock(&cache->mutex);
+        return;
+    }
+
+    if (link)
+        _cache_remove_link(cache, link);
+
+    // it would only push everything else out and be dropped itself
+    if (image->size > cache->budget)
+    {
+        g_mutex_unlock(&cache->mutex);
+        return;
+    }
+
+    g_queue_push_head(&cache->queue, g_object_ref(image));
+    g_hash_table_insert(cache->links, image->path, cache->queue.head);
+
+    cache->total_size += image->size;
+    _cache_enforce_budget(cache);
+
+    g_mutex_unlock(&cache->mutex);
+}
+
+void vnr_image_cache_remove(VnrImageCache *cache, const gchar *path)
+{
+    g_return_if_fail(cache != NULL);
+
+    if (!path)
+        return;
+
+    g_mutex_lock(&cache->mutex);
+
+    GList *link = g_hash_table_lookup(cache->links, path);
+
+    if (link)
+        _cache_remove_link(cache, link);
+
+    g_mutex_unlock(&cache->mutex);
+}
+
+static void _cache_remove_link(VnrImageCache *cache, GList *link)
+{
+    VnrImage *image = VNR_IMAGE(link->data);
+
+    g_hash_table_remove(cache->links, image->path);
+    g_queue_delete_link(&cache->queue, link);
+
+    cache->total_size -= image->size;
+
+    g_object_unref(image);
+}
+
+static void _cache_enforce_budget(VnrImageCache *cache)
+{
+    while (cache->total_size > cache->budget && cache->queue.tail)
+        _cache_remove_link(cache, cache->queue.tail);
+}
+
+
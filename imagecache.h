@@ -0,0 +1,27 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "image.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrImageCache VnrImageCache;
+
+VnrImageCache* vnr_image_cache_new(gsize budget);
+void vnr_image_cache_free(VnrImageCache *cache);
+
+void vnr_image_cache_set_budget(VnrImageCache *cache, gsize budget);
+gsize vnr_image_cache_get_budget(VnrImageCache *cache);
+VnrImage* vnr_image_cache_lookup(VnrImageCache *cache,
+                                 const gchar *path, time_t mtime);
+gboolean vnr_image_cache_contains(VnrImageCache *cache,
+                                  const gchar *path, time_t mtime,
+                                  gint max_size);
+void vnr_image_cache_insert(VnrImageCache *cache, VnrImage *image);
+void vnr_image_cache_remove(VnrImageCache *cache, const gchar *path);
+
+G_END_DECLS
+
+#endif // IMAGECACHE_H
+
+
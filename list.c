@@ -1,14 +1,221 @@
 #include "list.h"
 #include "config.h"
+#include "listcache.h"
+#include "uni-exiv2.hpp"
 
-static gint _file_compare_func(VnrFile *file, char *uri);
-static gint _list_compare_func(gconstpointer a, gconstpointer b,
-                               gpointer user_data);
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Number of files handed to the main thread at once by
+// vnr_list_scan_dir_async.
+#define LIST_BATCH_SIZE 512
+
+// Below this, _list_sort doesn't use the workers.
+#define LIST_SORT_PARALLEL 8192
+#define LIST_SORT_MAX_PARTS 16
+
+struct _VnrFileList
+{
+    // sorted by _list_compare_files, owns the files
+    GPtrArray *files;
+
+    // path -> VnrFile, the old path of a renamed file stays valid in its
+    // store until vnr_list_update
+    GHashTable *index;
+
+    // for the files added by vnr_list_insert_path
+    VnrFileStore *store;
+
+    // the folder listed, NULL for a list of files
+    gchar *directory;
+
+    gint current;
+    VnrListOrder order;
+};
+
+typedef void (*ListEmitFunc)(GPtrArray *batch, gpointer data);
+
+typedef struct _ListScan ListScan;
+
+struct _ListScan
+{
+    gchar *directory;
+    gboolean include_hidden;
+    VnrListOrder order;
+    VnrListBatchFunc func;
+    gpointer user_data;
+
+    // filled by _list_scan_emit
+    VnrListCache *cache;
+};
+
+typedef struct _ListBatch ListBatch;
+
+struct _ListBatch
+{
+    GTask *task;
+    GPtrArray *files;
+};
+
+// Sort key, the files are sorted through a compact array of these.
+typedef struct _ListKey ListKey;
+
+struct _ListKey
+{
+    gint64 value;
+    const gchar *collate;
+    VnrFile *file;
+};
+
+typedef struct _ListDates ListDates;
+
+struct _ListDates
+{
+    // taken[i] is the capture date of paths[i], -1 when it has none
+    GPtrArray *paths;
+    gint64 *mtimes;
+    gint64 *taken;
+};
+
+typedef struct _ListDatesPart ListDatesPart;
+
+struct _ListDatesPart
+{
+    const gchar **paths;
+    gint64 *taken;
+    gint start;
+    gint end;
+};
+
+// Parts of a sort or of a date read run by the shared workers, see
+// _list_run_parts.
+typedef struct _ListJob ListJob;
+
+struct _ListJob
+{
+    GMutex mutex;
+    GCond cond;
+    gint pending;
+};
+
+typedef struct _ListWork ListWork;
+
+struct _ListWork
+{
+    ListJob *job;
+    GThreadFunc func;
+    gpointer data;
+};
+
+typedef struct _ListSortPart ListSortPart;
+
+struct _ListSortPart
+{
+    VnrFile **files;
+    ListKey *keys;
+    ListKey *dest;
+    gint start;
+    gint middle;
+    gint end;
+    VnrListOrder order;
+};
+
+static VnrFileList* _list_new(GPtrArray *files);
+static VnrFileList* _list_new_sorted(GPtrArray *files, VnrListOrder order);
+static GPtrArray* _list_array_new();
+static gboolean _list_scan_dir(gchar *directory, gboolean include_hidden,
+                               GCancellable *cancellable,
+                               ListEmitFunc emit, gpointer data,
+                               GPtrArray **files);
+static void _list_enumerate_dir(gchar *directory, gboolean include_hidden,
+                                GPtrArray *files);
+static void _list_steal(VnrFileList *list, gint index);
+static void _list_scan_free(ListScan *scan);
+static void _list_scan_thread(GTask *task, gpointer source_object,
+                              gpointer task_data,
+                              GCancellable *cancellable);
+static void _list_scan_emit(GPtrArray *batch, gpointer data);
+static gboolean _list_scan_deliver(gpointer user_data);
+static gboolean _list_index_match(gpointer key, gpointer value,
+                                  gpointer user_data);
+static gint _list_lookup(VnrFileList *list, VnrFile *file);
+static gint _list_bound(VnrFileList *list, VnrFile *file);
+static void _list_dates_free(ListDates *dates);
+static void _list_dates_thread(GTask *task, gpointer source_object,
+                               gpointer task_data,
+                               GCancellable *cancellable);
+static GThreadPool* _list_get_pool();
+static void _list_work(ListWork *work, gpointer user_data);
+static void _list_run_parts(GThreadFunc func, gpointer parts,
+                            gsize part_size, gint n_parts);
+static void _list_read_dates(const gchar **paths, gint64 *taken,
+                             gint length);
+static gpointer _list_read_dates_part(gpointer data);
+static void _list_sort(VnrFile **files, gint length, VnrListOrder order);
+static gpointer _list_sort_part(gpointer data);
+static gpointer _list_merge_part(gpointer data);
+static void _list_key_init(ListKey *key, VnrFile *file, VnrListOrder order);
+static gint _list_compare_keys(const void *a, const void *b);
+static gint _list_compare_files(VnrFile *a, VnrFile *b, VnrListOrder order);
 
 // create ---------------------------------------------------------------------
 
-GList* vnr_list_new_for_path(gchar *filepath, gboolean include_hidden,
-                             GError **error)
+static VnrFileList* _list_new(GPtrArray *files)
+{
+    // Takes the files, sorts them and drops the duplicates. Returns NULL
+    // for an empty array, as the constructors below do for no images.
+
+    _list_sort((VnrFile**) files->pdata, files->len, VNR_LIST_ORDER_NAME);
+
+    return _list_new_sorted(files, VNR_LIST_ORDER_NAME);
+}
+
+static VnrFileList* _list_new_sorted(GPtrArray *files, VnrListOrder order)
+{
+    // Same as _list_new for files already sorted in order.
+
+    if (files->len == 0)
+    {
+        g_ptr_array_unref(files);
+        return NULL;
+    }
+
+    VnrFileList *list = g_slice_new0(VnrFileList);
+    list->files = files;
+    list->index = g_hash_table_new(g_str_hash, g_str_equal);
+    list->current = 0;
+    list->order = order;
+
+    guint i = 0;
+
+    while (i < files->len)
+    {
+        VnrFile *file = g_ptr_array_index(files, i);
+
+        if (g_hash_table_contains(list->index, file->path))
+        {
+            g_ptr_array_remove_index(files, i);
+            continue;
+        }
+
+        g_hash_table_insert(list->index, (gpointer) file->path, file);
+        ++i;
+    }
+
+    return list;
+}
+
+static GPtrArray* _list_array_new()
+{
+    return g_ptr_array_new_with_free_func((GDestroyNotify) vnr_file_free);
+}
+
+VnrFileList* vnr_list_new_for_path(gchar *filepath, gboolean include_hidden,
+                                   GError **error)
 {
     GFile *file = g_file_new_for_path(filepath);
 
@@ -23,15 +230,28 @@ GList* vnr_list_new_for_path(gchar *filepath, gboolean include_hidden,
 
     GFileType filetype = g_file_info_get_file_type(fileinfo);
 
-    GList *filelist = NULL;
+    VnrFileList *filelist = NULL;
 
-    if (filetype == G_FILE_TYPE_DIRECTORY)
-    {
-        filelist = vnr_list_new_for_dir(filepath, TRUE, include_hidden);
-    }
-    else
+    // Directories are listed by vnr_list_scan_dir_async, not here on the
+    // main thread.
+    if (filetype != G_FILE_TYPE_DIRECTORY)
     {
-        filelist = vnr_list_new_for_file(filepath, include_hidden, false);
+        // Only the file itself, the rest of its directory is added by
+        // vnr_list_scan_dir_async.
+        GPtrArray *files = _list_array_new();
+        VnrFileStore *store = vnr_file_store_new();
+        VnrFile *vnrfile = vnr_file_new_for_path(store, filepath,
+                                                 include_hidden);
+
+        if (vnrfile)
+            g_ptr_array_add(files, vnrfile);
+
+        vnr_file_store_unref(store);
+
+        filelist = _list_new(files);
+
+        if (filelist)
+            filelist->directory = g_path_get_dirname(filepath);
     }
 
     g_object_unref(fileinfo);
@@ -40,41 +260,237 @@ GList* vnr_list_new_for_path(gchar *filepath, gboolean include_hidden,
     return filelist;
 }
 
-GList* vnr_list_new_for_file(gchar *filepath,
-                             gboolean include_hidden, gboolean try_first)
+VnrFileList* vnr_list_new_for_batch(GPtrArray *batch, VnrListOrder order,
+                                    const gchar *directory)
 {
-    if (!filepath)
-        return NULL;
+    // Takes a batch of vnr_list_scan_dir_async, already sorted, as the
+    // start of the list of the directory. NULL for an empty batch.
 
-    gchar *directory = g_path_get_dirname(filepath);
-    if (!directory)
-        return NULL;
+    VnrFileList *filelist = _list_new_sorted(batch, order);
 
-    GList *filelist = vnr_list_new_for_dir(directory, TRUE, include_hidden);
-    g_free(directory);
+    if (filelist)
+        filelist->directory = g_strdup(directory);
 
-    if (!filelist)
-        return NULL;
+    return filelist;
+}
 
-    GList *find = vnr_list_find(filelist, filepath);
+void vnr_list_scan_dir_async(const gchar *directory,
+                             gboolean include_hidden,
+                             VnrListOrder order,
+                             GCancellable *cancellable,
+                             VnrListBatchFunc batch_func,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+    // Builds the list of a directory on a worker thread. Every
+    // LIST_BATCH_SIZE files, a sorted batch is passed to batch_func on the
+    // main thread, unless the scan has been cancelled meanwhile. A cached
+    // listing comes as a single batch.
+
+    ListScan *scan = g_slice_new0(ListScan);
+    scan->directory = g_strdup(directory);
+    scan->include_hidden = include_hidden;
+    scan->order = order;
+    scan->func = batch_func;
+    scan->user_data = user_data;
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_task_data(task, scan, (GDestroyNotify) _list_scan_free);
+    g_task_run_in_thread(task, _list_scan_thread);
+    g_object_unref(task);
+}
+
+gboolean vnr_list_scan_dir_finish(GAsyncResult *result, GError **error)
+{
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
 
-    if (!find)
+static void _list_scan_free(ListScan *scan)
+{
+    g_free(scan->directory);
+    vnr_list_cache_free(scan->cache);
+    g_slice_free(ListScan, scan);
+}
+
+static void _list_scan_thread(GTask *task, gpointer source_object,
+                              gpointer task_data,
+                              GCancellable *cancellable)
+{
+    (void) source_object;
+
+    ListScan *scan = (ListScan*) task_data;
+    GPtrArray *files = _list_array_new();
+
+    gboolean cached = vnr_list_cache_load(scan->directory,
+                                          scan->include_hidden, files);
+
+    if (!cached)
+        scan->cache = vnr_list_cache_new(scan->directory,
+                                         scan->include_hidden);
+
+    if (!cached && !_list_scan_dir(scan->directory, scan->include_hidden,
+                                   cancellable, _list_scan_emit, task,
+                                   &files))
     {
-        if (try_first)
-            return g_list_first(filelist);
-        else
-            return vnr_list_free(filelist);
+        scan->cache = vnr_list_cache_free(scan->cache);
+        _list_enumerate_dir(scan->directory, scan->include_hidden, files);
     }
 
-    return find;
+    if (files->len > 0)
+        _list_scan_emit(files, task);
+    else
+        g_ptr_array_unref(files);
+
+    if (!g_cancellable_is_cancelled(cancellable))
+        vnr_list_cache_save(scan->cache);
+
+    if (!g_task_return_error_if_cancelled(task))
+        g_task_return_boolean(task, TRUE);
 }
 
-GList* vnr_list_new_for_dir(gchar *directory, gboolean sort,
-                            gboolean include_hidden)
+static void _list_scan_emit(GPtrArray *batch, gpointer data)
 {
-    if (!directory)
-        return NULL;
+    ListBatch *item = g_slice_new(ListBatch);
+    item->task = g_object_ref(G_TASK(data));
+    item->files = batch;
+
+    // the capture dates are read here rather than on the main thread, the
+    // batch isn't shared yet
+    ListScan *scan = g_task_get_task_data(item->task);
+
+    if (scan->order == VNR_LIST_ORDER_TAKEN)
+    {
+        const gchar **paths = g_new(const gchar*, batch->len);
+        gint64 *taken = g_new(gint64, batch->len);
+
+        for (guint i = 0; i < batch->len; ++i)
+        {
+            VnrFile *file = g_ptr_array_index(batch, i);
+            paths[i] = file->path;
+            taken[i] = file->taken;
+        }
+
+        _list_read_dates(paths, taken, batch->len);
+
+        for (guint i = 0; i < batch->len; ++i)
+        {
+            VnrFile *file = g_ptr_array_index(batch, i);
+            file->taken = taken[i];
+        }
+
+        g_free(taken);
+        g_free(paths);
+    }
+
+    _list_sort((VnrFile**) batch->pdata, batch->len, scan->order);
+
+    vnr_list_cache_add(scan->cache, batch);
+
+    // Same priority as the completion of the task, so that batches are
+    // delivered before it.
+    g_main_context_invoke_full(g_task_get_context(item->task),
+                               G_PRIORITY_DEFAULT,
+                               _list_scan_deliver, item, NULL);
+}
+
+static gboolean _list_scan_deliver(gpointer user_data)
+{
+    ListBatch *item = (ListBatch*) user_data;
+    ListScan *scan = g_task_get_task_data(item->task);
+
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(item->task)))
+        g_ptr_array_unref(item->files);
+    else
+        scan->func(item->files, scan->order, scan->user_data);
+
+    g_object_unref(item->task);
+    g_slice_free(ListBatch, item);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean _list_scan_dir(gchar *directory, gboolean include_hidden,
+                               GCancellable *cancellable,
+                               ListEmitFunc emit, gpointer data,
+                               GPtrArray **files)
+{
+    // Fast path for local directories : entries come from readdir and
+    // fstatat and are classified by their extension, see
+    // file_name_is_supported. With an emit function, the files are
+    // passed on in batches instead of being all returned in files, each
+    // batch with its own store.
 
+    DIR *dir = opendir(directory);
+    if (!dir)
+        return FALSE;
+
+    int dfd = dirfd(dir);
+    struct dirent *entry;
+
+    VnrFileStore *store = vnr_file_store_new();
+
+    GString *path = g_string_new(directory);
+    g_string_append_c(path, G_DIR_SEPARATOR);
+    gsize prefix = path->len;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (g_cancellable_is_cancelled(cancellable))
+            break;
+
+        const char *name = entry->d_name;
+
+        if (name[0] == '.')
+        {
+            if (!include_hidden
+                || name[1] == '\0'
+                || (name[1] == '.' && name[2] == '\0'))
+                continue;
+        }
+
+        if (entry->d_type == DT_DIR)
+            continue;
+
+        struct stat st;
+        if (fstatat(dfd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        g_string_truncate(path, prefix);
+        g_string_append(path, name);
+
+        if (!file_name_is_supported(path->str))
+            continue;
+
+        gchar *display_name = g_filename_display_name(name);
+        VnrFile *vnrfile = vnr_file_new(store, path->str, display_name);
+        g_free(display_name);
+
+        vnrfile->mtime = st.st_mtime;
+        vnrfile->size = st.st_size;
+
+        g_ptr_array_add(*files, vnrfile);
+
+        if (emit && (*files)->len == LIST_BATCH_SIZE)
+        {
+            emit(*files, data);
+            *files = _list_array_new();
+
+            vnr_file_store_unref(store);
+            store = vnr_file_store_new();
+        }
+    }
+
+    closedir(dir);
+
+    g_string_free(path, TRUE);
+    vnr_file_store_unref(store);
+
+    return TRUE;
+}
+
+static void _list_enumerate_dir(gchar *directory, gboolean include_hidden,
+                                GPtrArray *files)
+{
     GFile *gfile = g_file_new_for_path(directory);
 
     GFileEnumerator *file_enum = g_file_enumerate_children(
@@ -84,18 +500,23 @@ GList* vnr_list_new_for_dir(gchar *directory, gboolean sort,
                         G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
                         G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE ","
                         G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                        G_FILE_ATTRIBUTE_STANDARD_SIZE ","
                         G_FILE_ATTRIBUTE_TIME_MODIFIED,
                         G_FILE_QUERY_INFO_NONE,
                         NULL, NULL);
 
-    GList *list = NULL;
+    if (!file_enum)
+    {
+        g_object_unref(gfile);
+        return;
+    }
+
+    VnrFileStore *store = vnr_file_store_new();
 
     GFileInfo *fileinfo = g_file_enumerator_next_file(file_enum, NULL, NULL);
 
     while (fileinfo)
     {
-        VnrFile *vnrfile = vnr_file_new();
-
         const char *mimetype = g_file_info_get_content_type(fileinfo);
         if (mimetype == NULL)
         {
@@ -107,18 +528,23 @@ GList* vnr_list_new_for_dir(gchar *directory, gboolean sort,
         if (mime_type_is_supported(mimetype)
             && (include_hidden || !g_file_info_get_is_hidden(fileinfo)))
         {
-            vnr_file_set_display_name(
-                vnrfile,
-                (char*) g_file_info_get_display_name(fileinfo));
+            const gchar *display_name =
+                                g_file_info_get_display_name(fileinfo);
+
+            gchar *path = g_build_filename(
+                                directory,
+                                g_file_info_get_name(fileinfo), NULL);
+
+            VnrFile *vnrfile = vnr_file_new(store, path, display_name);
+            g_free(path);
 
             vnrfile->mtime = g_file_info_get_attribute_uint64(
                                         fileinfo,
                                         G_FILE_ATTRIBUTE_TIME_MODIFIED);
 
-            vnrfile->path = g_strjoin(G_DIR_SEPARATOR_S, directory,
-                                       vnrfile->display_name, NULL);
+            vnrfile->size = g_file_info_get_size(fileinfo);
 
-            list = g_list_prepend(list, vnrfile);
+            g_ptr_array_add(files, vnrfile);
         }
 
         g_object_unref(fileinfo);
@@ -126,155 +552,876 @@ GList* vnr_list_new_for_dir(gchar *directory, gboolean sort,
         fileinfo = g_file_enumerator_next_file(file_enum, NULL, NULL);
     }
 
+    vnr_file_store_unref(store);
+
     g_object_unref(gfile);
     g_file_enumerator_close(file_enum, NULL, NULL);
     g_object_unref(file_enum);
-
-    if (sort)
-        list = vnr_list_sort(list);
-
-    return list;
 }
 
-GList* vnr_list_new_for_list(GSList *uri_list,
-                             gboolean include_hidden,
-                             GError **error)
+VnrFileList* vnr_list_new_for_list(GSList *uri_list,
+                                   gboolean include_hidden,
+                                   GError **error)
 {
     (void) error;
 
-    GList *file_list = NULL;
+    GPtrArray *files = _list_array_new();
+    VnrFileStore *store = vnr_file_store_new();
 
     while (uri_list != NULL)
     {
-        VnrFile *vnrfile = vnr_file_new_for_path(uri_list->data,
+        VnrFile *vnrfile = vnr_file_new_for_path(store, uri_list->data,
                                                  include_hidden);
         if (vnrfile)
-            file_list = g_list_prepend(file_list, vnrfile);
+            g_ptr_array_add(files, vnrfile);
 
         uri_list = g_slist_next(uri_list);
 
     }
 
-    file_list = vnr_list_sort(file_list);
+    vnr_file_store_unref(store);
 
-    return file_list;
+    return _list_new(files);
 }
 
 // delete ---------------------------------------------------------------------
 
-GList* vnr_list_delete_link(GList *list)
+gboolean vnr_list_remove(VnrFileList *list, gint index)
 {
-    if (list == NULL)
-        return NULL;
+    // Removes a file, the current position moves to the next one, or the
+    // first one after the last. Returns FALSE once the list is empty.
+
+    g_return_val_if_fail(list != NULL, FALSE);
+    g_return_val_if_fail(index >= 0 && index < (gint) list->files->len,
+                         FALSE);
 
-    VnrFile *file = VNR_FILE(list->data);
-    if (file)
-        g_object_unref(file);
+    VnrFile *file = g_ptr_array_index(list->files, index);
+
+    // the file may have been renamed without vnr_list_update
+    if (g_hash_table_lookup(list->index, file->path) == file)
+        g_hash_table_remove(list->index, file->path);
+    else
+        g_hash_table_foreach_remove(list->index, _list_index_match, file);
 
-    return g_list_delete_link(list, list);
+    g_ptr_array_remove_index(list->files, index);
+
+    gint length = list->files->len;
+
+    if (length == 0)
+    {
+        list->current = -1;
+        return FALSE;
+    }
+
+    if (index < list->current)
+        --list->current;
+    else if (list->current >= length)
+        list->current = 0;
+
+    return TRUE;
 }
 
-GList* vnr_list_delete_item(GList *list)
+static gboolean _list_index_match(gpointer key, gpointer value,
+                                  gpointer user_data)
 {
-    GList *first = g_list_first(list);
+    (void) key;
 
-    // empty list
-    if (first == NULL)
+    return value == user_data;
+}
+
+VnrFileList* vnr_list_free(VnrFileList *list)
+{
+    if (!list)
         return NULL;
 
-    // only one item in the list
-    if (g_list_length(first) == 1)
-        return vnr_list_free(first);
+    g_hash_table_destroy(list->index);
+    g_ptr_array_unref(list->files);
+    vnr_file_store_unref(list->store);
+    g_free(list->directory);
+    g_slice_free(VnrFileList, list);
 
-    GList *next = g_list_next(list);
-    if (next == NULL)
-        next = first;
+    return NULL;
+}
 
-    g_assert(next != list);
+// access ---------------------------------------------------------------------
 
-    vnr_list_delete_link(list);
+gint vnr_list_length(VnrFileList *list)
+{
+    if (!list)
+        return 0;
 
-    return next;
+    return list->files->len;
 }
 
-GList* vnr_list_free(GList *list)
+VnrFile* vnr_list_get(VnrFileList *list, gint index)
+{
+    if (!list || index < 0 || index >= (gint) list->files->len)
+        return NULL;
+
+    return g_ptr_array_index(list->files, index);
+}
+
+VnrFile* vnr_list_get_current(VnrFileList *list)
 {
     if (!list)
         return NULL;
 
-    GList *first = g_list_first(list);
-    g_list_free_full(first, g_object_unref);
+    return vnr_list_get(list, list->current);
+}
+
+gint vnr_list_get_index(VnrFileList *list)
+{
+    if (!list)
+        return -1;
 
-    return NULL;
+    return list->current;
 }
 
-// ----------------------------------------------------------------------------
+void vnr_list_set_index(VnrFileList *list, gint index)
+{
+    g_return_if_fail(list != NULL);
+    g_return_if_fail(index >= 0 && index < (gint) list->files->len);
+
+    list->current = index;
+}
 
-GList* vnr_list_find(GList *list, const char *filepath)
+gint vnr_list_wrap_index(VnrFileList *list, gint index)
 {
-    return g_list_find_custom(list, filepath,
-                              (GCompareFunc) _file_compare_func);
+    // Index of a neighbour, going around at both ends.
+
+    gint length = vnr_list_length(list);
+
+    if (length == 0)
+        return -1;
+
+    index %= length;
+
+    return (index < 0) ? index + length : index;
 }
 
-static gint _file_compare_func(VnrFile *file, char *uri)
+gint vnr_list_get_position(VnrFileList *list, gint *total)
 {
-    if (g_strcmp0(uri, file->path) == 0)
+    if (total)
+        *total = vnr_list_length(list);
+
+    if (!list)
         return 0;
-    else
-        return 1;
+
+    return list->current + 1;
 }
 
-gint vnr_list_get_position(GList *list, gint *total)
+// ----------------------------------------------------------------------------
+
+gint vnr_list_find(VnrFileList *list, const char *filepath)
 {
-    gint after = 0;
-    gint before = 0;
+    if (!list || !filepath)
+        return -1;
 
-    for (GList *it = list; it != NULL; it = it->next)
-        ++after;
+    VnrFile *file = g_hash_table_lookup(list->index, filepath);
 
-    for (GList *it = list; it != NULL; it = it->prev)
-        ++before;
+    if (!file)
+        return -1;
 
-    if (total)
-        *total = before + after - 1;
+    return _list_lookup(list, file);
+}
+
+gboolean vnr_list_insert(VnrFileList *list, VnrFile *newfile)
+{
+    // Returns FALSE when the path is already in the list, the caller keeps
+    // newfile in that case.
+
+    g_return_val_if_fail(list != NULL, FALSE);
+
+    if (!newfile || g_hash_table_contains(list->index, newfile->path))
+        return FALSE;
+
+    gint pos = _list_bound(list, newfile);
+
+    g_ptr_array_insert(list->files, pos, newfile);
+    g_hash_table_insert(list->index, (gpointer) newfile->path, newfile);
+
+    if (pos <= list->current)
+        ++list->current;
+
+    return TRUE;
+}
+
+gboolean vnr_list_insert_path(VnrFileList *list, const gchar *filepath,
+                              gboolean include_hidden)
+{
+    g_return_val_if_fail(list != NULL, FALSE);
+
+    if (!filepath || g_hash_table_contains(list->index, filepath))
+        return FALSE;
+
+    if (!list->store)
+        list->store = vnr_file_store_new();
+
+    VnrFile *file = vnr_file_new_for_path(list->store, filepath,
+                                          include_hidden);
+
+    if (!file)
+        return FALSE;
+
+    if (!vnr_list_insert(list, file))
+    {
+        vnr_file_free(file);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void vnr_list_update(VnrFileList *list, gint index, const gchar *oldpath)
+{
+    // After a rename, moves the file to its new place in the order.
+
+    g_return_if_fail(list != NULL);
+    g_return_if_fail(index >= 0 && index < (gint) list->files->len);
+
+    VnrFile *file = g_ptr_array_index(list->files, index);
+    VnrFile *current = vnr_list_get_current(list);
+
+    if (oldpath)
+        g_hash_table_remove(list->index, oldpath);
+
+    g_hash_table_insert(list->index, (gpointer) file->path, file);
+
+    _list_steal(list, index);
+    g_ptr_array_insert(list->files, _list_bound(list, file), file);
+
+    list->current = _list_lookup(list, current);
+}
+
+static void _list_steal(VnrFileList *list, gint index)
+{
+    // Removes a file from the array without freeing it.
+
+    g_ptr_array_set_free_func(list->files, NULL);
+    g_ptr_array_remove_index(list->files, index);
+    g_ptr_array_set_free_func(list->files, (GDestroyNotify) vnr_file_free);
+}
 
-    return before;
+void vnr_list_sort(VnrFileList *list)
+{
+    g_return_if_fail(list != NULL);
+
+    VnrFile *current = vnr_list_get_current(list);
+
+    _list_sort((VnrFile**) list->files->pdata, list->files->len,
+               list->order);
+
+    list->current = _list_lookup(list, current);
+}
+
+const gchar* vnr_list_get_directory(VnrFileList *list)
+{
+    if (!list)
+        return NULL;
+
+    return list->directory;
+}
+
+VnrListOrder vnr_list_get_order(VnrFileList *list)
+{
+    if (!list)
+        return VNR_LIST_ORDER_NAME;
+
+    return list->order;
 }
 
-GList* vnr_list_insert(GList *list, VnrFile *newfile)
+void vnr_list_set_order(VnrFileList *list, VnrListOrder order)
 {
-    GList *first = g_list_first(list);
-    GList *l = first;
+    g_return_if_fail(list != NULL);
 
-    while (l)
+    if (list->order == order)
+        return;
+
+    list->order = order;
+    vnr_list_sort(list);
+}
+
+void vnr_list_merge(VnrFileList *list, GPtrArray *batch,
+                    VnrListOrder order)
+{
+    // Merges the batch, sorted in order, into the list and takes it, the
+    // current file stays the same. Files of the batch already in the list
+    // are dropped.
+
+    g_return_if_fail(list != NULL);
+
+    // the order changed while the directory was scanned
+    if (order != list->order)
+        _list_sort((VnrFile**) batch->pdata, batch->len, list->order);
+
+    VnrFile *current = vnr_list_get_current(list);
+    GPtrArray *files = list->files;
+
+    GPtrArray *result = g_ptr_array_sized_new(files->len + batch->len);
+    g_ptr_array_set_free_func(result, (GDestroyNotify) vnr_file_free);
+
+    guint i = 0;
+    guint j = 0;
+
+    while (i < files->len || j < batch->len)
     {
-        VnrFile *file = VNR_FILE(l->data);
+        if (j == batch->len)
+        {
+            g_ptr_array_add(result, g_ptr_array_index(files, i++));
+            continue;
+        }
 
-        if (g_strcmp0(file->path, newfile->path) == 0)
-            return NULL;
+        VnrFile *file = g_ptr_array_index(batch, j);
+
+        if (g_hash_table_contains(list->index, file->path))
+        {
+            vnr_file_free(file);
+            ++j;
+            continue;
+        }
 
-        l = l->next;
+        if (i < files->len
+            && _list_compare_files(g_ptr_array_index(files, i), file,
+                                   list->order) <= 0)
+        {
+            g_ptr_array_add(result, g_ptr_array_index(files, i++));
+            continue;
+        }
+
+        g_hash_table_insert(list->index, (gpointer) file->path, file);
+        g_ptr_array_add(result, file);
+        ++j;
     }
 
-    return g_list_insert_sorted_with_data(
-                                    first,
-                                    newfile,
-                                    _list_compare_func,
-                                    NULL);
+    // the references moved to result
+    g_ptr_array_set_free_func(files, NULL);
+    g_ptr_array_unref(files);
+    g_ptr_array_set_free_func(batch, NULL);
+    g_ptr_array_unref(batch);
+
+    list->files = result;
+    list->current = _list_lookup(list, current);
 }
 
-GList* vnr_list_sort(GList *list)
+gboolean vnr_list_sync_paths(VnrFileList *list, GPtrArray *paths,
+                             gboolean include_hidden, gboolean add_new)
 {
-    return g_list_sort_with_data(list, _list_compare_func, NULL);
+    // Brings the entries of the given paths in line with the disk : files
+    // that are gone are removed, changed ones are updated and, with
+    // add_new, new images are added. The current file stays even if it's
+    // gone since it is still shown. Returns TRUE if the list changed.
+
+    g_return_val_if_fail(list != NULL && paths != NULL, FALSE);
+
+    VnrFile *current = vnr_list_get_current(list);
+    GPtrArray *batch = _list_array_new();
+    VnrFileStore *store = NULL;
+    gboolean changed = FALSE;
+
+    for (guint i = 0; i < paths->len; ++i)
+    {
+        const gchar *path = g_ptr_array_index(paths, i);
+        VnrFile *file = g_hash_table_lookup(list->index, path);
+        gint index = _list_lookup(list, file);
+
+        struct stat st;
+        gboolean exists = (stat(path, &st) == 0 && S_ISREG(st.st_mode));
+
+        if (file && index < 0)
+            continue;
+
+        if (file && !exists)
+        {
+            if (file != current)
+            {
+                vnr_list_remove(list, index);
+                changed = TRUE;
+            }
+
+            continue;
+        }
+
+        if (file)
+        {
+            if (file->mtime == st.st_mtime && file->size == st.st_size)
+                continue;
+
+            file->mtime = st.st_mtime;
+            file->size = st.st_size;
+            file->taken = 0;
+
+            vnr_list_update(list, index, NULL);
+            changed = TRUE;
+
+            continue;
+        }
+
+        if (!exists || !add_new || !file_name_is_supported(path))
+            continue;
+
+        const gchar *name = strrchr(path, G_DIR_SEPARATOR);
+        name = name ? name + 1 : path;
+
+        if (!include_hidden && name[0] == '.')
+            continue;
+
+        if (!store)
+            store = vnr_file_store_new();
+
+        gchar *display_name = g_filename_display_name(name);
+        VnrFile *newfile = vnr_file_new(store, path, display_name);
+        g_free(display_name);
+
+        newfile->mtime = st.st_mtime;
+        newfile->size = st.st_size;
+
+        g_ptr_array_add(batch, newfile);
+    }
+
+    vnr_file_store_unref(store);
+
+    // merging rebuilds the whole array, not worth it for nothing new
+    if (batch->len == 0)
+    {
+        g_ptr_array_unref(batch);
+        return changed;
+    }
+
+    _list_sort((VnrFile**) batch->pdata, batch->len, list->order);
+    vnr_list_merge(list, batch, list->order);
+
+    return TRUE;
 }
 
-static gint _list_compare_func(gconstpointer a, gconstpointer b,
+void vnr_list_read_dates_async(VnrFileList *list,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
                                gpointer user_data)
+{
+    // Reads the capture dates still unknown on a worker thread, the files
+    // themselves are only touched by vnr_list_read_dates_finish. Until
+    // then, they sort by modification time.
+
+    g_return_if_fail(list != NULL);
+
+    guint length = 0;
+
+    for (guint i = 0; i < list->files->len; ++i)
+    {
+        VnrFile *file = g_ptr_array_index(list->files, i);
+
+        if (file->taken == 0)
+            ++length;
+    }
+
+    ListDates *dates = g_slice_new0(ListDates);
+    dates->paths = g_ptr_array_new_full(length, g_free);
+    dates->mtimes = g_new(gint64, length);
+    dates->taken = g_new0(gint64, length);
+
+    for (guint i = 0; i < list->files->len; ++i)
+    {
+        VnrFile *file = g_ptr_array_index(list->files, i);
+
+        if (file->taken != 0)
+            continue;
+
+        dates->mtimes[dates->paths->len] = file->mtime;
+        g_ptr_array_add(dates->paths, g_strdup(file->path));
+    }
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_task_data(task, dates, (GDestroyNotify) _list_dates_free);
+
+    if (length > 0)
+        g_task_run_in_thread(task, _list_dates_thread);
+    else
+        g_task_return_boolean(task, TRUE);
+
+    g_object_unref(task);
+}
+
+gboolean vnr_list_read_dates_finish(VnrFileList *list, GAsyncResult *result,
+                                    GError **error)
+{
+    // Stores the dates read and sorts the list again if it is ordered by
+    // them. Files changed meanwhile keep theirs unknown, to be read by the
+    // next call. Returns TRUE if the order may have changed.
+
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+
+    if (!g_task_propagate_boolean(G_TASK(result), error) || !list)
+        return FALSE;
+
+    ListDates *dates = g_task_get_task_data(G_TASK(result));
+    gboolean changed = FALSE;
+
+    for (guint i = 0; i < dates->paths->len; ++i)
+    {
+        VnrFile *file = g_hash_table_lookup(
+                                    list->index,
+                                    g_ptr_array_index(dates->paths, i));
+
+        if (!file || file->taken != 0 || file->mtime != dates->mtimes[i])
+            continue;
+
+        file->taken = dates->taken[i];
+
+        if (file->taken > 0)
+            changed = TRUE;
+    }
+
+    if (!changed || list->order != VNR_LIST_ORDER_TAKEN)
+        return FALSE;
+
+    vnr_list_sort(list);
+
+    return TRUE;
+}
+
+static void _list_dates_free(ListDates *dates)
+{
+    g_ptr_array_unref(dates->paths);
+    g_free(dates->mtimes);
+    g_free(dates->taken);
+    g_slice_free(ListDates, dates);
+}
+
+static void _list_dates_thread(GTask *task, gpointer source_object,
+                               gpointer task_data,
+                               GCancellable *cancellable)
+{
+    (void) source_object;
+    (void) cancellable;
+
+    ListDates *dates = task_data;
+
+    _list_read_dates((const gchar**) dates->paths->pdata, dates->taken,
+                     dates->paths->len);
+
+    if (!g_task_return_error_if_cancelled(task))
+        g_task_return_boolean(task, TRUE);
+}
+
+static GThreadPool* _list_get_pool()
+{
+    // Workers shared by all sorts and date reads, one less than the number
+    // of processors since the calling thread runs a part too, or NULL on a
+    // single processor. Started once and kept for the life of the process.
+
+    static gsize initialized = 0;
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter(&initialized))
+    {
+        gint n_threads = MIN((gint) g_get_num_processors(),
+                             LIST_SORT_MAX_PARTS) - 1;
+        if (n_threads > 0)
+            pool = g_thread_pool_new((GFunc) _list_work, NULL,
+                                     n_threads, TRUE, NULL);
+        g_once_init_leave(&initialized, 1);
+    }
+
+    return pool;
+}
+
+static void _list_work(ListWork *work, gpointer user_data)
 {
     (void) user_data;
 
-    return g_strcmp0(VNR_FILE((void*) a)->display_name_collate,
-                     VNR_FILE((void*) b)->display_name_collate);
+    ListJob *job = work->job;
+
+    work->func(work->data);
+
+    g_mutex_lock(&job->mutex);
+    if (--job->pending == 0)
+        g_cond_signal(&job->cond);
+    g_mutex_unlock(&job->mutex);
+}
+
+static void _list_run_parts(GThreadFunc func, gpointer parts,
+                            gsize part_size, gint n_parts)
+{
+    // Calls func on each of the n_parts structs of part_size bytes at
+    // parts, the first on this thread and the others on the workers.
+    // Returns once all are done.
+
+    GThreadPool *pool = _list_get_pool();
+
+    if (!pool || n_parts == 1)
+    {
+        for (gint i = 0; i < n_parts; ++i)
+            func((guint8*) parts + i * part_size);
+        return;
+    }
+
+    ListJob job;
+    ListWork works[LIST_SORT_MAX_PARTS];
+
+    g_mutex_init(&job.mutex);
+    g_cond_init(&job.cond);
+    job.pending = n_parts - 1;
+
+    for (gint i = 1; i < n_parts; ++i)
+    {
+        works[i].job = &job;
+        works[i].func = func;
+        works[i].data = (guint8*) parts + i * part_size;
+
+        g_thread_pool_push(pool, &works[i], NULL);
+    }
+
+    func(parts);
+
+    g_mutex_lock(&job.mutex);
+    while (job.pending > 0)
+        g_cond_wait(&job.cond, &job.mutex);
+    g_mutex_unlock(&job.mutex);
+
+    g_mutex_clear(&job.mutex);
+    g_cond_clear(&job.cond);
+}
+
+static void _list_read_dates(const gchar **paths, gint64 *taken,
+                             gint length)
+{
+    // Fills the entries of taken that are 0, opening the files is worth
+    // the workers for any size.
+
+    gint n_parts = MIN(g_get_num_processors(), LIST_SORT_MAX_PARTS);
+    n_parts = CLAMP(n_parts, 1, MAX(length, 1));
+
+    ListDatesPart parts[LIST_SORT_MAX_PARTS];
+
+    for (gint i = 0; i < n_parts; ++i)
+    {
+        parts[i].paths = paths;
+        parts[i].taken = taken;
+        parts[i].start = (gint64) length * i / n_parts;
+        parts[i].end = (gint64) length * (i + 1) / n_parts;
+    }
+
+    _list_run_parts(_list_read_dates_part, parts, sizeof(ListDatesPart),
+                    n_parts);
+}
+
+static gpointer _list_read_dates_part(gpointer data)
+{
+    ListDatesPart *part = (ListDatesPart*) data;
+
+    for (gint i = part->start; i < part->end; ++i)
+    {
+        if (part->taken[i] != 0)
+            continue;
+
+        part->taken[i] = uni_read_exiv2_date_taken(part->paths[i]);
+
+        if (part->taken[i] == 0)
+            part->taken[i] = -1;
+    }
+
+    return NULL;
+}
+
+static gint _list_lookup(VnrFileList *list, VnrFile *file)
+{
+    // Binary search, the order is total so that a file has one place.
+
+    if (!file)
+        return -1;
+
+    gint pos = _list_bound(list, file);
+
+    if (pos < (gint) list->files->len
+        && g_ptr_array_index(list->files, pos) == file)
+        return pos;
+
+    return -1;
+}
+
+static gint _list_bound(VnrFileList *list, VnrFile *file)
+{
+    // First position whose file doesn't sort before the given one.
+
+    gint low = 0;
+    gint high = list->files->len;
+
+    while (low < high)
+    {
+        gint mid = low + (high - low) / 2;
+
+        if (_list_compare_files(g_ptr_array_index(list->files, mid), file,
+                                list->order) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// sort -----------------------------------------------------------------------
+
+static void _list_sort(VnrFile **files, gint length, VnrListOrder order)
+{
+    // Merge sort of an array of keys : the parts are filled and sorted by
+    // the workers, then merged pairwise, in parallel as well.
+
+    if (length < 2)
+        return;
+
+    ListKey *keys = g_new(ListKey, length);
+
+    gint n_parts = 1;
+
+    if (length >= LIST_SORT_PARALLEL)
+    {
+        gint max_parts = MIN(g_get_num_processors(), LIST_SORT_MAX_PARTS);
+
+        while (n_parts * 2 <= max_parts)
+            n_parts *= 2;
+    }
+
+    ListSortPart parts[LIST_SORT_MAX_PARTS];
+
+    for (gint i = 0; i < n_parts; ++i)
+    {
+        parts[i].files = files;
+        parts[i].keys = keys;
+        parts[i].start = (gint64) length * i / n_parts;
+        parts[i].end = (gint64) length * (i + 1) / n_parts;
+        parts[i].order = order;
+    }
+
+    _list_run_parts(_list_sort_part, parts, sizeof(ListSortPart), n_parts);
+
+    ListKey *dest = (n_parts > 1) ? g_new(ListKey, length) : NULL;
+
+    while (n_parts > 1)
+    {
+        gint n_merges = n_parts / 2;
+
+        // the merged runs are the parts of the next round
+        for (gint i = 0; i < n_merges; ++i)
+        {
+            ListSortPart *merge = &parts[i];
+
+            merge->keys = keys;
+            merge->dest = dest;
+            merge->start = parts[2 * i].start;
+            merge->middle = parts[2 * i].end;
+            merge->end = parts[2 * i + 1].end;
+        }
+
+        _list_run_parts(_list_merge_part, parts, sizeof(ListSortPart),
+                        n_merges);
+
+        ListKey *swap = keys;
+        keys = dest;
+        dest = swap;
+
+        n_parts = n_merges;
+    }
+
+    for (gint i = 0; i < length; ++i)
+        files[i] = keys[i].file;
+
+    g_free(keys);
+    g_free(dest);
+}
+
+static gpointer _list_sort_part(gpointer data)
+{
+    ListSortPart *part = (ListSortPart*) data;
+
+    for (gint i = part->start; i < part->end; ++i)
+        _list_key_init(&part->keys[i], part->files[i], part->order);
+
+    qsort(part->keys + part->start, part->end - part->start,
+          sizeof(ListKey), _list_compare_keys);
+
+    return NULL;
+}
+
+static gpointer _list_merge_part(gpointer data)
+{
+    ListSortPart *part = (ListSortPart*) data;
+
+    ListKey *keys = part->keys;
+    gint i = part->start;
+    gint j = part->middle;
+    gint k = part->start;
+
+    while (i < part->middle && j < part->end)
+    {
+        if (_list_compare_keys(&keys[i], &keys[j]) <= 0)
+            part->dest[k++] = keys[i++];
+        else
+            part->dest[k++] = keys[j++];
+    }
+
+    while (i < part->middle)
+        part->dest[k++] = keys[i++];
+
+    while (j < part->end)
+        part->dest[k++] = keys[j++];
+
+    return NULL;
+}
+
+static void _list_key_init(ListKey *key, VnrFile *file, VnrListOrder order)
+{
+    key->collate = file->display_name_collate;
+    key->file = file;
+
+    switch (order)
+    {
+    case VNR_LIST_ORDER_MTIME:
+        key->value = file->mtime;
+        break;
+
+    case VNR_LIST_ORDER_SIZE:
+        key->value = file->size;
+        break;
+
+    case VNR_LIST_ORDER_TAKEN:
+        // no file I/O here, the dates are read on workers, see
+        // vnr_list_read_dates_async ; files without one sort by
+        // modification time
+        key->value = (file->taken > 0) ? file->taken : file->mtime;
+        break;
+
+    default:
+        key->value = 0;
+        break;
+    }
+}
+
+static gint _list_compare_keys(const void *a, const void *b)
+{
+    const ListKey *key_a = (const ListKey*) a;
+    const ListKey *key_b = (const ListKey*) b;
+
+    if (key_a->value != key_b->value)
+        return (key_a->value < key_b->value) ? -1 : 1;
+
+    gint result = g_strcmp0(key_a->collate, key_b->collate);
+
+    if (result != 0)
+        return result;
+
+    return g_strcmp0(key_a->file->path, key_b->file->path);
+}
+
+static gint _list_compare_files(VnrFile *a, VnrFile *b, VnrListOrder order)
+{
+    ListKey key_a;
+    ListKey key_b;
+
+    _list_key_init(&key_a, a, order);
+    _list_key_init(&key_b, b, order);
+
+    return _list_compare_keys(&key_a, &key_b);
 }
 
 
@@ -2,33 +2,82 @@
 #define LIST_H
 
 #include "file.h"
-#include <glib.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
+// Sorted array of files with a path index and a current position.
+typedef struct _VnrFileList VnrFileList;
+
+// Stored in the preferences, keep the values.
+typedef enum
+{
+    VNR_LIST_ORDER_NAME,
+    VNR_LIST_ORDER_MTIME,
+    VNR_LIST_ORDER_SIZE,
+    VNR_LIST_ORDER_TAKEN,
+
+} VnrListOrder;
+
 // create ---------------------------------------------------------------------
 
-GList* vnr_list_new_for_path(gchar *filepath,
-                             gboolean include_hidden, GError **error);
-GList* vnr_list_new_for_file(gchar *filepath,
-                             gboolean include_hidden, gboolean try_first);
-GList* vnr_list_new_for_dir(gchar *directory, gboolean sort,
-                            gboolean include_hidden);
-GList* vnr_list_new_for_list(GSList *uri_list,
-                             gboolean include_hidden, GError **error);
+VnrFileList* vnr_list_new_for_path(gchar *filepath,
+                                   gboolean include_hidden, GError **error);
+VnrFileList* vnr_list_new_for_list(GSList *uri_list,
+                                   gboolean include_hidden, GError **error);
+
+// The batch is sorted in the given order.
+typedef void (*VnrListBatchFunc)(GPtrArray *batch, VnrListOrder order,
+                                 gpointer user_data);
+
+VnrFileList* vnr_list_new_for_batch(GPtrArray *batch, VnrListOrder order,
+                                    const gchar *directory);
+
+void vnr_list_scan_dir_async(const gchar *directory,
+                             gboolean include_hidden,
+                             VnrListOrder order,
+                             GCancellable *cancellable,
+                             VnrListBatchFunc batch_func,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data);
+gboolean vnr_list_scan_dir_finish(GAsyncResult *result, GError **error);
 
 // delete ---------------------------------------------------------------------
 
-GList* vnr_list_delete_link(GList *list);
-GList* vnr_list_delete_item(GList *list);
-GList* vnr_list_free(GList *list);
+gboolean vnr_list_remove(VnrFileList *list, gint index);
+VnrFileList* vnr_list_free(VnrFileList *list);
+
+// access ---------------------------------------------------------------------
+
+gint vnr_list_length(VnrFileList *list);
+VnrFile* vnr_list_get(VnrFileList *list, gint index);
+VnrFile* vnr_list_get_current(VnrFileList *list);
+gint vnr_list_get_index(VnrFileList *list);
+void vnr_list_set_index(VnrFileList *list, gint index);
+gint vnr_list_wrap_index(VnrFileList *list, gint index);
+gint vnr_list_get_position(VnrFileList *list, gint *total);
 
 // ----------------------------------------------------------------------------
 
-GList* vnr_list_find(GList *list, const char *filepath);
-gint vnr_list_get_position(GList *list, gint *total);
-GList* vnr_list_insert(GList *list, VnrFile *newfile);
-GList* vnr_list_sort(GList *list);
+gint vnr_list_find(VnrFileList *list, const char *filepath);
+gboolean vnr_list_insert(VnrFileList *list, VnrFile *newfile);
+gboolean vnr_list_insert_path(VnrFileList *list, const gchar *filepath,
+                              gboolean include_hidden);
+void vnr_list_update(VnrFileList *list, gint index, const gchar *oldpath);
+void vnr_list_sort(VnrFileList *list);
+const gchar* vnr_list_get_directory(VnrFileList *list);
+VnrListOrder vnr_list_get_order(VnrFileList *list);
+void vnr_list_set_order(VnrFileList *list, VnrListOrder order);
+void vnr_list_merge(VnrFileList *list, GPtrArray *batch,
+                    VnrListOrder order);
+gboolean vnr_list_sync_paths(VnrFileList *list, GPtrArray *paths,
+                             gboolean include_hidden, gboolean add_new);
+void vnr_list_read_dates_async(VnrFileList *list,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data);
+gboolean vnr_list_read_dates_finish(VnrFileList *list, GAsyncResult *result,
+                                    GError **error);
 
 G_END_DECLS
 
@@ -0,0 +1,471 @@
+#include "listcache.h"
+#include "config.h"
+
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// A cache file is a header, the entries, then the strings. The directory
+// path comes first in the strings, entries refer to the others by offset.
+// Every string ends with a NUL so that the files loaded point into the
+// mapped file as is.
+
+#define CACHE_MAGIC "VNRLIST"
+#define CACHE_VERSION 2
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_LOCALE_SIZE 64
+
+// Smaller directories are scanned faster than their cache is written.
+#define CACHE_MIN_FILES 1024
+
+// Cache files not used for this long are deleted, and the least recently
+// used ones beyond this count.
+#define CACHE_MAX_AGE (30 * 24 * 60 * 60)
+#define CACHE_MAX_FILES 64
+
+typedef struct _CacheHeader CacheHeader;
+
+struct _CacheHeader
+{
+    gchar magic[8];
+    guint32 byte_order;
+    guint32 version;
+    guint32 include_hidden;
+    guint32 count;
+    gint64 dir_mtime;
+    gint64 dir_mtime_nsec;
+    guint64 strings_size;
+
+    // the collation keys depend on it
+    gchar collate_locale[CACHE_LOCALE_SIZE];
+};
+
+typedef struct _CacheEntry CacheEntry;
+
+struct _CacheEntry
+{
+    guint32 path;
+    guint32 display_name;
+    guint32 display_name_collate;
+    guint32 reserved;
+    gint64 mtime;
+    gint64 size;
+    gint64 taken;
+};
+
+typedef struct _CacheFile CacheFile;
+
+struct _CacheFile
+{
+    gint64 mtime;
+    gchar *path;
+};
+
+struct _VnrListCache
+{
+    gchar *directory;
+    gboolean include_hidden;
+    gint64 dir_mtime;
+    gint64 dir_mtime_nsec;
+
+    GArray *entries;
+    GString *strings;
+};
+
+static gchar* _cache_get_path(const gchar *directory,
+                              gboolean include_hidden);
+static gboolean _cache_is_valid(const gchar *data, gsize size,
+                                const gchar *directory,
+                                gboolean include_hidden,
+                                const struct stat *st);
+static guint32 _cache_add_string(VnrListCache *cache, const gchar *str);
+static void _cache_get_locale(gchar *locale);
+static void _cache_prune(const gchar *dir);
+static gint _cache_compare_files(gconstpointer a, gconstpointer b);
+
+
+// load -----------------------------------------------------------------------
+
+gboolean vnr_list_cache_load(const gchar *directory, gboolean include_hidden,
+                             GPtrArray *files)
+{
+    // Adds the cached files of the directory, FALSE when there's no valid
+    // cache. The files share one store which keeps the file mapped.
+    //
+    // The directory's mtime doesn't change when a file is rewritten in
+    // place, each file is checked again : those gone are left out, and
+    // changed ones get their new mtime and size and an unknown capture
+    // date.
+
+    struct stat st;
+    if (!directory || stat(directory, &st) != 0)
+        return FALSE;
+
+    gchar *path = _cache_get_path(directory, include_hidden);
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+
+    // used now, see _cache_prune
+    if (mapped)
+        g_utime(path, NULL);
+
+    g_free(path);
+
+    if (!mapped)
+        return FALSE;
+
+    GBytes *data = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    gsize size = 0;
+    const gchar *base = g_bytes_get_data(data, &size);
+
+    if (!_cache_is_valid(base, size, directory, include_hidden, &st))
+    {
+        g_bytes_unref(data);
+        return FALSE;
+    }
+
+    const CacheHeader *header = (const CacheHeader*) base;
+    const CacheEntry *entries = (const CacheEntry*) (header + 1);
+    const gchar *strings = (const gchar*) (entries + header->count);
+
+    int dfd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0)
+    {
+        g_bytes_unref(data);
+        return FALSE;
+    }
+
+    VnrFileStore *store = vnr_file_store_new_for_data(data);
+    g_bytes_unref(data);
+
+    for (guint32 i = 0; i < header->count; ++i)
+    {
+        const CacheEntry *entry = entries + i;
+        const gchar *name = strrchr(strings + entry->path, G_DIR_SEPARATOR);
+
+        struct stat fst;
+        if (!name || fstatat(dfd, name + 1, &fst, 0) != 0
+            || !S_ISREG(fst.st_mode))
+            continue;
+
+        VnrFile *file = vnr_file_new_static(
+                                store,
+                                strings + entry->path,
+                                strings + entry->display_name,
+                                strings + entry->display_name_collate);
+
+        file->mtime = entry->mtime;
+        file->size = entry->size;
+        file->taken = entry->taken;
+
+        if (file->mtime != fst.st_mtime || file->size != fst.st_size)
+        {
+            file->mtime = fst.st_mtime;
+            file->size = fst.st_size;
+            file->taken = 0;
+        }
+
+        g_ptr_array_add(files, file);
+    }
+
+    close(dfd);
+    vnr_file_store_unref(store);
+
+    return TRUE;
+}
+
+static gchar* _cache_get_path(const gchar *directory,
+                              gboolean include_hidden)
+{
+    gchar *key = g_strdup_printf("%s\n%d", directory, include_hidden ? 1 : 0);
+    gchar *name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+
+    gchar *path = g_build_filename(g_get_user_cache_dir(), PACKAGE, "lists",
+                                   name, NULL);
+    g_free(name);
+    g_free(key);
+
+    return path;
+}
+
+static gboolean _cache_is_valid(const gchar *data, gsize size,
+                                const gchar *directory,
+                                gboolean include_hidden,
+                                const struct stat *st)
+{
+    // The directory's mtime changes when a file is added, removed or
+    // renamed, files rewritten are caught by vnr_list_cache_load.
+
+    if (!data || size < sizeof(CacheHeader))
+        return FALSE;
+
+    const CacheHeader *header = (const CacheHeader*) data;
+
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->byte_order != CACHE_BYTE_ORDER
+        || header->version != CACHE_VERSION
+        || header->include_hidden != (include_hidden ? 1 : 0)
+        || header->dir_mtime != (gint64) st->st_mtim.tv_sec
+        || header->dir_mtime_nsec != (gint64) st->st_mtim.tv_nsec)
+        return FALSE;
+
+    gchar locale[CACHE_LOCALE_SIZE];
+    _cache_get_locale(locale);
+
+    if (memcmp(header->collate_locale, locale, CACHE_LOCALE_SIZE) != 0)
+        return FALSE;
+
+    gsize available = size - sizeof(CacheHeader);
+
+    if (header->count > available / sizeof(CacheEntry))
+        return FALSE;
+
+    available -= header->count * sizeof(CacheEntry);
+
+    if (header->strings_size != available || available == 0)
+        return FALSE;
+
+    const CacheEntry *entries = (const CacheEntry*) (header + 1);
+    const gchar *strings = (const gchar*) (entries + header->count);
+
+    if (strings[available - 1] != '\0' || strcmp(strings, directory) != 0)
+        return FALSE;
+
+    for (guint32 i = 0; i < header->count; ++i)
+    {
+        if (entries[i].path >= available
+            || entries[i].display_name >= available
+            || entries[i].display_name_collate >= available)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+// save -----------------------------------------------------------------------
+
+VnrListCache* vnr_list_cache_new(const gchar *directory,
+                                 gboolean include_hidden)
+{
+    // To be created before the directory is read. Returns NULL when the
+    // directory was modified within the last seconds, its mtime may not
+    // change again for further changes then.
+
+    struct stat st;
+    if (!directory || stat(directory, &st) != 0)
+        return NULL;
+
+    if (st.st_mtim.tv_sec >= time(NULL) - 1)
+        return NULL;
+
+    VnrListCache *cache = g_slice_new0(VnrListCache);
+
+    cache->directory = g_strdup(directory);
+    cache->include_hidden = include_hidden;
+    cache->dir_mtime = st.st_mtim.tv_sec;
+    cache->dir_mtime_nsec = st.st_mtim.tv_nsec;
+
+    cache->entries = g_array_new(FALSE, FALSE, sizeof(CacheEntry));
+    cache->strings = g_string_sized_new(64 * 1024);
+
+    _cache_add_string(cache, directory);
+
+    return cache;
+}
+
+VnrListCache* vnr_list_cache_free(VnrListCache *cache)
+{
+    if (!cache)
+        return NULL;
+
+    g_free(cache->directory);
+    g_array_unref(cache->entries);
+    g_string_free(cache->strings, TRUE);
+    g_slice_free(VnrListCache, cache);
+
+    return NULL;
+}
+
+void vnr_list_cache_add(VnrListCache *cache, GPtrArray *files)
+{
+    if (!cache)
+        return;
+
+    for (guint i = 0; i < files->len; ++i)
+    {
+        VnrFile *file = g_ptr_array_index(files, i);
+        CacheEntry entry = {0};
+
+        entry.path = _cache_add_string(cache, file->path);
+
+        // the display name often is the end of the path
+        gsize length = strlen(file->path);
+
+        if (file->display_name >= file->path
+            && file->display_name < file->path + length)
+        {
+            entry.display_name = entry.path
+                                 + (file->display_name - file->path);
+        }
+        else
+        {
+            entry.display_name = _cache_add_string(cache,
+                                                   file->display_name);
+        }
+
+        entry.display_name_collate = _cache_add_string(
+                                            cache,
+                                            file->display_name_collate);
+        entry.mtime = file->mtime;
+        entry.size = file->size;
+        entry.taken = file->taken;
+
+        g_array_append_val(cache->entries, entry);
+    }
+}
+
+gboolean vnr_list_cache_save(VnrListCache *cache)
+{
+    // Not saved if the directory changed while it was read.
+
+    if (!cache || cache->entries->len < CACHE_MIN_FILES
+        || cache->strings->len > G_MAXUINT32)
+        return FALSE;
+
+    struct stat st;
+    if (stat(cache->directory, &st) != 0
+        || (gint64) st.st_mtim.tv_sec != cache->dir_mtime
+        || (gint64) st.st_mtim.tv_nsec != cache->dir_mtime_nsec)
+        return FALSE;
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.version = CACHE_VERSION;
+    header.include_hidden = cache->include_hidden ? 1 : 0;
+    header.count = cache->entries->len;
+    header.dir_mtime = cache->dir_mtime;
+    header.dir_mtime_nsec = cache->dir_mtime_nsec;
+    header.strings_size = cache->strings->len;
+    _cache_get_locale(header.collate_locale);
+
+    gsize entries_size = cache->entries->len * sizeof(CacheEntry);
+    gsize size = sizeof(header) + entries_size + cache->strings->len;
+
+    gchar *buffer = g_malloc(size);
+    gchar *pos = buffer;
+
+    memcpy(pos, &header, sizeof(header));
+    pos += sizeof(header);
+    memcpy(pos, cache->entries->data, entries_size);
+    pos += entries_size;
+    memcpy(pos, cache->strings->str, cache->strings->len);
+
+    gchar *path = _cache_get_path(cache->directory, cache->include_hidden);
+    gchar *dir = g_path_get_dirname(path);
+
+    // written to a temporary file and renamed, files already mapped stay
+    // as they are
+    gboolean ret = g_mkdir_with_parents(dir, 0700) == 0
+                   && g_file_set_contents(path, buffer, size, NULL);
+
+    if (ret)
+        _cache_prune(dir);
+
+    g_free(dir);
+    g_free(path);
+    g_free(buffer);
+
+    return ret;
+}
+
+static guint32 _cache_add_string(VnrListCache *cache, const gchar *str)
+{
+    guint32 offset = cache->strings->len;
+
+    g_string_append_len(cache->strings, str, strlen(str) + 1);
+
+    return offset;
+}
+
+static void _cache_get_locale(gchar *locale)
+{
+    // Name of the collation locale, zero padded to CACHE_LOCALE_SIZE.
+    // Longer names are cut, both sides of a comparison are.
+
+    const gchar *name = setlocale(LC_COLLATE, NULL);
+
+    memset(locale, 0, CACHE_LOCALE_SIZE);
+    g_strlcpy(locale, name ? name : "", CACHE_LOCALE_SIZE);
+}
+
+static void _cache_prune(const gchar *dir)
+{
+    // Deletes the cache files not used for CACHE_MAX_AGE, then the least
+    // recently used ones beyond CACHE_MAX_FILES. A file's mtime is the
+    // last time it was written or loaded.
+
+    GDir *gdir = g_dir_open(dir, 0, NULL);
+    if (!gdir)
+        return;
+
+    GArray *kept = g_array_new(FALSE, FALSE, sizeof(CacheFile));
+    gint64 now = time(NULL);
+    const gchar *name;
+
+    while ((name = g_dir_read_name(gdir)) != NULL)
+    {
+        gchar *path = g_build_filename(dir, name, NULL);
+
+        GStatBuf st;
+        if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            g_free(path);
+            continue;
+        }
+
+        if (now - st.st_mtime > CACHE_MAX_AGE)
+        {
+            g_unlink(path);
+            g_free(path);
+            continue;
+        }
+
+        CacheFile item = {st.st_mtime, path};
+        g_array_append_val(kept, item);
+    }
+
+    g_dir_close(gdir);
+
+    if (kept->len > CACHE_MAX_FILES)
+    {
+        g_array_sort(kept, _cache_compare_files);
+
+        for (guint i = 0; i < kept->len - CACHE_MAX_FILES; ++i)
+            g_unlink(g_array_index(kept, CacheFile, i).path);
+    }
+
+    for (guint i = 0; i < kept->len; ++i)
+        g_free(g_array_index(kept, CacheFile, i).path);
+
+    g_array_unref(kept);
+}
+
+static gint _cache_compare_files(gconstpointer a, gconstpointer b)
+{
+    // oldest first
+    gint64 mtime_a = ((const CacheFile*) a)->mtime;
+    gint64 mtime_b = ((const CacheFile*) b)->mtime;
+
+    return (mtime_a > mtime_b) - (mtime_a < mtime_b);
+}
+
+
@@ -0,0 +1,27 @@
+#ifndef LISTCACHE_H
+#define LISTCACHE_H
+
+#include "file.h"
+
+G_BEGIN_DECLS
+
+// Directory listing saved under the user cache dir, valid as long as the
+// directory's mtime is unchanged. The files are checked again on load, and
+// old cache files deleted on save.
+typedef struct _VnrListCache VnrListCache;
+
+gboolean vnr_list_cache_load(const gchar *directory, gboolean include_hidden,
+                             GPtrArray *files);
+
+VnrListCache* vnr_list_cache_new(const gchar *directory,
+                                 gboolean include_hidden);
+VnrListCache* vnr_list_cache_free(VnrListCache *cache);
+
+void vnr_list_cache_add(VnrListCache *cache, GPtrArray *files);
+gboolean vnr_list_cache_save(VnrListCache *cache);
+
+G_END_DECLS
+
+#endif // LISTCACHE_H
+
+
@@ -0,0 +1,354 @@
+
+#include "loader.h"
+#include "config.h"
+
+// The file is mapped when it's on a local disk, read otherwise, and decoded
+// on a GTask worker and the result is delivered to the main thread. Images
+// still in the cache are returned right away, a decode already started by
+// the prefetcher is waited for instead of being duplicated.
+//
+// Files larger than LOADER_PROGRESSIVE_SIZE are shown while decoding: the
+// rows reported by the worker are merged into a single damaged rectangle
+// which an idle handler hands to the main thread, so a burst of updates
+// costs one redraw.
+
+#define LOADER_PROGRESSIVE_SIZE (2 * 1024 * 1024)
+
+typedef struct _LoadProgress LoadProgress;
+
+struct _LoadProgress
+{
+    gint ref_count;
+    GMutex mutex;
+
+    GdkPixbuf *pixbuf;
+    GdkRectangle area;
+    gboolean scheduled;
+    gboolean done;
+
+    GCancellable *cancellable;
+    VnrLoaderProgressFunc func;
+    gpointer user_data;
+};
+
+typedef struct _LoadData LoadData;
+
+struct _LoadData
+{
+    VnrPrefetch *prefetch;
+    gchar *path;
+    time_t mtime;
+    gint max_size;
+    LoadProgress *progress;
+};
+
+static void _load_data_free(LoadData *data);
+
+static LoadProgress* _load_progress_new(GCancellable *cancellable,
+                                        VnrLoaderProgressFunc func,
+                                        gpointer user_data);
+static LoadProgress* _load_progress_ref(LoadProgress *progress);
+static void _load_progress_unref(LoadProgress *progress);
+static void _load_progress_update(GdkPixbuf *pixbuf,
+                                  const GdkRectangle *area,
+                                  gpointer user_data);
+static gboolean _load_progress_flush(gpointer user_data);
+
+static void _loader_read_thread(GTask *task, gpointer source_object,
+                                gpointer task_data,
+                                GCancellable *cancellable);
+static void _loader_wait_thread(GTask *task, gpointer source_object,
+                                gpointer task_data,
+                                GCancellable *cancellable);
+
+
+static void _load_data_free(LoadData *data)
+{
+    if (data->progress)
+        _load_progress_unref(data->progress);
+
+    g_free(data->path);
+    g_slice_free(LoadData, data);
+}
+
+void vnr_loader_load_async(VnrImageCache *cache, VnrPrefetch *prefetch,
+                           VnrFile *file, gint max_size,
+                           GCancellable *cancellable,
+                           VnrLoaderProgressFunc progress,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+    g_return_if_fail(cache != NULL && prefetch != NULL && file != NULL);
+
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+    gboolean pending = FALSE;
+    VnrImage *image = vnr_image_cache_lookup(cache, file->path, file->mtime);
+
+    if (image && !vnr_image_covers(image, max_size))
+        g_clear_object(&image);
+
+    if (!image)
+        image = vnr_prefetch_lookup(prefetch, file, max_size, &pending);
+
+    if (image)
+    {
+        g_task_return_pointer(task, image, g_object_unref);
+        g_object_unref(task);
+
+        return;
+    }
+
+    LoadData *data = g_slice_new0(LoadData);
+    data->prefetch = prefetch;
+    data->path = g_strdup(file->path);
+    data->mtime = file->mtime;
+    data->max_size = max_size;
+
+    if (progress)
+        data->progress = _load_progress_new(cancellable, progress, user_data);
+
+    g_task_set_task_data(task, data, (GDestroyNotify) _load_data_free);
+
+    if (pending)
+        g_task_run_in_thread(task, _loader_wait_thread);
+    else
+        g_task_run_in_thread(task, _loader_read_thread);
+
+    g_object_unref(task);
+}
+
+VnrImage* vnr_loader_load_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+
+    LoadData *data = g_task_get_task_data(G_TASK(result));
+
+    // updates still queued are superseded by the result
+    if (data && data->progress)
+    {
+        g_mutex_lock(&data->progress->mutex);
+        data->progress->done = TRUE;
+        g_mutex_unlock(&data->progress->mutex);
+    }
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void _loader_read_thread(GTask *task, gpointer source_object,
+                                gpointer task_data,
+                                GCancellable *cancellable)
+{
+    (void) source_object;
+
+    LoadData *data = task_data;
+    GError *error = NULL;
+
+    // files that can't be mapped safely are read through a stream
+    GBytes *bytes = vnr_image_map_file(data->path);
+    GInputStream *stream = NULL;
+    goffset size;
+
+    if (bytes)
+    {
+        size = g_bytes_get_size(bytes);
+    }
+    else
+    {
+        GFile *file = g_file_new_for_path(data->path);
+        stream = G_INPUT_STREAM(g_file_read(file, cancellable, &error));
+        g_object_unref(file);
+
+        if (!stream)
+        {
+            g_task_return_error(task, error);
+            return;
+        }
+
+        GFileInfo *info = g_file_input_stream_query_info(
+                                        G_FILE_INPUT_STREAM(stream),
+                                        G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                        cancellable, NULL);
+        size = info ? g_file_info_get_size(info) : 0;
+        if (info)
+            g_object_unref(info);
+    }
+
+    LoadProgress *progress = data->progress;
+
+    // small files decode faster than a partial image can be drawn
+    if (progress && size < LOADER_PROGRESSIVE_SIZE)
+        progress = NULL;
+
+    VnrImage *image;
+
+    if (bytes)
+    {
+        image = vnr_image_new_from_data(data->path, data->mtime,
+                                        bytes, data->max_size,
+                                        progress ? _load_progress_update : NULL,
+                                        progress,
+                                        cancellable, &error);
+        g_bytes_unref(bytes);
+    }
+    else
+    {
+        image = vnr_image_new_from_stream(data->path, data->mtime,
+                                          stream, data->max_size,
+                                          progress ? _load_progress_update : NULL,
+                                          progress,
+                                          cancellable, &error);
+        g_object_unref(stream);
+    }
+
+    if (!image)
+    {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_pointer(task, image, g_object_unref);
+}
+
+static void _loader_wait_thread(GTask *task, gpointer source_object,
+                                gpointer task_data,
+                                GCancellable *cancellable)
+{
+    (void) source_object;
+
+    LoadData *data = task_data;
+    GError *error = NULL;
+
+    VnrImage *image = vnr_prefetch_wait(data->prefetch,
+                                        data->path, data->mtime,
+                                        cancellable);
+
+    if (image && !vnr_image_covers(image, data->max_size))
+        g_clear_object(&image);
+
+    // the prefetcher failed or gave up, decode here
+    if (!image && !g_cancellable_is_cancelled(cancellable))
+    {
+        image = vnr_image_new_for_path(data->path, data->mtime,
+                                       data->max_size,
+                                       cancellable, &error);
+    }
+
+    if (!image)
+    {
+        if (!error)
+            g_cancellable_set_error_if_cancelled(cancellable, &error);
+
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_pointer(task, image, g_object_unref);
+}
+
+
+// Progress -------------------------------------------------------------------
+
+static LoadProgress* _load_progress_new(GCancellable *cancellable,
+                                        VnrLoaderProgressFunc func,
+                                        gpointer user_data)
+{
+    LoadProgress *progress = g_slice_new0(LoadProgress);
+
+    progress->ref_count = 1;
+    g_mutex_init(&progress->mutex);
+
+    if (cancellable)
+        progress->cancellable = g_object_ref(cancellable);
+
+    progress->func = func;
+    progress->user_data = user_data;
+
+    return progress;
+}
+
+static LoadProgress* _load_progress_ref(LoadProgress *progress)
+{
+    g_atomic_int_inc(&progress->ref_count);
+
+    return progress;
+}
+
+static void _load_progress_unref(LoadProgress *progress)
+{
+    if (!g_atomic_int_dec_and_test(&progress->ref_count))
+        return;
+
+    if (progress->pixbuf)
+        g_object_unref(progress->pixbuf);
+
+    if (progress->cancellable)
+        g_object_unref(progress->cancellable);
+
+    g_mutex_clear(&progress->mutex);
+    g_slice_free(LoadProgress, progress);
+}
+
+static void _load_progress_update(GdkPixbuf *pixbuf,
+                                  const GdkRectangle *area,
+                                  gpointer user_data)
+{
+    LoadProgress *progress = user_data;
+
+    g_mutex_lock(&progress->mutex);
+
+    if (progress->pixbuf != pixbuf || progress->area.width == 0)
+    {
+        // a new frame replaces whatever was pending
+        g_set_object(&progress->pixbuf, pixbuf);
+        progress->area = *area;
+    }
+    else
+    {
+        gdk_rectangle_union(&progress->area, area, &progress->area);
+    }
+
+    if (!progress->scheduled && !progress->done)
+    {
+        progress->scheduled = TRUE;
+
+        g_idle_add(_load_progress_flush, _load_progress_ref(progress));
+    }
+
+    g_mutex_unlock(&progress->mutex);
+}
+
+static gboolean _load_progress_flush(gpointer user_data)
+{
+    LoadProgress *progress = user_data;
+
+    g_mutex_lock(&progress->mutex);
+
+    GdkPixbuf *pixbuf = progress->pixbuf;
+    GdkRectangle area = progress->area;
+    gboolean done = progress->done;
+
+    if (pixbuf)
+        g_object_ref(pixbuf);
+
+    progress->area.width = 0;
+    progress->area.height = 0;
+    progress->scheduled = FALSE;
+
+    g_mutex_unlock(&progress->mutex);
+
+    if (pixbuf && !done && area.width > 0
+        && !g_cancellable_is_cancelled(progress->cancellable))
+    {
+        progress->func(pixbuf, &area, progress->user_data);
+    }
+
+    if (pixbuf)
+        g_object_unref(pixbuf);
+
+    _load_progress_unref(progress);
+
+    return G_SOURCE_REMOVE;
+}
+
+
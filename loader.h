@@ -0,0 +1,29 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "file.h"
+#include "image.h"
+#include "imagecache.h"
+#include "prefetch.h"
+
+G_BEGIN_DECLS
+
+// Called on the main thread with the partially decoded image and the
+// smallest rectangle covering the rows decoded since the last call.
+typedef void (*VnrLoaderProgressFunc)(GdkPixbuf *pixbuf,
+                                      const GdkRectangle *area,
+                                      gpointer user_data);
+
+void vnr_loader_load_async(VnrImageCache *cache, VnrPrefetch *prefetch,
+                           VnrFile *file, gint max_size,
+                           GCancellable *cancellable,
+                           VnrLoaderProgressFunc progress,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data);
+VnrImage* vnr_loader_load_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
+
+#endif // LOADER_H
+
+
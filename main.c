@@ -79,11 +79,17 @@ int main(int argc, char **argv)
 
     GSList *uri_list = vnr_tools_get_list_from_array(files);
 
-    GList *file_list = NULL;
+    VnrFileList *file_list = NULL;
 
     if (uri_list)
     {
-        if (g_slist_length(uri_list) == 1)
+        // listed in the background, see window_open_dir
+        if (g_slist_length(uri_list) == 1
+            && g_file_test(uri_list->data, G_FILE_TEST_IS_DIR))
+        {
+            window_open_dir(window, uri_list->data);
+        }
+        else if (g_slist_length(uri_list) == 1)
         {
             file_list = vnr_list_new_for_path(uri_list->data,
                                               window->prefs->show_hidden,
@@ -119,6 +125,7 @@ int main(int argc, char **argv)
     }
 
     window_list_set(window, file_list);
+    window_list_scan(window);
 
     window->prefs->start_slideshow = slideshow;
     window->prefs->start_fullscreen = fullscreen;
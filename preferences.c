@@ -40,6 +40,12 @@ G_DEFINE_TYPE(VnrPrefs, vnr_prefs, G_TYPE_OBJECT)
         g_clear_error(&read_error);                                  \
     }
 
+// Bounds of the hand edited cache and prefetch keys, the image cache budget
+// is allocated from cache-size, in MiB.
+#define VNR_PREFS_CACHE_SIZE_MIN 16
+#define VNR_PREFS_CACHE_SIZE_MAX 4096
+#define VNR_PREFS_PREFETCH_MAX 8
+
 
 static void vnr_prefs_set_default(VnrPrefs *prefs);
 static GtkWidget* _prefs_build(VnrPrefs *prefs);
@@ -122,6 +128,10 @@ static void vnr_prefs_set_default(VnrPrefs *prefs)
     prefs->start_fullscreen = FALSE;
     prefs->auto_resize = FALSE;
     prefs->desktop = VNR_PREFS_DESKTOP_AUTO;
+    prefs->prefetch_next = 2;
+    prefs->prefetch_prev = 1;
+    prefs->cache_size = 256;
+    prefs->sort_order = 0;
 }
 
 static GtkWidget* _prefs_build(VnrPrefs *prefs)
@@ -351,6 +361,18 @@ static gboolean vnr_prefs_load(VnrPrefs *prefs, GError **error)
     VNR_PREF_LOAD_KEY(jpeg_quality, integer, "jpeg-quality", 90);
     VNR_PREF_LOAD_KEY(png_compression, integer, "png-compression", 9);
     VNR_PREF_LOAD_KEY(desktop, integer, "desktop", VNR_PREFS_DESKTOP_AUTO);
+    VNR_PREF_LOAD_KEY(prefetch_next, integer, "prefetch-next", 2);
+    VNR_PREF_LOAD_KEY(prefetch_prev, integer, "prefetch-prev", 1);
+    VNR_PREF_LOAD_KEY(cache_size, integer, "cache-size", 256);
+    VNR_PREF_LOAD_KEY(sort_order, integer, "sort-order", 0);
+
+    prefs->prefetch_next = CLAMP(prefs->prefetch_next,
+                                 0, VNR_PREFS_PREFETCH_MAX);
+    prefs->prefetch_prev = CLAMP(prefs->prefetch_prev,
+                                 0, VNR_PREFS_PREFETCH_MAX);
+    prefs->cache_size = CLAMP(prefs->cache_size,
+                              VNR_PREFS_CACHE_SIZE_MIN,
+                              VNR_PREFS_CACHE_SIZE_MAX);
 
     g_key_file_free(conf);
 
@@ -401,6 +423,14 @@ gboolean vnr_prefs_save(VnrPrefs *prefs)
                            prefs->png_compression);
     g_key_file_set_integer(conf, "prefs", "desktop",
                            prefs->desktop);
+    g_key_file_set_integer(conf, "prefs", "prefetch-next",
+                           prefs->prefetch_next);
+    g_key_file_set_integer(conf, "prefs", "prefetch-prev",
+                           prefs->prefetch_prev);
+    g_key_file_set_integer(conf, "prefs", "cache-size",
+                           prefs->cache_size);
+    g_key_file_set_integer(conf, "prefs", "sort-order",
+                           prefs->sort_order);
 
     if (g_mkdir_with_parents(dir, 0700) != 0)
         g_warning("Error creating config file's parent directory (%s)\n", dir);
@@ -110,6 +110,10 @@ struct _VnrPrefs
     gint slideshow_timeout;
     gint jpeg_quality;
     gint png_compression;
+    gint prefetch_next;
+    gint prefetch_prev;
+    gint cache_size;
+    gint sort_order; // VnrListOrder
 
     GtkSpinButton *slideshow_timeout_widget;
 };
@@ -0,0 +1,505 @@
+#include "prefetch.h"
+#include "config.h"
+
+// Decoding huge images in parallel quickly exhausts memory, two workers
+// are enough to stay ahead of the user.
+#define PREFETCH_THREADS 2
+
+// Prefetched images are inserted in the cache and count against its
+// budget. They may take up to half of it, so that the images viewed last
+// aren't all pushed out by the ones not viewed yet.
+#define PREFETCH_BUDGET_DIVISOR 2
+
+typedef enum
+{
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_FAILED,
+
+} PrefetchState;
+
+typedef struct _PrefetchEntry PrefetchEntry;
+
+struct _PrefetchEntry
+{
+    gint ref_count;
+    gchar *path;
+    time_t mtime;
+    PrefetchState state;
+    gboolean wanted;
+    gint distance;
+    gint max_size;
+    GCancellable *cancellable;
+    VnrImage *image;
+};
+
+struct _VnrPrefetch
+{
+    VnrImageCache *cache;
+    GThreadPool *pool;
+    GMutex mutex;
+    GCond cond;
+    GHashTable *entries;
+    gsize total_size;
+    gsize budget;
+    gint max_size;
+};
+
+static PrefetchEntry* _entry_new(VnrFile *file, gint distance,
+                                 gint max_size);
+static PrefetchEntry* _entry_ref(PrefetchEntry *entry);
+static void _entry_unref(PrefetchEntry *entry);
+static gboolean _entry_covers(PrefetchEntry *entry, gint max_size);
+
+static void _prefetch_worker(PrefetchEntry *entry, VnrPrefetch *prefetch);
+static gint _prefetch_compare_jobs(gconstpointer a, gconstpointer b,
+                                   gpointer user_data);
+static void _prefetch_want(VnrPrefetch *prefetch, VnrFile *file,
+                           gint distance, gboolean schedule);
+static void _prefetch_remove_entry(VnrPrefetch *prefetch,
+                                   PrefetchEntry *entry);
+static void _prefetch_enforce_budget(VnrPrefetch *prefetch);
+
+
+// entries --------------------------------------------------------------------
+
+static PrefetchEntry* _entry_new(VnrFile *file, gint distance,
+                                 gint max_size)
+{
+    PrefetchEntry *entry = g_slice_new0(PrefetchEntry);
+
+    entry->ref_count = 1;
+    entry->path = g_strdup(file->path);
+    entry->mtime = file->mtime;
+    entry->state = PREFETCH_QUEUED;
+    entry->wanted = TRUE;
+    entry->distance = distance;
+    entry->max_size = max_size;
+    entry->cancellable = g_cancellable_new();
+
+    return entry;
+}
+
+static PrefetchEntry* _entry_ref(PrefetchEntry *entry)
+{
+    ++entry->ref_count;
+
+    return entry;
+}
+
+static void _entry_unref(PrefetchEntry *entry)
+{
+    if (--entry->ref_count > 0)
+        return;
+
+    if (entry->image)
+        g_object_unref(entry->image);
+
+    g_object_unref(entry->cancellable);
+    g_free(entry->path);
+    g_slice_free(PrefetchEntry, entry);
+}
+
+static gboolean _entry_covers(PrefetchEntry *entry, gint max_size)
+{
+    if (entry->state == PREFETCH_DONE)
+        return vnr_image_covers(entry->image, max_size);
+
+    return entry->max_size <= 0
+           || (max_size > 0 && entry->max_size >= max_size);
+}
+
+
+
+// creation -------------------------------------------------------------------
+
+VnrPrefetch* vnr_prefetch_new(VnrImageCache *cache)
+{
+    VnrPrefetch *prefetch = g_slice_new0(VnrPrefetch);
+
+    prefetch->cache = cache;
+
+    g_mutex_init(&prefetch->mutex);
+    g_cond_init(&prefetch->cond);
+
+    prefetch->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                              (GDestroyNotify) _entry_unref);
+
+    prefetch->pool = g_thread_pool_new((GFunc) _prefetch_worker,
+                                       prefetch,
+                                       PREFETCH_THREADS,
+                                       FALSE, NULL);
+
+    g_thread_pool_set_sort_function(prefetch->pool,
+                                    _prefetch_compare_jobs, NULL);
+
+    return prefetch;
+}
+
+void vnr_prefetch_free(VnrPrefetch *prefetch)
+{
+    if (!prefetch)
+        return;
+
+    // let queued jobs drain without decoding anything
+    g_mutex_lock(&prefetch->mutex);
+
+    GHashTableIter iter;
+    PrefetchEntry *entry;
+
+    g_hash_table_iter_init(&iter, prefetch->entries);
+
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer*) &entry))
+        entry->wanted = FALSE;
+
+    g_mutex_unlock(&prefetch->mutex);
+
+    g_thread_pool_free(prefetch->pool, FALSE, TRUE);
+
+    g_hash_table_destroy(prefetch->entries);
+    g_cond_clear(&prefetch->cond);
+    g_mutex_clear(&prefetch->mutex);
+
+    g_slice_free(VnrPrefetch, prefetch);
+}
+
+
+// worker ---------------------------------------------------------------------
+
+static void _prefetch_worker(PrefetchEntry *entry, VnrPrefetch *prefetch)
+{
+    g_mutex_lock(&prefetch->mutex);
+
+    if (!entry->wanted)
+    {
+        entry->state = PREFETCH_FAILED;
+        g_cond_broadcast(&prefetch->cond);
+        _entry_unref(entry);
+
+        g_mutex_unlock(&prefetch->mutex);
+
+        return;
+    }
+
+    entry->state = PREFETCH_RUNNING;
+
+    g_mutex_unlock(&prefetch->mutex);
+
+    // entry->path is never modified once the entry exists
+    VnrImage *image = vnr_image_new_for_path(entry->path, entry->mtime,
+                                             entry->max_size,
+                                             entry->cancellable, NULL);
+
+    g_mutex_lock(&prefetch->mutex);
+
+    if (image && entry->wanted)
+    {
+        // outlives the entry when the user moves away
+        vnr_image_cache_insert(prefetch->cache, image);
+
+        entry->image = image;
+        entry->state = PREFETCH_DONE;
+
+        prefetch->total_size += image->size;
+
+        _prefetch_enforce_budget(prefetch);
+    }
+    else
+    {
+        if (image)
+            g_object_unref(image);
+
+        entry->state = PREFETCH_FAILED;
+    }
+
+    g_cond_broadcast(&prefetch->cond);
+    _entry_unref(entry);
+
+    g_mutex_unlock(&prefetch->mutex);
+}
+
+static gint _prefetch_compare_jobs(gconstpointer a, gconstpointer b,
+                                   gpointer user_data)
+{
+    (void) user_data;
+
+    const PrefetchEntry *entry_a = a;
+    const PrefetchEntry *entry_b = b;
+
+    return entry_a->distance - entry_b->distance;
+}
+
+
+// schedule -------------------------------------------------------------------
+
+void vnr_prefetch_update(VnrPrefetch *prefetch, VnrFileList *list,
+                         gboolean forward, gint count_next, gint count_prev,
+                         gint max_size)
+{
+    g_return_if_fail(prefetch != NULL);
+
+    gsize budget = vnr_image_cache_get_budget(prefetch->cache)
+                   / PREFETCH_BUDGET_DIVISOR;
+
+    g_mutex_lock(&prefetch->mutex);
+
+    prefetch->budget = budget;
+    prefetch->max_size = max_size;
+
+    GHashTableIter iter;
+    PrefetchEntry *entry;
+
+    g_hash_table_iter_init(&iter, prefetch->entries);
+
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer*) &entry))
+    {
+        entry->wanted = FALSE;
+        entry->distance = G_MAXINT;
+    }
+
+    gint current = vnr_list_get_index(list);
+
+    if (current >= 0)
+    {
+        // keep the displayed image, so that coming back to it is free
+        _prefetch_want(prefetch, vnr_list_get(list, current), 0, FALSE);
+
+        gint count_ahead = forward ? count_next : count_prev;
+        gint count_behind = forward ? count_prev : count_next;
+        gint step = forward ? 1 : -1;
+
+        for (gint i = 1; i <= count_ahead; ++i)
+        {
+            gint it = vnr_list_wrap_index(list, current + i * step);
+
+            if (it == current)
+                break;
+
+            _prefetch_want(prefetch, vnr_list_get(list, it), i, TRUE);
+        }
+
+        for (gint i = 1; i <= count_behind; ++i)
+        {
+            gint it = vnr_list_wrap_index(list, current - i * step);
+
+            if (it == current)
+                break;
+
+            _prefetch_want(prefetch, vnr_list_get(list, it), count_ahead + i,
+                           TRUE);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, prefetch->entries);
+
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer*) &entry))
+    {
+        if (entry->wanted)
+            continue;
+
+        if (entry->state == PREFETCH_DONE)
+            prefetch->total_size -= entry->image->size;
+        else if (entry->state == PREFETCH_RUNNING)
+            g_cancellable_cancel(entry->cancellable);
+
+        g_hash_table_iter_remove(&iter);
+    }
+
+    _prefetch_enforce_budget(prefetch);
+
+    g_mutex_unlock(&prefetch->mutex);
+}
+
+static void _prefetch_want(VnrPrefetch *prefetch, VnrFile *file,
+                           gint distance, gboolean schedule)
+{
+    PrefetchEntry *entry = g_hash_table_lookup(prefetch->entries, file->path);
+
+    // outdated, or decoded smaller than the view needs now
+    if (entry && (entry->mtime != file->mtime
+                  || !_entry_covers(entry, prefetch->max_size)))
+    {
+        _prefetch_remove_entry(prefetch, entry);
+        entry = NULL;
+    }
+
+    if (entry)
+    {
+        entry->wanted = TRUE;
+        entry->distance = MIN(entry->distance, distance);
+
+        return;
+    }
+
+    if (!schedule || prefetch->total_size >= prefetch->budget)
+        return;
+
+    if (vnr_image_cache_contains(prefetch->cache, file->path, file->mtime,
+                                 prefetch->max_size))
+        return;
+
+    entry = _entry_new(file, distance, prefetch->max_size);
+    g_hash_table_insert(prefetch->entries, entry->path, entry);
+
+    g_thread_pool_push(prefetch->pool, _entry_ref(entry), NULL);
+}
+
+static void _prefetch_remove_entry(VnrPrefetch *prefetch,
+                                   PrefetchEntry *entry)
+{
+    // a running worker keeps its own reference and drops the result
+    entry->wanted = FALSE;
+
+    if (entry->state == PREFETCH_DONE)
+        prefetch->total_size -= entry->image->size;
+    else if (entry->state == PREFETCH_RUNNING)
+        g_cancellable_cancel(entry->cancellable);
+
+    g_hash_table_remove(prefetch->entries, entry->path);
+}
+
+static void _prefetch_enforce_budget(VnrPrefetch *prefetch)
+{
+    while (prefetch->total_size > prefetch->budget)
+    {
+        GHashTableIter iter;
+        PrefetchEntry *entry;
+        PrefetchEntry *farthest = NULL;
+
+        g_hash_table_iter_init(&iter, prefetch->entries);
+
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer*) &entry))
+        {
+            if (entry->state != PREFETCH_DONE)
+                continue;
+
+            if (!farthest || entry->distance > farthest->distance)
+                farthest = entry;
+        }
+
+        if (!farthest)
+            break;
+
+        _prefetch_remove_entry(prefetch, farthest);
+    }
+}
+
+
+// lookup ---------------------------------------------------------------------
+
+VnrImage* vnr_prefetch_lookup(VnrPrefetch *prefetch, VnrFile *file,
+                              gint max_size, gboolean *pending)
+{
+    g_return_val_if_fail(prefetch != NULL, NULL);
+    g_return_val_if_fail(file != NULL, NULL);
+
+    if (pending)
+        *pending = FALSE;
+
+    g_mutex_lock(&prefetch->mutex);
+
+    PrefetchEntry *entry = g_hash_table_lookup(prefetch->entries, file->path);
+
+    if (!entry || entry->mtime != file->mtime)
+    {
+        g_mutex_unlock(&prefetch->mutex);
+        return NULL;
+    }
+
+    // decoded at a lower resolution than the caller needs
+    if (entry->state != PREFETCH_QUEUED && !_entry_covers(entry, max_size))
+    {
+        g_mutex_unlock(&prefetch->mutex);
+        return NULL;
+    }
+
+    VnrImage *image = NULL;
+
+    switch (entry->state)
+    {
+    case PREFETCH_QUEUED:
+        // the caller decodes it right away, don't do it twice
+        _prefetch_remove_entry(prefetch, entry);
+        break;
+
+    case PREFETCH_RUNNING:
+        entry->wanted = TRUE;
+        entry->distance = 0;
+
+        if (pending)
+            *pending = TRUE;
+        break;
+
+    case PREFETCH_DONE:
+        image = g_object_ref(entry->image);
+        break;
+
+    default:
+        break;
+    }
+
+    g_mutex_unlock(&prefetch->mutex);
+
+    return image;
+}
+
+VnrImage* vnr_prefetch_wait(VnrPrefetch *prefetch,
+                            const gchar *path, time_t mtime,
+                            GCancellable *cancellable)
+{
+    g_return_val_if_fail(prefetch != NULL, NULL);
+    g_return_val_if_fail(path != NULL, NULL);
+
+    g_mutex_lock(&prefetch->mutex);
+
+    PrefetchEntry *entry = g_hash_table_lookup(prefetch->entries, path);
+
+    if (!entry || entry->mtime != mtime)
+    {
+        g_mutex_unlock(&prefetch->mutex);
+        return NULL;
+    }
+
+    _entry_ref(entry);
+
+    // wake up regularly to notice cancellation
+    while (entry->state == PREFETCH_RUNNING
+           && !g_cancellable_is_cancelled(cancellable))
+    {
+        gint64 end_time = g_get_monotonic_time()
+                          + 50 * G_TIME_SPAN_MILLISECOND;
+
+        g_cond_wait_until(&prefetch->cond, &prefetch->mutex, end_time);
+    }
+
+    VnrImage *image = NULL;
+
+    if (entry->state == PREFETCH_DONE)
+        image = g_object_ref(entry->image);
+
+    _entry_unref(entry);
+
+    g_mutex_unlock(&prefetch->mutex);
+
+    return image;
+}
+
+void vnr_prefetch_remove(VnrPrefetch *prefetch, const gchar *path)
+{
+    g_return_if_fail(prefetch != NULL);
+
+    if (!path)
+        return;
+
+    g_mutex_lock(&prefetch->mutex);
+
+    PrefetchEntry *entry = g_hash_table_lookup(prefetch->entries, path);
+
+    if (entry)
+        _prefetch_remove_entry(prefetch, entry);
+
+    g_mutex_unlock(&prefetch->mutex);
+}
+
+
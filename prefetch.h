@@ -0,0 +1,30 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "file.h"
+#include "image.h"
+#include "imagecache.h"
+#include "list.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrPrefetch VnrPrefetch;
+
+VnrPrefetch* vnr_prefetch_new(VnrImageCache *cache);
+void vnr_prefetch_free(VnrPrefetch *prefetch);
+
+void vnr_prefetch_update(VnrPrefetch *prefetch, VnrFileList *list,
+                         gboolean forward, gint count_next, gint count_prev,
+                         gint max_size);
+VnrImage* vnr_prefetch_lookup(VnrPrefetch *prefetch, VnrFile *file,
+                              gint max_size, gboolean *pending);
+VnrImage* vnr_prefetch_wait(VnrPrefetch *prefetch,
+                            const gchar *path, time_t mtime,
+                            GCancellable *cancellable);
+void vnr_prefetch_remove(VnrPrefetch *prefetch, const gchar *path);
+
+G_END_DECLS
+
+#endif // PREFETCH_H
+
+
@@ -0,0 +1,111 @@
+#include "preview.h"
+#include "uni-exiv2.hpp"
+
+#include <gio/gio.h>
+
+static GdkPixbuf* _preview_orient(GdkPixbuf *pixbuf, gint orientation);
+
+
+// load -----------------------------------------------------------------------
+
+GdkPixbuf* vnr_preview_load(const gchar *path, gint size,
+                            gint *width, gint *height)
+{
+    // Returns the image fitted in a box of size pixels, oriented, with the
+    // size of the image in width and height, 0 when unknown. Images already
+    // smaller are not scaled up.
+
+    gint image_width = 0;
+    gint image_height = 0;
+    GdkPixbufFormat *format = gdk_pixbuf_get_file_info(path, &image_width,
+                                                       &image_height);
+    GdkPixbuf *pixbuf = NULL;
+
+    if (format && image_width <= size && image_height <= size)
+    {
+        pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+    }
+    else
+    {
+        // camera files, gdk-pixbuf may not know the raw ones
+        gchar *name = format ? gdk_pixbuf_format_get_name(format) : NULL;
+        gboolean camera = !format || g_strcmp0(name, "jpeg") == 0
+                          || g_strcmp0(name, "tiff") == 0;
+        g_free(name);
+
+        if (camera)
+        {
+            pixbuf = vnr_preview_load_embedded(path, size, width, height);
+
+            if (pixbuf)
+            {
+                if (*width == 0 || *height == 0)
+                {
+                    *width = image_width;
+                    *height = image_height;
+                }
+
+                return pixbuf;
+            }
+        }
+
+        // the JPEG loader decodes at 1/2, 1/4 or 1/8 scale when asked for
+        // a smaller size, 1/8 needs only the DC coefficients
+        if (format)
+            pixbuf = gdk_pixbuf_new_from_file_at_size(path, size, size, NULL);
+    }
+
+    *width = image_width;
+    *height = image_height;
+
+    if (!pixbuf)
+        return NULL;
+
+    GdkPixbuf *oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+    g_object_unref(pixbuf);
+
+    return oriented;
+}
+
+GdkPixbuf* vnr_preview_load_embedded(const gchar *path, gint size,
+                                     gint *width, gint *height)
+{
+    // The preview a camera stored in the file, when one is large enough.
+
+    gint orientation = 1;
+
+    GBytes *bytes = uni_read_exiv2_preview(path, size, width, height,
+                                           &orientation);
+    if (!bytes)
+        return NULL;
+
+    GInputStream *stream = g_memory_input_stream_new_from_bytes(bytes);
+    g_bytes_unref(bytes);
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream_at_scale(stream,
+                                                            size, size, TRUE,
+                                                            NULL, NULL);
+    g_object_unref(stream);
+
+    if (!pixbuf)
+        return NULL;
+
+    return _preview_orient(pixbuf, orientation);
+}
+
+static GdkPixbuf* _preview_orient(GdkPixbuf *pixbuf, gint orientation)
+{
+    // Previews rarely have Exif data of their own, the orientation of the
+    // image is applied unless they do.
+
+    gchar value[8];
+    g_snprintf(value, sizeof(value), "%d", orientation);
+    gdk_pixbuf_set_option(pixbuf, "orientation", value);
+
+    GdkPixbuf *oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+    g_object_unref(pixbuf);
+
+    return oriented;
+}
+
+
@@ -0,0 +1,20 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Small versions of images, made without decoding them in full when
+// possible. Can be called from worker threads.
+
+GdkPixbuf* vnr_preview_load(const gchar *path, gint size,
+                            gint *width, gint *height);
+GdkPixbuf* vnr_preview_load_embedded(const gchar *path, gint size,
+                                     gint *width, gint *height);
+
+G_END_DECLS
+
+#endif // PREVIEW_H
+
+
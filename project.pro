@@ -20,6 +20,8 @@ HEADERS = \
     src/uni-exiv2.hpp \
     src/uni-image-view.h \
     src/uni-nav.h \
+    src/uni-pyramid.h \
+    src/uni-scale.h \
     src/uni-scroll-win.h \
     src/uni-utils.h \
     src/uni-zoom.h \
@@ -31,8 +33,16 @@ HEADERS = \
     config.h.in \
     dialog.h \
     file.h \
+    image.h \
+    imagecache.h \
     list.h \
+    listcache.h \
+    loader.h \
+    prefetch.h \
     preferences.h \
+    preview.h \
+    thumbnails.h \
+    thumbview.h \
     window.h \
 
 SOURCES = \
@@ -42,6 +52,8 @@ SOURCES = \
     src/uni-exiv2.cpp \
     src/uni-image-view.c \
     src/uni-nav.c \
+    src/uni-pyramid.c \
+    src/uni-scale.c \
     src/uni-scroll-win.c \
     src/uni-utils.c \
     src/vnr-crop.c \
@@ -52,9 +64,17 @@ SOURCES = \
     0temp.c \
     dialog.c \
     file.c \
+    image.c \
+    imagecache.c \
     list.c \
+    listcache.c \
+    loader.c \
     main.c \
+    prefetch.c \
     preferences.c \
+    preview.c \
+    thumbnails.c \
+    thumbview.c \
     window.c \
 
 DISTFILES = \
@@ -22,6 +22,7 @@
 
 #include "uni-cache.h"
 #include "uni-utils.h"
+#include <math.h>
 #include <string.h>
 
 static gboolean
@@ -34,25 +35,25 @@ uni_rectangle_contains_rect(GdkRectangle r1, GdkRectangle r2)
 }
 
 static void
-uni_pixbuf_copy_area_intact(GdkPixbuf *src,
-                            int src_x,
-                            int src_y,
-                            int width,
-                            int height,
-                            GdkPixbuf *dst, int dst_x, int dst_y)
+uni_surface_copy_area_intact(cairo_surface_t *src,
+                             int src_x,
+                             int src_y,
+                             int width,
+                             int height,
+                             cairo_surface_t *dst, int dst_x, int dst_y)
 {
     int y;
     if (src_x == dst_x && src_y == dst_y && src == dst)
         return;
 
-    int src_stride = gdk_pixbuf_get_rowstride(src);
-    int dst_stride = gdk_pixbuf_get_rowstride(dst);
-    int chans = gdk_pixbuf_get_n_channels(src);
+    int src_stride = cairo_image_surface_get_stride(src);
+    int dst_stride = cairo_image_surface_get_stride(dst);
+    int chans = 4;
 
     int linelen = width * chans;
 
-    guchar *src_base = gdk_pixbuf_get_pixels(src);
-    guchar *dst_base = gdk_pixbuf_get_pixels(dst);
+    guchar *src_base = cairo_image_surface_get_data(src);
+    guchar *dst_base = cairo_image_surface_get_data(dst);
 
     int src_y_ofs = src_y * src_stride;
     int dst_y_ofs = dst_y * dst_stride;
@@ -117,7 +118,7 @@ UniPixbufDrawCache *
 uni_pixbuf_draw_cache_new()
 {
     UniPixbufDrawCache *cache = g_new0(UniPixbufDrawCache, 1);
-    cache->last_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 1, 1);
+    cache->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 1, 1);
     cache->check_size = 16;
     cache->old = (UniPixbufDrawOpts){
         0,
@@ -125,7 +126,7 @@ uni_pixbuf_draw_cache_new()
         0,
         0,
         GDK_INTERP_NEAREST,
-        cache->last_pixbuf};
+        NULL};
     return cache;
 }
 
@@ -137,7 +138,8 @@ uni_pixbuf_draw_cache_new()
  **/
 void uni_pixbuf_draw_cache_free(UniPixbufDrawCache *cache)
 {
-    g_object_unref(cache->last_pixbuf);
+    uni_pyramid_free(cache->pyramid);
+    cairo_surface_destroy(cache->surface);
     g_free(cache);
 }
 
@@ -157,14 +159,280 @@ void uni_pixbuf_draw_cache_free(UniPixbufDrawCache *cache)
  * which is why this method must be used to tell draw cache about it.
  **/
 void uni_pixbuf_draw_cache_invalidate(UniPixbufDrawCache *cache)
+{
+    uni_pixbuf_draw_cache_damage(cache, NULL);
+}
+
+/**
+ * uni_pixbuf_draw_cache_damage:
+ * @cache: a #UniPixbufDrawCache
+ * @rect: the area of the pixbuf, in image space coordinates, that
+ *   has changed or %NULL for all of it
+ *
+ * Like uni_pixbuf_draw_cache_invalidate(), but only the reduced
+ * levels computed from @rect are thrown away.
+ **/
+void uni_pixbuf_draw_cache_damage(UniPixbufDrawCache *cache,
+                                  GdkRectangle *rect)
 {
     /* Set the cached zoom to a bogus value, to force a
        DRAW_FLAGS_SCALE. */
     cache->old.zoom = -1234.0;
+
+    if (cache->pyramid)
+        uni_pyramid_damage(cache->pyramid, rect);
+}
+
+/**
+ * uni_pixbuf_draw_cache_update_pyramid:
+ *
+ * Drops the pyramid once another pixbuf is drawn. A new one is only
+ * built when that pixbuf is drawn zoomed out.
+ **/
+static void
+uni_pixbuf_draw_cache_update_pyramid(UniPixbufDrawCache *cache,
+                                     GdkPixbuf *pixbuf)
+{
+    if (cache->pyramid && uni_pyramid_get_source(cache->pyramid) != pixbuf)
+    {
+        uni_pyramid_free(cache->pyramid);
+        cache->pyramid = NULL;
+    }
+}
+
+/*************************************************************/
+/***** Band parallel scaling *********************************/
+/*************************************************************/
+
+/* Scales smaller than this are not worth handing to other threads. */
+#define UNI_CACHE_BAND_MIN_PIXELS (256 * 256)
+#define UNI_CACHE_BAND_MIN_HEIGHT 32
+#define UNI_CACHE_MAX_BANDS 32
+
+typedef struct
+{
+    GMutex mutex;
+    GCond cond;
+    int pending;
+} UniScaleJob;
+
+typedef struct
+{
+    UniScaleJob *job;
+    GdkPixbuf *src;
+    /* Read instead of @src when set. */
+    const UniScaleTiles *tiles;
+    cairo_surface_t *dst;
+    int dst_x;
+    int dst_y;
+    int width;
+    int height;
+    gdouble offset_x;
+    gdouble offset_y;
+    gdouble zoom;
+    GdkInterpType interp;
+    int check_x;
+    int check_y;
+} UniScaleBand;
+
+static void
+uni_pixbuf_draw_cache_scale_band(UniScaleBand *band)
+{
+    if (band->tiles)
+    {
+        uni_scale_blend_surface_tiles(band->tiles, band->dst,
+                                      band->dst_x, band->dst_y,
+                                      band->width, band->height,
+                                      band->offset_x, band->offset_y,
+                                      band->zoom, band->interp,
+                                      band->check_x, band->check_y);
+        return;
+    }
+    uni_surface_scale_blend(band->src, band->dst,
+                            band->dst_x, band->dst_y,
+                            band->width, band->height,
+                            band->offset_x, band->offset_y,
+                            band->zoom, band->interp,
+                            band->check_x, band->check_y);
+}
+
+static void
+uni_pixbuf_draw_cache_band_worker(UniScaleBand *band, gpointer user_data)
+{
+    (void) user_data;
+    UniScaleJob *job = band->job;
+
+    uni_pixbuf_draw_cache_scale_band(band);
+
+    g_mutex_lock(&job->mutex);
+    if (--job->pending == 0)
+        g_cond_signal(&job->cond);
+    g_mutex_unlock(&job->mutex);
+}
+
+/**
+ * uni_pixbuf_draw_cache_get_pool:
+ *
+ * Returns the worker threads shared by all draw caches, one less than
+ * the number of processors since the drawing thread scales a band
+ * too, or %NULL on a single processor. The threads are started once
+ * and kept for the life of the process.
+ **/
+static GThreadPool *
+uni_pixbuf_draw_cache_get_pool(void)
+{
+    static gsize initialized = 0;
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter(&initialized))
+    {
+        int n_threads = MIN((int) g_get_num_processors(),
+                            UNI_CACHE_MAX_BANDS) - 1;
+        if (n_threads > 0)
+            pool = g_thread_pool_new(
+                (GFunc) uni_pixbuf_draw_cache_band_worker,
+                NULL, n_threads, TRUE, NULL);
+        g_once_init_leave(&initialized, 1);
+    }
+    return pool;
+}
+
+/**
+ * uni_pixbuf_draw_cache_scale_bands:
+ *
+ * Same as uni_surface_scale_blend(), but large areas are cut into
+ * horizontal bands scaled in parallel. Each band writes to its own
+ * rows of @dst, and the call returns once all of them are done. The
+ * pixels are read from @tiles instead of @src when it is set.
+ **/
+static void
+uni_pixbuf_draw_cache_scale_bands(GdkPixbuf *src,
+                                  const UniScaleTiles *tiles,
+                                  cairo_surface_t *dst,
+                                  int dst_x, int dst_y,
+                                  int width, int height,
+                                  gdouble offset_x, gdouble offset_y,
+                                  gdouble zoom, GdkInterpType interp,
+                                  int check_x, int check_y)
+{
+    GThreadPool *pool = NULL;
+    int n_bands = 1;
+
+    if ((gint64) width * height >= UNI_CACHE_BAND_MIN_PIXELS)
+        pool = uni_pixbuf_draw_cache_get_pool();
+    if (pool)
+        n_bands = CLAMP(height / UNI_CACHE_BAND_MIN_HEIGHT, 1,
+                        (int) g_thread_pool_get_max_threads(pool) + 1);
+
+    UniScaleJob job;
+    UniScaleBand bands[UNI_CACHE_MAX_BANDS];
+    int n, top = 0;
+
+    for (n = 0; n < n_bands; n++)
+    {
+        int bottom = height * (n + 1) / n_bands;
+        bands[n] = (UniScaleBand){
+            &job, src, tiles, dst,
+            dst_x, dst_y + top,
+            width, bottom - top,
+            offset_x, offset_y,
+            zoom, interp,
+            check_x, check_y + top};
+        top = bottom;
+    }
+
+    if (n_bands == 1)
+    {
+        uni_pixbuf_draw_cache_scale_band(&bands[0]);
+        return;
+    }
+
+    g_mutex_init(&job.mutex);
+    g_cond_init(&job.cond);
+    job.pending = n_bands - 1;
+
+    /* The first band is scaled right here while the pool takes care
+       of the others. */
+    for (n = 1; n < n_bands; n++)
+        g_thread_pool_push(pool, &bands[n], NULL);
+    uni_pixbuf_draw_cache_scale_band(&bands[0]);
+
+    g_mutex_lock(&job.mutex);
+    while (job.pending > 0)
+        g_cond_wait(&job.cond, &job.mutex);
+    g_mutex_unlock(&job.mutex);
+
+    g_mutex_clear(&job.mutex);
+    g_cond_clear(&job.cond);
 }
 
-static GdkPixbuf *
-uni_pixbuf_draw_cache_scroll_intersection(GdkPixbuf *pixbuf,
+/**
+ * uni_pixbuf_draw_cache_scale:
+ *
+ * Scales the area @dst_x, @dst_y, @width, @height of the cache from
+ * the pixbuf in @opts, see uni_surface_scale_blend(). When zoomed out,
+ * the tiles of the pyramid level nearest to the zoom are read
+ * instead.
+ **/
+static void
+uni_pixbuf_draw_cache_scale(UniPixbufDrawCache *cache,
+                            UniPixbufDrawOpts *opts,
+                            int dst_x, int dst_y,
+                            int width, int height,
+                            gdouble offset_x, gdouble offset_y,
+                            int check_x, int check_y)
+{
+    gdouble zoom = opts->zoom;
+    UniScaleTiles *tiles = NULL;
+    int level = 0;
+
+    /* Averaged pixels would look different from nearest sampling.
+       Below half size, the filter footprint of the full pixbuf grows
+       with the square of the zoom out, start from the nearest larger
+       level instead. Only the filtered scaler reads tiles. */
+    if (opts->interp == GDK_INTERP_BILINEAR && zoom < 0.5)
+    {
+        if (!cache->pyramid)
+            cache->pyramid = uni_pyramid_new(opts->pixbuf);
+        if (cache->pyramid)
+            level = uni_pyramid_get_level_for_zoom(cache->pyramid, zoom);
+    }
+
+    if (level > 0)
+    {
+        zoom *= (gdouble)(1 << level);
+
+        /* The area of the level sampled, with a margin for the
+           filter. */
+        GdkRectangle area;
+        area.x = (int)floor((dst_x - offset_x) / zoom) - 1;
+        area.y = (int)floor((dst_y - offset_y) / zoom) - 1;
+        area.width = (int)ceil(width / zoom) + 3;
+        area.height = (int)ceil(height / zoom) + 3;
+
+        tiles = uni_pyramid_get_area(cache->pyramid, level, &area);
+        if (!tiles)
+            return;
+
+        /* The tiles only hold the area, not the whole level. */
+        offset_x += area.x * zoom;
+        offset_y += area.y * zoom;
+    }
+
+    cairo_surface_flush(cache->surface);
+    uni_pixbuf_draw_cache_scale_bands(opts->pixbuf, tiles, cache->surface,
+                                      dst_x, dst_y, width, height,
+                                      offset_x, offset_y,
+                                      zoom, opts->interp, check_x, check_y);
+    cairo_surface_mark_dirty_rectangle(cache->surface,
+                                       dst_x, dst_y, width, height);
+
+    if (tiles)
+        uni_pyramid_release_area(cache->pyramid, level, tiles);
+}
+
+static cairo_surface_t *
+uni_pixbuf_draw_cache_scroll_intersection(cairo_surface_t *surface,
                                           int new_width,
                                           int new_height,
                                           int src_x,
@@ -173,30 +441,33 @@ uni_pixbuf_draw_cache_scroll_intersection(GdkPixbuf *pixbuf,
                                           int inter_height,
                                           int dst_x, int dst_y)
 {
-    int last_width = gdk_pixbuf_get_width(pixbuf);
-    int last_height = gdk_pixbuf_get_height(pixbuf);
+    int last_width = cairo_image_surface_get_width(surface);
+    int last_height = cairo_image_surface_get_height(surface);
 
     int width = MAX(last_width, new_width);
     int height = MAX(last_height, new_height);
+
+    cairo_surface_flush(surface);
     if (width > last_width || height > last_height)
     {
-        GdkColorspace cs = gdk_pixbuf_get_colorspace(pixbuf);
-        int bps = gdk_pixbuf_get_bits_per_sample(pixbuf);
-        gboolean alpha = gdk_pixbuf_get_has_alpha(pixbuf);
-        GdkPixbuf *tmp = gdk_pixbuf_new(cs, alpha, bps, width, height);
-
-        uni_pixbuf_copy_area_intact(pixbuf,
-                                    src_x, src_y,
-                                    inter_width, inter_height,
-                                    tmp, dst_x, dst_y);
-        g_object_unref(pixbuf);
+        cairo_surface_t *tmp =
+            cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+
+        cairo_surface_flush(tmp);
+        uni_surface_copy_area_intact(surface,
+                                     src_x, src_y,
+                                     inter_width, inter_height,
+                                     tmp, dst_x, dst_y);
+        cairo_surface_mark_dirty(tmp);
+        cairo_surface_destroy(surface);
         return tmp;
     }
-    uni_pixbuf_copy_area_intact(pixbuf,
-                                src_x, src_y,
-                                inter_width, inter_height,
-                                pixbuf, dst_x, dst_y);
-    return pixbuf;
+    uni_surface_copy_area_intact(surface,
+                                 src_x, src_y,
+                                 inter_width, inter_height,
+                                 surface, dst_x, dst_y);
+    cairo_surface_mark_dirty(surface);
+    return surface;
 }
 
 /**
@@ -225,8 +496,8 @@ uni_pixbuf_draw_cache_intersect_draw(UniPixbufDrawCache *cache,
     if (gdk_rectangle_intersect(&old_rect, &this, &inter))
         uni_rectangle_get_rects_around(&this, &inter, around);
 
-    cache->last_pixbuf =
-        uni_pixbuf_draw_cache_scroll_intersection(cache->last_pixbuf,
+    cache->surface =
+        uni_pixbuf_draw_cache_scroll_intersection(cache->surface,
                                                   this.width,
                                                   this.height,
                                                   inter.x - old_rect.x,
@@ -240,14 +511,12 @@ uni_pixbuf_draw_cache_intersect_draw(UniPixbufDrawCache *cache,
     {
         if (!around[n].width || !around[n].height)
             continue;
-        uni_pixbuf_scale_blend(opts->pixbuf,
-                               cache->last_pixbuf,
-                               around[n].x - this.x,
-                               around[n].y - this.y,
-                               around[n].width, around[n].height,
-                               -this.x, -this.y,
-                               opts->zoom,
-                               opts->interp, around[n].x, around[n].y);
+        uni_pixbuf_draw_cache_scale(cache, opts,
+                                    around[n].x - this.x,
+                                    around[n].y - this.y,
+                                    around[n].width, around[n].height,
+                                    -this.x, -this.y,
+                                    around[n].x, around[n].y);
     }
 }
 
@@ -264,6 +533,7 @@ void uni_pixbuf_draw_cache_draw(UniPixbufDrawCache *cache,
                                 UniPixbufDrawOpts *opts, cairo_t *cr)
 {
     GdkRectangle this = opts->zoom_rect;
+    uni_pixbuf_draw_cache_update_pyramid(cache, opts->pixbuf);
     UniPixbufDrawMethod method =
         uni_pixbuf_draw_cache_get_method(&cache->old, opts);
     int deltax = 0;
@@ -279,28 +549,22 @@ void uni_pixbuf_draw_cache_draw(UniPixbufDrawCache *cache,
     }
     else if (method == UNI_PIXBUF_DRAW_METHOD_SCALE)
     {
-        int last_width = gdk_pixbuf_get_width(cache->last_pixbuf);
-        int last_height = gdk_pixbuf_get_height(cache->last_pixbuf);
-        GdkColorspace new_cs = gdk_pixbuf_get_colorspace(opts->pixbuf);
-        GdkColorspace last_cs =
-            gdk_pixbuf_get_colorspace(cache->last_pixbuf);
-        int new_bps = gdk_pixbuf_get_bits_per_sample(opts->pixbuf);
-        int last_bps = gdk_pixbuf_get_bits_per_sample(cache->last_pixbuf);
-
-        if (this.width > last_width || this.height > last_height ||
-            new_cs != last_cs || new_bps != last_bps)
+        int last_width = cairo_image_surface_get_width(cache->surface);
+        int last_height = cairo_image_surface_get_height(cache->surface);
+
+        if (this.width > last_width || this.height > last_height)
         {
-            g_object_unref(cache->last_pixbuf);
-            cache->last_pixbuf = gdk_pixbuf_new(new_cs, FALSE, new_bps,
-                                                this.width, this.height);
+            cairo_surface_destroy(cache->surface);
+            cache->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                        this.width,
+                                                        this.height);
         }
 
-        uni_pixbuf_scale_blend(opts->pixbuf,
-                               cache->last_pixbuf,
-                               0, 0,
-                               this.width, this.height,
-                               (double)-this.x, (double)-this.y,
-                               opts->zoom, opts->interp, this.x, this.y);
+        uni_pixbuf_draw_cache_scale(cache, opts,
+                                    0, 0,
+                                    this.width, this.height,
+                                    (double)-this.x, (double)-this.y,
+                                    this.x, this.y);
     }
     cairo_save(cr);
     GdkRectangle rect;
@@ -309,13 +573,12 @@ void uni_pixbuf_draw_cache_draw(UniPixbufDrawCache *cache,
     rect.width = this.width;
     rect.height = this.height;
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-    GdkPixbuf *subpixbuf = gdk_pixbuf_new_subpixbuf(cache->last_pixbuf, deltax, deltay, this.width, this.height);
-    gdk_cairo_set_source_pixbuf(cr, subpixbuf, rect.x, rect.y);
+    cairo_set_source_surface(cr, cache->surface,
+                             rect.x - deltax, rect.y - deltay);
     cairo_rectangle(cr, opts->widget_x, opts->widget_y, this.width, this.height);
     cairo_clip(cr);
     cairo_paint(cr);
     cairo_restore(cr);
-    g_object_unref(subpixbuf);
     if (method != UNI_PIXBUF_DRAW_METHOD_CONTAINS)
         cache->old = *opts;
 }
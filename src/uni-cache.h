@@ -24,6 +24,7 @@
 #define __UNI_CACHE_H__
 
 #include <gdk/gdk.h>
+#include "uni-pyramid.h"
 
 typedef struct _UniPixbufDrawOpts UniPixbufDrawOpts;
 typedef struct _UniPixbufDrawCache UniPixbufDrawCache;
@@ -77,14 +78,22 @@ struct _UniPixbufDrawOpts
  **/
 struct _UniPixbufDrawCache
 {
-    GdkPixbuf *last_pixbuf;
+    /* The last drawn area, kept in the format cairo paints from so
+       that drawing it again is a plain copy. */
+    cairo_surface_t *surface;
     UniPixbufDrawOpts old;
     int check_size;
+
+    /* Reduced levels of the pixbuf to scale from when zoomed
+       out. */
+    UniPyramid *pyramid;
 };
 
 UniPixbufDrawCache *uni_pixbuf_draw_cache_new(void);
 void uni_pixbuf_draw_cache_free(UniPixbufDrawCache *cache);
 void uni_pixbuf_draw_cache_invalidate(UniPixbufDrawCache *cache);
+void uni_pixbuf_draw_cache_damage(UniPixbufDrawCache *cache,
+                                  GdkRectangle *rect);
 void uni_pixbuf_draw_cache_draw(UniPixbufDrawCache *cache,
                                 UniPixbufDrawOpts *opts,
                                 cairo_t *cr);
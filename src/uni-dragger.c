@@ -142,7 +142,7 @@ uni_dragger_motion_notify(UniDragger *tool, GdkEventMotion *ev)
 void uni_dragger_pixbuf_changed(UniDragger *tool,
                                 gboolean reset_fit, GdkRectangle *rect)
 {
-    uni_pixbuf_draw_cache_invalidate(tool->cache);
+    uni_pixbuf_draw_cache_damage(tool->cache, rect);
 }
 
 void uni_dragger_paint_image(UniDragger *tool,
@@ -21,8 +21,12 @@
  */
 
 #include <exiv2/exiv2.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <memory>
+#include <mutex>
 
 #include "uni-exiv2.hpp"
 
@@ -37,21 +41,119 @@
 #endif
 #endif
 
-static std::unique_ptr<Exiv2::Image> cached_image;
-
-extern "C" void
-uni_read_exiv2_map(const char *uri, void (*callback)(const char *, const char *, void *), void *user_data)
+static void
+uni_exiv2_init_threads()
 {
+    // Exiv2 may be used from several threads once the XMP toolkit is
+    // initialized.
+
+    static std::once_flag xmp_once;
+    std::call_once(xmp_once, []() { Exiv2::XmpParser::initialize(); });
+
     Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+}
+
+struct _UniExiv2Metadata
+{
+    gint ref_count;
+    std::unique_ptr<Exiv2::Image> image;
+};
+
+extern "C" UniExiv2Metadata *
+uni_exiv2_metadata_new(const char *uri)
+{
+    // Parses the metadata of the file once, NULL when there's none Exiv2
+    // can read. Can be called from worker threads, the result is only
+    // read afterwards.
+
+    uni_exiv2_init_threads();
+
     try
     {
         std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(uri);
         if (image == nullptr)
         {
-            return;
+            return NULL;
         }
 
         image->readMetadata();
+
+        UniExiv2Metadata *metadata = new UniExiv2Metadata;
+        metadata->ref_count = 1;
+        metadata->image = std::move(image);
+
+        return metadata;
+    }
+    catch (EXIV_ERROR &)
+    {
+    }
+
+    return NULL;
+}
+
+extern "C" UniExiv2Metadata *
+uni_exiv2_metadata_new_for_data(gconstpointer data, gsize size)
+{
+    // Same from the contents of the file in memory. The metadata is
+    // copied to a blank image as the data doesn't outlive the call.
+
+    uni_exiv2_init_threads();
+
+    try
+    {
+        std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(
+            static_cast<const Exiv2::byte *>(data), size);
+        if (image == nullptr)
+        {
+            return NULL;
+        }
+
+        image->readMetadata();
+
+        std::unique_ptr<Exiv2::Image> copy =
+            Exiv2::ImageFactory::create(Exiv2::ImageType::jpeg);
+        copy->setMetadata(*image);
+
+        UniExiv2Metadata *metadata = new UniExiv2Metadata;
+        metadata->ref_count = 1;
+        metadata->image = std::move(copy);
+
+        return metadata;
+    }
+    catch (EXIV_ERROR &)
+    {
+    }
+
+    return NULL;
+}
+
+extern "C" UniExiv2Metadata *
+uni_exiv2_metadata_ref(UniExiv2Metadata *metadata)
+{
+    g_atomic_int_inc(&metadata->ref_count);
+
+    return metadata;
+}
+
+extern "C" void
+uni_exiv2_metadata_unref(UniExiv2Metadata *metadata)
+{
+    if (metadata == nullptr || !g_atomic_int_dec_and_test(&metadata->ref_count))
+    {
+        return;
+    }
+
+    delete metadata;
+}
+
+extern "C" void
+uni_exiv2_metadata_map(UniExiv2Metadata *metadata,
+                       void (*callback)(const char *, const char *, void *),
+                       void *user_data)
+{
+    try
+    {
+        Exiv2::Image *image = metadata->image.get();
         Exiv2::ExifData &exifData = image->exifData();
         Exiv2::IptcData &iptcData = image->iptcData();
 
@@ -109,64 +211,193 @@ uni_read_exiv2_map(const char *uri, void (*callback)(const char *, const char *,
 }
 
 extern "C" int
-uni_read_exiv2_to_cache(const char *uri)
+uni_exiv2_metadata_get_orientation(UniExiv2Metadata *metadata)
 {
-    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    int orientation = 1;
 
-    if (cached_image != nullptr)
+    try
+    {
+        Exiv2::ExifData &exifData = metadata->image->exifData();
+        Exiv2::ExifData::const_iterator pos = Exiv2::orientation(exifData);
+
+        if (pos != exifData.end())
+        {
+            sscanf(pos->toString().c_str(), "%d", &orientation);
+        }
+    }
+    catch (EXIV_ERROR &)
     {
-        cached_image->clearMetadata();
-        cached_image.reset(nullptr);
     }
 
+    return orientation;
+}
+
+extern "C" int
+uni_exiv2_metadata_write(UniExiv2Metadata *metadata, const char *uri)
+{
+    // Puts the metadata back into the file once its pixels were saved.
+    // The saved pixels are oriented already.
+
+    uni_exiv2_init_threads();
+
     try
     {
-        cached_image = Exiv2::ImageFactory::open(uri);
-        if (cached_image == nullptr)
+        std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(uri);
+        if (image == nullptr)
+        {
+            return 2;
+        }
+
+        image->setMetadata(*metadata->image);
+
+        Exiv2::ExifData &exifData = image->exifData();
+        Exiv2::ExifData::iterator pos =
+            exifData.findKey(Exiv2::ExifKey("Exif.Image.Orientation"));
+
+        if (pos != exifData.end())
         {
-            return 1;
+            exifData["Exif.Image.Orientation"] = uint16_t(1);
         }
 
-        cached_image->readMetadata();
+        image->writeMetadata();
+
+        return 0;
     }
     catch (EXIV_ERROR &e)
     {
         std::cerr << "Exiv2: '" << e << "'\n";
     }
 
-    return 0;
+    return 1;
 }
 
-extern "C" int
-uni_write_exiv2_from_cache(const char *uri)
+extern "C" gint64
+uni_read_exiv2_date_taken(const char *uri)
 {
-    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    // Called from several threads when sorting.
 
-    if (cached_image == nullptr)
+    uni_exiv2_init_threads();
+
+    try
+    {
+        std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(uri);
+        if (image == nullptr)
+        {
+            return 0;
+        }
+
+        image->readMetadata();
+        Exiv2::ExifData &exifData = image->exifData();
+
+        Exiv2::ExifData::const_iterator pos =
+            exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal"));
+
+        if (pos == exifData.end())
+        {
+            return 0;
+        }
+
+        int year, month, day, hour, minute, second;
+
+        if (sscanf(pos->toString().c_str(), "%d:%d:%d %d:%d:%d",
+                   &year, &month, &day, &hour, &minute, &second) != 6)
+        {
+            return 0;
+        }
+
+        GDateTime *date = g_date_time_new_local(year, month, day,
+                                                hour, minute, second);
+        if (date == nullptr)
+        {
+            return 0;
+        }
+
+        gint64 result = g_date_time_to_unix(date);
+        g_date_time_unref(date);
+
+        return result;
+    }
+    catch (EXIV_ERROR &)
     {
-        return 1;
     }
 
+    return 0;
+}
+
+extern "C" GBytes *
+uni_read_exiv2_preview(const char *uri, int min_size,
+                       int *width, int *height, int *orientation)
+{
+    // Returns the smallest JPEG preview embedded in the file whose largest
+    // side is at least min_size, with the size and Exif orientation of the
+    // image it was made from. Previews letterboxed to another aspect ratio
+    // are skipped. Called from worker threads.
+
+    uni_exiv2_init_threads();
+
+    *width = 0;
+    *height = 0;
+    *orientation = 1;
+
     try
     {
         std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(uri);
         if (image == nullptr)
         {
-            return 2;
+            return NULL;
         }
 
-        image->setMetadata(*cached_image);
-        image->writeMetadata();
+        image->readMetadata();
 
-        cached_image->clearMetadata();
-        cached_image.reset(nullptr);
+        int image_width = image->pixelWidth();
+        int image_height = image->pixelHeight();
 
-        return 0;
+        Exiv2::PreviewManager manager(*image);
+        Exiv2::PreviewPropertiesList list = manager.getPreviewProperties();
+
+        // sorted by size, smallest first
+        for (const Exiv2::PreviewProperties &props : list)
+        {
+            int preview_width = props.width_;
+            int preview_height = props.height_;
+
+            if (props.mimeType_ != "image/jpeg"
+                || std::max(preview_width, preview_height) < min_size)
+            {
+                continue;
+            }
+
+            if (image_width > 0 && image_height > 0
+                && std::abs((double) preview_width / preview_height
+                            - (double) image_width / image_height) > 0.02)
+            {
+                continue;
+            }
+
+            Exiv2::PreviewImage preview = manager.getPreviewImage(props);
+
+            if (preview.size() == 0)
+            {
+                return NULL;
+            }
+
+            Exiv2::ExifData &exifData = image->exifData();
+            Exiv2::ExifData::const_iterator pos = Exiv2::orientation(exifData);
+
+            if (pos != exifData.end())
+            {
+                sscanf(pos->toString().c_str(), "%d", orientation);
+            }
+
+            *width = image_width;
+            *height = image_height;
+
+            return g_bytes_new(preview.pData(), preview.size());
+        }
     }
-    catch (EXIV_ERROR &e)
+    catch (EXIV_ERROR &)
     {
-        std::cerr << "Exiv2: '" << e << "'\n";
     }
 
-    return 0;
+    return NULL;
 }
@@ -70,12 +70,23 @@ extern "C"
 
 #endif /* __cplusplus */
 
-    void uni_read_exiv2_map(const char *uri,
-                            void (*callback)(const char *, const char *, void *),
-                            void *user_data);
-
-    int uni_read_exiv2_to_cache(const char *uri);
-    int uni_write_exiv2_from_cache(const char *uri);
+    typedef struct _UniExiv2Metadata UniExiv2Metadata;
+
+    UniExiv2Metadata *uni_exiv2_metadata_new(const char *uri);
+    UniExiv2Metadata *uni_exiv2_metadata_new_for_data(gconstpointer data,
+                                                      gsize size);
+    UniExiv2Metadata *uni_exiv2_metadata_ref(UniExiv2Metadata *metadata);
+    void uni_exiv2_metadata_unref(UniExiv2Metadata *metadata);
+
+    void uni_exiv2_metadata_map(UniExiv2Metadata *metadata,
+                                void (*callback)(const char *, const char *, void *),
+                                void *user_data);
+    int uni_exiv2_metadata_get_orientation(UniExiv2Metadata *metadata);
+    int uni_exiv2_metadata_write(UniExiv2Metadata *metadata, const char *uri);
+
+    gint64 uni_read_exiv2_date_taken(const char *uri);
+    GBytes *uni_read_exiv2_preview(const char *uri, int min_size,
+                                   int *width, int *height, int *orientation);
 
 #ifdef __cplusplus
 
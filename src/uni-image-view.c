@@ -24,6 +24,7 @@
 #include <gdk/gdkkeysyms.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "uni-dragger.h"
 #include "uni-image-view.h"
@@ -81,12 +82,30 @@ struct _UniImageViewPrivate
      * driving the scrollable adjustment values */
     GtkScrollablePolicy hscroll_policy : 1;
     GtkScrollablePolicy vscroll_policy : 1;
+
+    /* Zooming draws with nearest neighbour until input settles,
+       refine_id is the timeout that then redraws with interp. */
+    gboolean interacting;
+    guint refine_id;
+
+    /* Whether the pixbuf has been painted since it was set. */
+    gboolean shown;
+
+    /* Copy of what was last painted on the window, scrolled in place
+       by uni_image_view_fast_scroll(). It is only complete once the
+       whole allocation has been painted into it. */
+    cairo_surface_t *frame;
+    gboolean frame_valid;
 };
 
 static guint uni_image_view_signals[LAST_SIGNAL] = {0};
 
 G_DEFINE_TYPE_WITH_CODE(UniImageView, uni_image_view, GTK_TYPE_WIDGET, G_IMPLEMENT_INTERFACE(GTK_TYPE_SCROLLABLE, NULL));
 
+/* Delay in milliseconds after the last zoom step before the view is
+   redrawn with the configured interpolation. */
+#define UNI_IMAGE_VIEW_REFINE_DELAY 150
+
 /*************************************************************/
 /***** Static stuff ******************************************/
 /*************************************************************/
@@ -169,6 +188,49 @@ uni_image_view_update_adjustments(UniImageView *view)
     g_signal_handlers_unblock_by_data(G_OBJECT(view->priv->vadjustment), view);
 }
 
+static gboolean
+uni_image_view_refine(UniImageView *view)
+{
+    view->priv->refine_id = 0;
+    view->priv->interacting = FALSE;
+
+    /* The interpolation differs from the cached frame, so the draw
+       cache rescales the whole view. */
+    if (view->interp != GDK_INTERP_NEAREST)
+        gtk_widget_queue_draw(GTK_WIDGET(view));
+    return FALSE;
+}
+
+static void
+uni_image_view_stop_interaction(UniImageView *view)
+{
+    if (view->priv->refine_id)
+    {
+        g_source_remove(view->priv->refine_id);
+        view->priv->refine_id = 0;
+    }
+    view->priv->interacting = FALSE;
+}
+
+/**
+ * uni_image_view_begin_interaction:
+ *
+ * Makes the following frames draw with nearest neighbour sampling,
+ * which is much cheaper than filtering while the zoom keeps
+ * changing. Each call pushes back the final, filtered, redraw.
+ **/
+static void
+uni_image_view_begin_interaction(UniImageView *view)
+{
+    if (view->priv->refine_id)
+        g_source_remove(view->priv->refine_id);
+
+    view->priv->interacting = TRUE;
+    view->priv->refine_id =
+        g_timeout_add(UNI_IMAGE_VIEW_REFINE_DELAY,
+                      (GSourceFunc) uni_image_view_refine, view);
+}
+
 /**
  * This method must only be used by uni_image_view_zoom_to_fit () and
  * uni_image_view_set_zoom ().
@@ -199,6 +261,12 @@ uni_image_view_set_zoom_with_center(UniImageView *view,
     view->offset_x = offset_x;
     view->offset_y = offset_y;
 
+    /* A pixbuf that was just set is drawn filtered right away, later
+       zoom changes, including fitting to a resized window, are
+       interactive. */
+    if (zoom_ratio != 1.0 && view->priv->shown)
+        uni_image_view_begin_interaction(view);
+
     if (!is_allocating && zoom_ratio != 1.0)
     {
         view->fitting = UNI_FITTING_NONE;
@@ -323,60 +391,115 @@ uni_image_view_repaint_area(UniImageView *view, GdkRectangle *paint_rect, cairo_
             (GdkRectangle){src_x, src_y,
                            paint_area.width, paint_area.height},
             paint_area.x, paint_area.y,
-            view->interp,
+            view->priv->interacting ? GDK_INTERP_NEAREST : view->interp,
             view->pixbuf};
         uni_dragger_paint_image(UNI_DRAGGER(view->tool), &opts,
                                 cr);
+        view->priv->shown = TRUE;
     }
 
     view->is_rendering = FALSE;
     return TRUE;
 }
 
+static void
+uni_image_view_free_frame(UniImageView *view)
+{
+    if (view->priv->frame)
+    {
+        cairo_surface_destroy(view->priv->frame);
+        view->priv->frame = NULL;
+    }
+    view->priv->frame_valid = FALSE;
+}
+
 /**
- * uni_image_view_fast_scroll:
+ * uni_image_view_get_frame:
+ *
+ * Returns the retained frame, recreated if the allocation changed
+ * size. A new frame is not valid until it has been fully painted.
+ **/
+static cairo_surface_t *
+uni_image_view_get_frame(UniImageView *view)
+{
+    Size alloc = uni_image_view_get_allocated_size(view);
+    cairo_surface_t *frame = view->priv->frame;
+
+    if (frame &&
+        cairo_image_surface_get_width(frame) == MAX(alloc.width, 1) &&
+        cairo_image_surface_get_height(frame) == MAX(alloc.height, 1))
+        return frame;
+
+    uni_image_view_free_frame(view);
+    view->priv->frame = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                   MAX(alloc.width, 1),
+                                                   MAX(alloc.height, 1));
+    return view->priv->frame;
+}
+
+/**
+ * uni_image_view_shift_frame:
  *
- * Actually scroll the views window using gdk_draw_drawable().
- * GTK_WIDGET (view)->window is guaranteed to be non-NULL in this
- * function.
+ * Moves the contents of the frame by -@delta_x, -@delta_y pixels
+ * without any temporary copy. Rows are walked away from the
+ * direction of the move so that none is overwritten before it has
+ * been copied.
  **/
 static void
-uni_image_view_fast_scroll(UniImageView *view, int delta_x, int delta_y)
+uni_image_view_shift_frame(UniImageView *view, int delta_x, int delta_y)
 {
-    int src_x, src_y;
-    int dest_x, dest_y;
-    if (delta_x < 0)
-    {
-        src_x = 0;
-        dest_x = -delta_x;
-    }
-    else
-    {
-        src_x = delta_x;
-        dest_x = 0;
-    }
-    if (delta_y < 0)
-    {
-        src_y = 0;
-        dest_y = -delta_y;
-    }
-    else
+    cairo_surface_t *frame = view->priv->frame;
+    int width = cairo_image_surface_get_width(frame);
+    int height = cairo_image_surface_get_height(frame);
+    int stride = cairo_image_surface_get_stride(frame);
+    int bpp = 4;
+    int y;
+
+    cairo_surface_flush(frame);
+    guchar *data = cairo_image_surface_get_data(frame);
+
+    int src_x = MAX(delta_x, 0);
+    int dst_x = MAX(-delta_x, 0);
+    int linelen = (width - abs(delta_x)) * bpp;
+    int lines = height - abs(delta_y);
+
+    for (y = 0; y < lines; y++)
     {
-        src_y = delta_y;
-        dest_y = 0;
+        int row = (delta_y >= 0) ? y : lines - 1 - y;
+        guchar *src = data + (row + MAX(delta_y, 0)) * stride + src_x * bpp;
+        guchar *dst = data + (row + MAX(-delta_y, 0)) * stride + dst_x * bpp;
+        memmove(dst, src, linelen);
     }
 
+    cairo_surface_mark_dirty(frame);
+}
+
+/**
+ * uni_image_view_fast_scroll:
+ *
+ * Scrolls the retained frame in place, paints the strips that became
+ * visible into it and puts it on the window. Nothing is read back
+ * from the window. GTK_WIDGET (view)->window is guaranteed to be
+ * non-NULL in this function.
+ **/
+static void
+uni_image_view_fast_scroll(UniImageView *view, int delta_x, int delta_y)
+{
     Size alloc = uni_image_view_get_allocated_size(view);
     GdkWindow *window = gtk_widget_get_window(GTK_WIDGET(view));
 
-    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-    cairo_t *cr = gdk_cairo_create(window);
-    G_GNUC_END_IGNORE_DEPRECATIONS
+    /* Without a complete frame, or when nothing of it stays visible,
+       there is nothing to scroll. */
+    uni_image_view_get_frame(view);
+    if (!view->priv->frame_valid ||
+        abs(delta_x) >= alloc.width || abs(delta_y) >= alloc.height)
+    {
+        gdk_window_invalidate_rect(window, NULL, TRUE);
+        return;
+    }
 
-    GdkPixbuf *win = gdk_pixbuf_get_from_window(window, src_x, src_y, alloc.width - abs(delta_x), alloc.height - abs(delta_y));
-    gdk_cairo_set_source_pixbuf(cr, win, dest_x, dest_y);
-    cairo_paint(cr);
-    g_object_unref(win);
+    uni_image_view_shift_frame(view, delta_x, delta_y);
+    cairo_t *cr = cairo_create(view->priv->frame);
 
     /* If we moved in both the x and y directions, two "strips" of the
        image becomes visible. One horizontal strip and one vertical
@@ -395,6 +518,14 @@ uni_image_view_fast_scroll(UniImageView *view, int delta_x, int delta_y)
         alloc.height};
     uni_image_view_repaint_area(view, &vert_strip, cr);
     cairo_destroy(cr);
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    cr = gdk_cairo_create(window);
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    cairo_set_source_surface(cr, view->priv->frame, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
 }
 
 /**
@@ -537,6 +668,8 @@ uni_image_view_unrealize(GtkWidget *widget)
     gdk_cursor_unref(view->void_cursor);
     G_GNUC_END_IGNORE_DEPRECATIONS
 
+    uni_image_view_free_frame(view);
+
     GTK_WIDGET_CLASS(uni_image_view_parent_class)->unrealize(widget);
 }
 
@@ -576,7 +709,36 @@ uni_image_view_expose(GtkWidget *widget, cairo_t *cr)
     gtk_widget_get_allocation(GTK_WIDGET(VNR_WINDOW(gtk_widget_get_toplevel(widget))->scroll_view), &allocation);
     allocation.x = 0;
     allocation.y = 0;
-    return uni_image_view_repaint_area(UNI_IMAGE_VIEW(widget), &allocation, cr);
+
+    /* Only scale the damaged part, the rest of the window is still
+       valid. */
+    GdkRectangle clip;
+    if (gdk_cairo_get_clip_rectangle(cr, &clip) &&
+        !gdk_rectangle_intersect(&allocation, &clip, &allocation))
+        return FALSE;
+
+    /* Paint into the retained frame first, then put the frame on the
+       window. */
+    UniImageView *view = UNI_IMAGE_VIEW(widget);
+    Size alloc = uni_image_view_get_allocated_size(view);
+    cairo_surface_t *frame = uni_image_view_get_frame(view);
+    cairo_t *frame_cr = cairo_create(frame);
+    gdk_cairo_rectangle(frame_cr, &allocation);
+    cairo_clip(frame_cr);
+    int ret = uni_image_view_repaint_area(view, &allocation, frame_cr);
+    cairo_destroy(frame_cr);
+    if (!ret)
+        return FALSE;
+
+    if (allocation.x <= 0 && allocation.y <= 0 &&
+        allocation.x + allocation.width >= alloc.width &&
+        allocation.y + allocation.height >= alloc.height)
+        view->priv->frame_valid = TRUE;
+
+    cairo_set_source_surface(cr, frame, 0, 0);
+    gdk_cairo_rectangle(cr, &allocation);
+    cairo_fill(cr);
+    return ret;
 }
 
 static int uni_image_view_button_press(GtkWidget *widget, GdkEventButton *ev)
@@ -841,6 +1003,11 @@ uni_image_view_init(UniImageView *view)
     view->priv = (UniImageViewPrivate *)g_type_instance_get_private((GTypeInstance *)view, UNI_TYPE_IMAGE_VIEW);
 
     view->priv->hadjustment = view->priv->vadjustment = NULL;
+    view->priv->interacting = FALSE;
+    view->priv->refine_id = 0;
+    view->priv->shown = FALSE;
+    view->priv->frame = NULL;
+    view->priv->frame_valid = FALSE;
     uni_image_view_set_scroll_adjustments(view, GTK_ADJUSTMENT(gtk_adjustment_new(0.0, 1.0, 0.0, 1.0, 1.0, 1.0)), GTK_ADJUSTMENT(gtk_adjustment_new(0.0, 1.0, 0.0, 1.0, 1.0, 1.0)));
     g_object_ref_sink(view->priv->hadjustment);
     g_object_ref_sink(view->priv->vadjustment);
@@ -850,6 +1017,8 @@ static void
 uni_image_view_finalize(GObject *object)
 {
     UniImageView *view = UNI_IMAGE_VIEW(object);
+    uni_image_view_stop_interaction(view);
+    uni_image_view_free_frame(view);
     if (view->priv->hadjustment)
     {
         g_signal_handlers_disconnect_by_data(G_OBJECT(view->priv->hadjustment), view);
@@ -1330,6 +1499,9 @@ void uni_image_view_set_pixbuf(UniImageView *view,
         view->pixbuf = pixbuf;
         if (view->pixbuf)
             g_object_ref(pixbuf);
+
+        uni_image_view_stop_interaction(view);
+        view->priv->shown = FALSE;
     }
 
     if (reset_fit)
@@ -1353,6 +1525,55 @@ void uni_image_view_set_pixbuf(UniImageView *view,
     uni_dragger_pixbuf_changed(UNI_DRAGGER(view->tool), reset_fit, NULL);
 }
 
+/**
+ * uni_image_view_damage_pixels:
+ * @view: A #UniImageView.
+ * @rect: The area of the pixbuf, in image space coordinates, whose
+ *   contents have changed or %NULL for the whole pixbuf.
+ *
+ * Tells the view that the pixels of its pixbuf inside @rect have
+ * been modified, for example by an incremental loader. Only the part
+ * of the widget showing @rect is redrawn, neither the zoom nor the
+ * offset is changed.
+ **/
+void uni_image_view_damage_pixels(UniImageView *view, GdkRectangle *rect)
+{
+    g_return_if_fail(UNI_IS_IMAGE_VIEW(view));
+
+    uni_dragger_pixbuf_changed(UNI_DRAGGER(view->tool), FALSE, rect);
+
+    GdkRectangle image_area;
+    if (!gtk_widget_get_realized(GTK_WIDGET(view)) ||
+        !uni_image_view_get_draw_rect(view, &image_area))
+        return;
+
+    if (!rect)
+    {
+        gtk_widget_queue_draw_area(GTK_WIDGET(view),
+                                   image_area.x, image_area.y,
+                                   image_area.width, image_area.height);
+        return;
+    }
+
+    /* Convert to widget space, rounding outwards so that partially
+       covered pixels are repainted too. */
+    int x1 = (int)floor(rect->x * view->zoom - view->offset_x);
+    int y1 = (int)floor(rect->y * view->zoom - view->offset_y);
+    int x2 = (int)ceil((rect->x + rect->width) * view->zoom - view->offset_x);
+    int y2 = (int)ceil((rect->y + rect->height) * view->zoom - view->offset_y);
+
+    GdkRectangle damage = {
+        image_area.x + x1 - 1,
+        image_area.y + y1 - 1,
+        x2 - x1 + 2,
+        y2 - y1 + 2};
+
+    if (gdk_rectangle_intersect(&image_area, &damage, &damage))
+        gtk_widget_queue_draw_area(GTK_WIDGET(view),
+                                   damage.x, damage.y,
+                                   damage.width, damage.height);
+}
+
 /**
  * uni_image_view_set_zoom:
  * @view: a #UniImageView
@@ -0,0 +1,460 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uni-pyramid.h"
+#include <math.h>
+
+#define UNI_PYRAMID_MAX_LEVELS 16
+
+/* Reduced tiles always kept, 16 MiB of RGBA. The limit grows to
+   twice the tiles of the largest area drawn so far, so that a
+   redraw finds those of the last one. */
+#define UNI_PYRAMID_MIN_TILES 64
+
+typedef struct
+{
+    /* TILE_SIZE wide rows, NULL until the tile has been reduced from
+       the level below. */
+    guchar *pixels;
+    /* Set while the tile above is being reduced from this one, or
+       while an area holding it is drawn. */
+    int busy;
+    /* Node in the pyramid's LRU queue, data is the tile. */
+    GList link;
+} UniPyramidTile;
+
+typedef struct
+{
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    /* Unused for level 0 which is the source pixbuf. */
+    UniPyramidTile *tiles;
+} UniPyramidLevel;
+
+/**
+ * UniPyramid:
+ *
+ * Multi-resolution copy of a pixbuf. Level 0 is the pixbuf
+ * itself, each following level halves its size until it fits in a
+ * single tile. Reduced levels are stored as separate tiles, filled
+ * lazily, so that only the parts of the image that are actually
+ * shown are ever computed. Least recently drawn tiles are dropped
+ * beyond @max_tiles, a zoomed out view of a huge image does not keep
+ * whole levels around.
+ *
+ * Drawing a zoomed out view then samples from the level nearest to
+ * the zoom instead of from the full resolution pixbuf, which keeps
+ * the cost of a redraw proportional to the size of the view.
+ **/
+struct _UniPyramid
+{
+    GdkPixbuf *source;
+    int chans;
+    UniPyramidLevel levels[UNI_PYRAMID_MAX_LEVELS];
+    int n_levels;
+    /* Tiles holding pixels, most recently used first. */
+    GQueue lru;
+    int max_tiles;
+};
+
+/**
+ * uni_pyramid_reduce:
+ * @src: top left pixel of the area to reduce
+ * @src_width: width of that area, odd edges repeat their last column
+ * @src_height: height of that area, odd edges repeat their last row
+ * @dst: top left pixel of the area to fill
+ *
+ * Averages each 2x2 block of @src into one pixel of @dst. Colors are
+ * weighted by their alpha so that transparent pixels do not bleed
+ * into their neighbours.
+ **/
+static void
+uni_pyramid_reduce(const guchar *src, int src_stride,
+                   int src_width, int src_height,
+                   guchar *dst, int dst_stride,
+                   int chans)
+{
+    int dst_width = (src_width + 1) / 2;
+    int dst_height = (src_height + 1) / 2;
+    gboolean alpha = (chans == 4);
+    int x, y, c;
+
+    for (y = 0; y < dst_height; y++)
+    {
+        const guchar *row0 = src + (2 * y) * src_stride;
+        const guchar *row1 = src + MIN(2 * y + 1, src_height - 1) * src_stride;
+        guchar *d = dst + y * dst_stride;
+
+        for (x = 0; x < dst_width; x++, d += chans)
+        {
+            int x0 = 2 * x * chans;
+            int x1 = MIN(2 * x + 1, src_width - 1) * chans;
+            const guchar *p[4] = {row0 + x0, row0 + x1, row1 + x0, row1 + x1};
+
+            if (!alpha)
+            {
+                for (c = 0; c < 3; c++)
+                    d[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) >> 2;
+                continue;
+            }
+
+            int a = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+            d[3] = (a + 2) >> 2;
+
+            for (c = 0; c < 3; c++)
+            {
+                if (a == 0)
+                {
+                    d[c] = 0;
+                    continue;
+                }
+                int sum = p[0][c] * p[0][3] + p[1][c] * p[1][3] +
+                          p[2][c] * p[2][3] + p[3][c] * p[3][3];
+                d[c] = (sum + a / 2) / a;
+            }
+        }
+    }
+}
+
+static void
+uni_pyramid_drop_tile(UniPyramid *pyramid, UniPyramidTile *tile)
+{
+    if (!tile->pixels)
+        return;
+
+    g_queue_unlink(&pyramid->lru, &tile->link);
+    g_free(tile->pixels);
+    tile->pixels = NULL;
+}
+
+/* Drops the least recently used tiles beyond the limit, except those
+   still needed for a reduction. */
+static void
+uni_pyramid_evict(UniPyramid *pyramid)
+{
+    GList *link = pyramid->lru.tail;
+
+    while (link && pyramid->lru.length > (guint) pyramid->max_tiles)
+    {
+        GList *prev = link->prev;
+        UniPyramidTile *tile = link->data;
+
+        if (!tile->busy)
+            uni_pyramid_drop_tile(pyramid, tile);
+        link = prev;
+    }
+}
+
+/**
+ * uni_pyramid_ensure_tile:
+ *
+ * Reduces a tile from the 2x2 tiles of the level below covering it,
+ * or from the source for level 1, unless it is still there. Each
+ * quarter of the tile comes from exactly one tile below.
+ **/
+static UniPyramidTile *
+uni_pyramid_ensure_tile(UniPyramid *pyramid, int level, int tx, int ty)
+{
+    UniPyramidLevel *lv = &pyramid->levels[level];
+    UniPyramidLevel *below = &pyramid->levels[level - 1];
+    UniPyramidTile *tile = &lv->tiles[ty * lv->tiles_x + tx];
+    int chans = pyramid->chans;
+    int half = UNI_PYRAMID_TILE_SIZE / 2;
+    int dst_stride = UNI_PYRAMID_TILE_SIZE * chans;
+    int i, j;
+
+    if (tile->pixels)
+    {
+        g_queue_unlink(&pyramid->lru, &tile->link);
+        g_queue_push_head_link(&pyramid->lru, &tile->link);
+        return tile;
+    }
+
+    int width = MIN(UNI_PYRAMID_TILE_SIZE,
+                    lv->width - tx * UNI_PYRAMID_TILE_SIZE);
+    int height = MIN(UNI_PYRAMID_TILE_SIZE,
+                     lv->height - ty * UNI_PYRAMID_TILE_SIZE);
+    UniPyramidTile *children[4] = {NULL, NULL, NULL, NULL};
+
+    if (level > 1)
+    {
+        for (j = 0; j < 2 && half * j < height; j++)
+            for (i = 0; i < 2 && half * i < width; i++)
+            {
+                children[j * 2 + i] =
+                    uni_pyramid_ensure_tile(pyramid, level - 1,
+                                            2 * tx + i, 2 * ty + j);
+                children[j * 2 + i]->busy++;
+            }
+    }
+
+    tile->pixels = g_malloc(height * dst_stride);
+
+    for (j = 0; j < 2 && half * j < height; j++)
+        for (i = 0; i < 2 && half * i < width; i++)
+        {
+            /* The area of the level below the quarter comes from. */
+            int src_x = (2 * tx + i) * UNI_PYRAMID_TILE_SIZE;
+            int src_y = (2 * ty + j) * UNI_PYRAMID_TILE_SIZE;
+            int src_width = MIN(UNI_PYRAMID_TILE_SIZE, below->width - src_x);
+            int src_height = MIN(UNI_PYRAMID_TILE_SIZE, below->height - src_y);
+            const guchar *src;
+            int src_stride;
+
+            if (level > 1)
+            {
+                src = children[j * 2 + i]->pixels;
+                src_stride = UNI_PYRAMID_TILE_SIZE * chans;
+            }
+            else
+            {
+                src_stride = gdk_pixbuf_get_rowstride(pyramid->source);
+                src = gdk_pixbuf_get_pixels(pyramid->source)
+                      + src_y * src_stride + src_x * chans;
+            }
+
+            uni_pyramid_reduce(src, src_stride, src_width, src_height,
+                               tile->pixels + half * j * dst_stride
+                               + half * i * chans,
+                               dst_stride, chans);
+        }
+
+    for (i = 0; i < 4; i++)
+        if (children[i])
+            children[i]->busy--;
+
+    tile->link.data = tile;
+    g_queue_push_head_link(&pyramid->lru, &tile->link);
+
+    tile->busy++;
+    uni_pyramid_evict(pyramid);
+    tile->busy--;
+
+    return tile;
+}
+
+/**
+ * uni_pyramid_new:
+ * @pixbuf: the full resolution pixbuf, must be 8 bits RGB or RGBA
+ * @returns: a new #UniPyramid
+ *
+ * Creates a pyramid for @pixbuf. No pixels are computed until an area
+ * is asked for with uni_pyramid_get_area().
+ **/
+UniPyramid *
+uni_pyramid_new(GdkPixbuf *pixbuf)
+{
+    g_return_val_if_fail(GDK_IS_PIXBUF(pixbuf), NULL);
+    g_return_val_if_fail(gdk_pixbuf_get_bits_per_sample(pixbuf) == 8, NULL);
+
+    UniPyramid *pyramid = g_new0(UniPyramid, 1);
+
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+
+    pyramid->source = g_object_ref(pixbuf);
+    pyramid->chans = gdk_pixbuf_get_n_channels(pixbuf);
+    pyramid->levels[0].width = width;
+    pyramid->levels[0].height = height;
+    pyramid->n_levels = 1;
+    g_queue_init(&pyramid->lru);
+    pyramid->max_tiles = UNI_PYRAMID_MIN_TILES;
+
+    while (MAX(width, height) > UNI_PYRAMID_TILE_SIZE &&
+           pyramid->n_levels < UNI_PYRAMID_MAX_LEVELS)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+
+        UniPyramidLevel *lv = &pyramid->levels[pyramid->n_levels++];
+        lv->width = width;
+        lv->height = height;
+        lv->tiles_x = (width + UNI_PYRAMID_TILE_SIZE - 1) / UNI_PYRAMID_TILE_SIZE;
+        lv->tiles_y = (height + UNI_PYRAMID_TILE_SIZE - 1) / UNI_PYRAMID_TILE_SIZE;
+        lv->tiles = g_new0(UniPyramidTile, lv->tiles_x * lv->tiles_y);
+    }
+
+    return pyramid;
+}
+
+/**
+ * uni_pyramid_free:
+ * @pyramid: a #UniPyramid
+ *
+ * Deallocates the pyramid and all its tiles.
+ **/
+void uni_pyramid_free(UniPyramid *pyramid)
+{
+    int n, t;
+
+    if (!pyramid)
+        return;
+
+    for (n = 1; n < pyramid->n_levels; n++)
+    {
+        UniPyramidLevel *lv = &pyramid->levels[n];
+
+        for (t = 0; t < lv->tiles_x * lv->tiles_y; t++)
+            g_free(lv->tiles[t].pixels);
+        g_free(lv->tiles);
+    }
+    g_object_unref(pyramid->source);
+    g_free(pyramid);
+}
+
+GdkPixbuf *
+uni_pyramid_get_source(UniPyramid *pyramid)
+{
+    return pyramid->source;
+}
+
+/**
+ * uni_pyramid_get_level_for_zoom:
+ * @zoom: the zoom the image is drawn at
+ * @returns: the smallest level that still has at least one pixel per
+ *   pixel drawn, 0 when zooming in.
+ **/
+int uni_pyramid_get_level_for_zoom(UniPyramid *pyramid, gdouble zoom)
+{
+    if (zoom >= 1.0)
+        return 0;
+
+    int level = (int)floor(log2(1.0 / zoom));
+    return CLAMP(level, 0, pyramid->n_levels - 1);
+}
+
+/**
+ * uni_pyramid_get_area:
+ * @level: the level to get, each level halves the size of the
+ *   previous one, must not be 0
+ * @area: the area of the level, in its own coordinates, to get.
+ *   Clipped to the level on return.
+ * @returns: the tiles holding @area of @level, to give back with
+ *   uni_pyramid_release_area()
+ *
+ * Computes the tiles of @level covering @area if needed. They are
+ * read in place and kept until released, several threads may scale
+ * from them at once.
+ **/
+UniScaleTiles *
+uni_pyramid_get_area(UniPyramid *pyramid, int level, GdkRectangle *area)
+{
+    g_return_val_if_fail(level > 0 && level < pyramid->n_levels, NULL);
+
+    UniPyramidLevel *lv = &pyramid->levels[level];
+    GdkRectangle bounds = {0, 0, lv->width, lv->height};
+    GdkRectangle rect;
+
+    if (!gdk_rectangle_intersect(&bounds, area, &rect))
+        rect = (GdkRectangle){0, 0, 1, 1};
+    *area = rect;
+
+    int tx, ty;
+    int tx0 = rect.x / UNI_PYRAMID_TILE_SIZE;
+    int ty0 = rect.y / UNI_PYRAMID_TILE_SIZE;
+    int tiles_x = (rect.x + rect.width - 1) / UNI_PYRAMID_TILE_SIZE - tx0 + 1;
+    int tiles_y = (rect.y + rect.height - 1) / UNI_PYRAMID_TILE_SIZE - ty0 + 1;
+
+    pyramid->max_tiles = MAX(pyramid->max_tiles, 2 * tiles_x * tiles_y);
+
+    UniScaleTiles *tiles = g_new(UniScaleTiles, 1);
+    *tiles = (UniScaleTiles){
+        rect.x, rect.y, rect.width, rect.height,
+        pyramid->chans,
+        UNI_PYRAMID_TILE_SIZE, UNI_PYRAMID_TILE_SIZE,
+        UNI_PYRAMID_TILE_SIZE * pyramid->chans,
+        tiles_x, g_new(const guint8 *, tiles_x * tiles_y)};
+
+    for (ty = 0; ty < tiles_y; ty++)
+        for (tx = 0; tx < tiles_x; tx++)
+        {
+            UniPyramidTile *tile =
+                uni_pyramid_ensure_tile(pyramid, level, tx0 + tx, ty0 + ty);
+            tile->busy++;
+            tiles->tiles[ty * tiles_x + tx] = tile->pixels;
+        }
+
+    return tiles;
+}
+
+/**
+ * uni_pyramid_release_area:
+ * @level: the level @tiles was got from
+ * @tiles: the tiles returned by uni_pyramid_get_area()
+ *
+ * Lets the tiles of the area be dropped again and frees @tiles.
+ **/
+void uni_pyramid_release_area(UniPyramid *pyramid, int level,
+                              UniScaleTiles *tiles)
+{
+    UniPyramidLevel *lv = &pyramid->levels[level];
+    int tx0 = tiles->x / UNI_PYRAMID_TILE_SIZE;
+    int ty0 = tiles->y / UNI_PYRAMID_TILE_SIZE;
+    int tx, ty;
+
+    for (ty = ty0; ty * UNI_PYRAMID_TILE_SIZE < tiles->y + tiles->height; ty++)
+        for (tx = tx0; tx * UNI_PYRAMID_TILE_SIZE < tiles->x + tiles->width;
+             tx++)
+            lv->tiles[ty * lv->tiles_x + tx].busy--;
+
+    uni_pyramid_evict(pyramid);
+    g_free(tiles->tiles);
+    g_free(tiles);
+}
+
+/**
+ * uni_pyramid_damage:
+ * @rect: the area of the source pixbuf that has changed, or %NULL if
+ *   all of it has.
+ *
+ * Drops the tiles computed from @rect, they are reduced again the
+ * next time they are needed.
+ **/
+void uni_pyramid_damage(UniPyramid *pyramid, GdkRectangle *rect)
+{
+    int n, tx, ty;
+
+    for (n = 1; n < pyramid->n_levels; n++)
+    {
+        UniPyramidLevel *lv = &pyramid->levels[n];
+
+        int x0 = 0, y0 = 0;
+        int x1 = lv->tiles_x - 1, y1 = lv->tiles_y - 1;
+
+        if (rect)
+        {
+            x0 = (rect->x >> n) / UNI_PYRAMID_TILE_SIZE;
+            y0 = (rect->y >> n) / UNI_PYRAMID_TILE_SIZE;
+            x1 = ((rect->x + rect->width - 1) >> n) / UNI_PYRAMID_TILE_SIZE;
+            y1 = ((rect->y + rect->height - 1) >> n) / UNI_PYRAMID_TILE_SIZE;
+
+            x0 = CLAMP(x0, 0, lv->tiles_x - 1);
+            y0 = CLAMP(y0, 0, lv->tiles_y - 1);
+            x1 = CLAMP(x1, 0, lv->tiles_x - 1);
+            y1 = CLAMP(y1, 0, lv->tiles_y - 1);
+        }
+
+        for (ty = y0; ty <= y1; ty++)
+            for (tx = x0; tx <= x1; tx++)
+                uni_pyramid_drop_tile(pyramid,
+                                      &lv->tiles[ty * lv->tiles_x + tx]);
+    }
+}
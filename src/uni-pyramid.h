@@ -0,0 +1,42 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UNI_PYRAMID_H__
+#define __UNI_PYRAMID_H__
+
+#include <gdk/gdk.h>
+#include "uni-scale.h"
+
+/* Side of the square tiles the reduced levels are computed in. */
+#define UNI_PYRAMID_TILE_SIZE 256
+
+typedef struct _UniPyramid UniPyramid;
+
+UniPyramid *uni_pyramid_new(GdkPixbuf *pixbuf);
+void uni_pyramid_free(UniPyramid *pyramid);
+
+GdkPixbuf *uni_pyramid_get_source(UniPyramid *pyramid);
+int uni_pyramid_get_level_for_zoom(UniPyramid *pyramid, gdouble zoom);
+UniScaleTiles *uni_pyramid_get_area(UniPyramid *pyramid,
+                                    int level, GdkRectangle *area);
+void uni_pyramid_release_area(UniPyramid *pyramid, int level,
+                              UniScaleTiles *tiles);
+void uni_pyramid_damage(UniPyramid *pyramid, GdkRectangle *rect);
+
+#endif /* __UNI_PYRAMID_H__ */
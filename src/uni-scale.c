@@ -0,0 +1,998 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uni-scale.h"
+#include "uni-utils.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNI_SCALE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Zooms needing more taps than this per axis are left to gdk-pixbuf. */
+#define UNI_SCALE_MAX_TAPS 64
+
+/* Rounded division of a product of two 8 bit values by 255. The
+   vector kernels use the very same expression so that every
+   implementation gives identical results. */
+#define UNI_SCALE_DIV255(t) \
+    ((((t) + 128) + (((t) + 128) >> 8)) >> 8)
+
+/**
+ * UniScaleFilter:
+ *
+ * Resampling weights along one axis. Every output pixel reads
+ * @n_taps source pixels whose weights add up to 256. Indices are
+ * clamped to the source so edges repeat their last pixel.
+ **/
+typedef struct
+{
+    int n_taps;
+    int first;
+    int last;
+    int *index;
+    guint16 *weight;
+} UniScaleFilter;
+
+/* Computes out[i] = sum(rows[k][i] * weights[k]) over @length bytes. */
+typedef void (*UniScaleVerticalFunc)(const guint8 **rows,
+                                     const guint16 *weights,
+                                     int n_rows,
+                                     guint16 *out,
+                                     int length);
+
+static UniScaleVerticalFunc uni_scale_vertical;
+static UniScaleVerticalFunc uni_scale_vertical_premul;
+
+/* Layouts the output rows can be written in. */
+typedef enum
+{
+    UNI_SCALE_OUT_RGB,
+    UNI_SCALE_OUT_RGBA,
+    /* CAIRO_FORMAT_RGB24, one native endian 0xffRRGGBB word. */
+    UNI_SCALE_OUT_CAIRO
+} UniScaleOut;
+
+/* Writes @width output pixels of one row, from a source row for
+   nearest neighbour and from the output of the vertical kernel
+   otherwise. RGBA sources are composited over the checks. */
+typedef void (*UniScaleNearestFunc)(const guint8 *src, int src_chans,
+                                    guint8 *dst, UniScaleOut out,
+                                    const UniScaleFilter *fx, int width,
+                                    const guint8 checks[2][3],
+                                    int check_x, int check_row);
+typedef void (*UniScaleHorizontalFunc)(const guint16 *row, int src_chans,
+                                       guint8 *dst, UniScaleOut out,
+                                       const UniScaleFilter *fx, int width,
+                                       const guint8 checks[2][3],
+                                       int check_x, int check_row);
+
+static UniScaleNearestFunc uni_scale_nearest;
+static UniScaleHorizontalFunc uni_scale_horizontal;
+
+/*************************************************************/
+/***** Filters ***********************************************/
+/*************************************************************/
+static gboolean
+uni_scale_filter_init(UniScaleFilter *filter,
+                      int start, int length,
+                      gdouble offset, gdouble zoom,
+                      int src_length, GdkInterpType interp)
+{
+    gdouble w[UNI_SCALE_MAX_TAPS];
+    int n, i, k;
+
+    if (interp == GDK_INTERP_NEAREST)
+        n = 1;
+    else if (zoom >= 1.0)
+        n = 2;
+    else
+        n = (int) ceil(1.0 / zoom) + 1;
+
+    if (n > UNI_SCALE_MAX_TAPS)
+        return FALSE;
+
+    filter->n_taps = n;
+    filter->first = src_length - 1;
+    filter->last = 0;
+    filter->index = g_new(int, length * n);
+    filter->weight = g_new(guint16, length * n);
+
+    for (i = 0; i < length; i++)
+    {
+        int *index = filter->index + i * n;
+        guint16 *weight = filter->weight + i * n;
+        gdouble x = start + i - offset;
+        gdouble total = 0.0, sum = 0.0;
+        int s0, prev = 0;
+
+        if (n == 1)
+        {
+            s0 = (int) floor((x + 0.5) / zoom);
+            w[0] = 1.0;
+        }
+        else if (zoom >= 1.0)
+        {
+            /* Linear interpolation between the two nearest centers. */
+            gdouble pos = (x + 0.5) / zoom - 0.5;
+            s0 = (int) floor(pos);
+            w[1] = pos - s0;
+            w[0] = 1.0 - w[1];
+        }
+        else
+        {
+            /* Box filter, each source pixel counts for the part of
+               the output pixel it covers. */
+            gdouble left = x / zoom;
+            gdouble right = (x + 1.0) / zoom;
+            s0 = (int) floor(left);
+            for (k = 0; k < n; k++)
+            {
+                gdouble cover = MIN(right, s0 + k + 1) - MAX(left, s0 + k);
+                w[k] = MAX(cover, 0.0);
+            }
+        }
+
+        for (k = 0; k < n; k++)
+            total += w[k];
+
+        /* Quantize the running sum rather than each weight so that
+           the integer weights always add up to exactly 256. */
+        for (k = 0; k < n; k++)
+        {
+            int next;
+
+            sum += w[k];
+            next = (int) floor(sum / total * 256.0 + 0.5);
+            weight[k] = next - prev;
+            prev = next;
+
+            index[k] = CLAMP(s0 + k, 0, src_length - 1);
+            filter->first = MIN(filter->first, index[k]);
+            filter->last = MAX(filter->last, index[k]);
+        }
+    }
+    return TRUE;
+}
+
+static void
+uni_scale_filter_clear(UniScaleFilter *filter)
+{
+    g_free(filter->index);
+    g_free(filter->weight);
+}
+
+/*************************************************************/
+/***** Vertical kernels **************************************/
+/*************************************************************/
+static void
+uni_scale_vertical_c(const guint8 **rows,
+                     const guint16 *weights,
+                     int n_rows, guint16 *out, int length)
+{
+    int i, k;
+
+    for (i = 0; i < length; i++)
+    {
+        unsigned int acc = 0;
+        for (k = 0; k < n_rows; k++)
+            acc += rows[k][i] * weights[k];
+        out[i] = acc;
+    }
+}
+
+/* Same as above, but the rows are RGBA and are multiplied by their
+   alpha on the fly. @length must be a multiple of four. */
+static void
+uni_scale_vertical_premul_c(const guint8 **rows,
+                            const guint16 *weights,
+                            int n_rows, guint16 *out, int length)
+{
+    int i, k;
+
+    for (i = 0; i < length; i += 4)
+    {
+        unsigned int acc[4] = {0, 0, 0, 0};
+        for (k = 0; k < n_rows; k++)
+        {
+            const guint8 *p = rows[k] + i;
+            unsigned int a = p[3];
+            acc[0] += UNI_SCALE_DIV255(p[0] * a) * weights[k];
+            acc[1] += UNI_SCALE_DIV255(p[1] * a) * weights[k];
+            acc[2] += UNI_SCALE_DIV255(p[2] * a) * weights[k];
+            acc[3] += a * weights[k];
+        }
+        out[i + 0] = acc[0];
+        out[i + 1] = acc[1];
+        out[i + 2] = acc[2];
+        out[i + 3] = acc[3];
+    }
+}
+
+#ifdef UNI_SCALE_X86
+/* The tails of the vector kernels, from @start up to @length. */
+static void
+uni_scale_vertical_tail(const guint8 **rows, const guint16 *weights,
+                        int n_rows, guint16 *out, int start, int length,
+                        gboolean premul)
+{
+    const guint8 *tail[UNI_SCALE_MAX_TAPS];
+    int k;
+
+    for (k = 0; k < n_rows; k++)
+        tail[k] = rows[k] + start;
+
+    if (premul)
+        uni_scale_vertical_premul_c(tail, weights, n_rows,
+                                    out + start, length - start);
+    else
+        uni_scale_vertical_c(tail, weights, n_rows,
+                             out + start, length - start);
+}
+
+__attribute__((target("sse2")))
+static void
+uni_scale_vertical_sse2(const guint8 **rows,
+                        const guint16 *weights,
+                        int n_rows, guint16 *out, int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i, k;
+
+    for (i = 0; i + 16 <= length; i += 16)
+    {
+        __m128i lo = zero, hi = zero;
+        for (k = 0; k < n_rows; k++)
+        {
+            __m128i px = _mm_loadu_si128((const __m128i *) (rows[k] + i));
+            __m128i wk = _mm_set1_epi16(weights[k]);
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), wk));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), wk));
+        }
+        _mm_storeu_si128((__m128i *) (out + i), lo);
+        _mm_storeu_si128((__m128i *) (out + i + 8), hi);
+    }
+    uni_scale_vertical_tail(rows, weights, n_rows, out, i, length, FALSE);
+}
+
+/* Multiplies two RGBA pixels widened to 16 bits by their alpha. */
+__attribute__((target("sse2")))
+static inline __m128i
+uni_scale_premul_sse2(__m128i px)
+{
+    const __m128i color = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i opaque = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i a, t;
+
+    a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xff), 0xff);
+    a = _mm_or_si128(_mm_and_si128(a, color), opaque);
+    t = _mm_add_epi16(_mm_mullo_epi16(px, a), half);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void
+uni_scale_vertical_premul_sse2(const guint8 **rows,
+                               const guint16 *weights,
+                               int n_rows, guint16 *out, int length)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i, k;
+
+    for (i = 0; i + 16 <= length; i += 16)
+    {
+        __m128i lo = zero, hi = zero;
+        for (k = 0; k < n_rows; k++)
+        {
+            __m128i px = _mm_loadu_si128((const __m128i *) (rows[k] + i));
+            __m128i wk = _mm_set1_epi16(weights[k]);
+            __m128i pl = uni_scale_premul_sse2(_mm_unpacklo_epi8(px, zero));
+            __m128i ph = uni_scale_premul_sse2(_mm_unpackhi_epi8(px, zero));
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(pl, wk));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(ph, wk));
+        }
+        _mm_storeu_si128((__m128i *) (out + i), lo);
+        _mm_storeu_si128((__m128i *) (out + i + 8), hi);
+    }
+    uni_scale_vertical_tail(rows, weights, n_rows, out, i, length, TRUE);
+}
+
+__attribute__((target("avx2")))
+static void
+uni_scale_vertical_avx2(const guint8 **rows,
+                        const guint16 *weights,
+                        int n_rows, guint16 *out, int length)
+{
+    int i, k;
+
+    for (i = 0; i + 32 <= length; i += 32)
+    {
+        __m256i lo = _mm256_setzero_si256(), hi = lo;
+        for (k = 0; k < n_rows; k++)
+        {
+            const __m128i *p = (const __m128i *) (rows[k] + i);
+            __m256i wk = _mm256_set1_epi16(weights[k]);
+            __m256i pl = _mm256_cvtepu8_epi16(_mm_loadu_si128(p));
+            __m256i ph = _mm256_cvtepu8_epi16(_mm_loadu_si128(p + 1));
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(pl, wk));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(ph, wk));
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), lo);
+        _mm256_storeu_si256((__m256i *) (out + i + 16), hi);
+    }
+    uni_scale_vertical_tail(rows, weights, n_rows, out, i, length, FALSE);
+}
+
+/* Multiplies four RGBA pixels widened to 16 bits by their alpha. */
+__attribute__((target("avx2")))
+static inline __m256i
+uni_scale_premul_avx2(__m256i px)
+{
+    const __m256i color = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+                                           0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i opaque = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0,
+                                            255, 0, 0, 0, 255, 0, 0, 0);
+    const __m256i half = _mm256_set1_epi16(128);
+    __m256i a, t;
+
+    a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xff), 0xff);
+    a = _mm256_or_si256(_mm256_and_si256(a, color), opaque);
+    t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), half);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void
+uni_scale_vertical_premul_avx2(const guint8 **rows,
+                               const guint16 *weights,
+                               int n_rows, guint16 *out, int length)
+{
+    int i, k;
+
+    for (i = 0; i + 32 <= length; i += 32)
+    {
+        __m256i lo = _mm256_setzero_si256(), hi = lo;
+        for (k = 0; k < n_rows; k++)
+        {
+            const __m128i *p = (const __m128i *) (rows[k] + i);
+            __m256i wk = _mm256_set1_epi16(weights[k]);
+            __m256i pl = _mm256_cvtepu8_epi16(_mm_loadu_si128(p));
+            __m256i ph = _mm256_cvtepu8_epi16(_mm_loadu_si128(p + 1));
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(uni_scale_premul_avx2(pl), wk));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(uni_scale_premul_avx2(ph), wk));
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), lo);
+        _mm256_storeu_si256((__m256i *) (out + i + 16), hi);
+    }
+    uni_scale_vertical_tail(rows, weights, n_rows, out, i, length, TRUE);
+}
+#endif
+
+/*************************************************************/
+/***** Rows **************************************************/
+/*************************************************************/
+static const int uni_scale_out_bpp[] = {3, 4, 4};
+
+static inline void
+uni_scale_put(guint8 *dst, UniScaleOut out,
+              unsigned int r, unsigned int g, unsigned int b)
+{
+    switch (out)
+    {
+    case UNI_SCALE_OUT_CAIRO:
+        *(guint32 *) dst = 0xff000000 | (r << 16) | (g << 8) | b;
+        break;
+    case UNI_SCALE_OUT_RGBA:
+        dst[3] = 255;
+        /* Fall through */
+    default:
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+    }
+}
+
+static inline guint8
+uni_scale_over(unsigned int color, unsigned int alpha, unsigned int check)
+{
+    return UNI_SCALE_DIV255(color * alpha + check * (255 - alpha));
+}
+
+static inline const guint8 *
+uni_scale_check(const guint8 checks[2][3], int x, int check_x, int check_row)
+{
+    return checks[(((x + check_x) / CHECK_SIZE) + check_row) & 1];
+}
+
+/* Output pixel @x by nearest neighbour, a plain copy or a composite
+   over the checks. */
+static inline void
+uni_scale_nearest_pixel(const guint8 *src, int src_chans,
+                        guint8 *dst, UniScaleOut out,
+                        const UniScaleFilter *fx, int x,
+                        const guint8 checks[2][3], int check_x, int check_row)
+{
+    const guint8 *p = src + fx->index[x] * src_chans;
+
+    if (src_chans == 4)
+    {
+        const guint8 *check = uni_scale_check(checks, x, check_x, check_row);
+        uni_scale_put(dst, out,
+                      uni_scale_over(p[0], p[3], check[0]),
+                      uni_scale_over(p[1], p[3], check[1]),
+                      uni_scale_over(p[2], p[3], check[2]));
+    }
+    else
+        uni_scale_put(dst, out, p[0], p[1], p[2]);
+}
+
+/* Output pixel @x of the horizontal pass over the output of the
+   vertical kernel. A premultiplied row is composited over the checks
+   as it goes. */
+static inline void
+uni_scale_filter_pixel(const guint16 *row, int src_chans,
+                       guint8 *dst, UniScaleOut out,
+                       const UniScaleFilter *fx, int x,
+                       const guint8 checks[2][3], int check_x, int check_row)
+{
+    int n = fx->n_taps;
+    const int *index = fx->index + x * n;
+    const guint16 *weight = fx->weight + x * n;
+    unsigned int acc[4] = {32768, 32768, 32768, 32768};
+    unsigned int v[3];
+    int k, c;
+
+    for (k = 0; k < n; k++)
+    {
+        const guint16 *p = row + (index[k] - fx->first) * src_chans;
+        for (c = 0; c < src_chans; c++)
+            acc[c] += p[c] * weight[k];
+    }
+
+    if (src_chans == 4)
+    {
+        const guint8 *check = uni_scale_check(checks, x, check_x, check_row);
+        unsigned int alpha = acc[3] >> 16;
+        for (c = 0; c < 3; c++)
+        {
+            v[c] = (acc[c] >> 16) + UNI_SCALE_DIV255(check[c] * (255 - alpha));
+            v[c] = MIN(v[c], 255);
+        }
+    }
+    else
+    {
+        for (c = 0; c < 3; c++)
+            v[c] = acc[c] >> 16;
+    }
+    uni_scale_put(dst, out, v[0], v[1], v[2]);
+}
+
+static void
+uni_scale_nearest_c(const guint8 *src, int src_chans,
+                    guint8 *dst, UniScaleOut out,
+                    const UniScaleFilter *fx, int width,
+                    const guint8 checks[2][3], int check_x, int check_row)
+{
+    int bpp = uni_scale_out_bpp[out];
+    int x;
+
+    for (x = 0; x < width; x++, dst += bpp)
+        uni_scale_nearest_pixel(src, src_chans, dst, out, fx, x,
+                                checks, check_x, check_row);
+}
+
+static void
+uni_scale_horizontal_c(const guint16 *row, int src_chans,
+                       guint8 *dst, UniScaleOut out,
+                       const UniScaleFilter *fx, int width,
+                       const guint8 checks[2][3], int check_x, int check_row)
+{
+    int bpp = uni_scale_out_bpp[out];
+    int x;
+
+    for (x = 0; x < width; x++, dst += bpp)
+        uni_scale_filter_pixel(row, src_chans, dst, out, fx, x,
+                               checks, check_x, check_row);
+}
+
+#ifdef UNI_SCALE_X86
+/* Writes @count pixels held as 16 bit R, G, B, X channels, the first
+   two in @lo and the next two in @hi. */
+__attribute__((target("sse2")))
+static inline void
+uni_scale_store_sse2(guint8 *dst, UniScaleOut out,
+                     __m128i lo, __m128i hi, int count)
+{
+    const __m128i opaque = _mm_set1_epi32(0xff000000);
+    guint32 words[4];
+    __m128i px;
+    int i;
+
+    /* Cairo words are B, G, R, X in memory. */
+    if (out == UNI_SCALE_OUT_CAIRO)
+    {
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xc6), 0xc6);
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xc6), 0xc6);
+    }
+    px = _mm_or_si128(_mm_packus_epi16(lo, hi), opaque);
+
+    if (out != UNI_SCALE_OUT_RGB && count == 4)
+    {
+        _mm_storeu_si128((__m128i *) dst, px);
+        return;
+    }
+
+    _mm_storeu_si128((__m128i *) words, px);
+    for (i = 0; i < count; i++)
+    {
+        if (out == UNI_SCALE_OUT_RGB)
+            memcpy(dst + i * 3, words + i, 3);
+        else
+            memcpy(dst + i * 4, words + i, 4);
+    }
+}
+
+/* Composites RGBA sources four pixels at a time, a source without
+   alpha is a plain copy and stays with the C loop. */
+__attribute__((target("sse2")))
+static void
+uni_scale_nearest_sse2(const guint8 *src, int src_chans,
+                       guint8 *dst, UniScaleOut out,
+                       const UniScaleFilter *fx, int width,
+                       const guint8 checks[2][3], int check_x, int check_row)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    int bpp = uni_scale_out_bpp[out];
+    guint32 check_words[2];
+    int x, i;
+
+    if (src_chans != 4)
+    {
+        uni_scale_nearest_c(src, src_chans, dst, out, fx, width,
+                            checks, check_x, check_row);
+        return;
+    }
+
+    for (i = 0; i < 2; i++)
+        check_words[i] = checks[i][0] | (checks[i][1] << 8)
+                         | (checks[i][2] << 16);
+
+    for (x = 0; x + 4 <= width; x += 4, dst += 4 * bpp)
+    {
+        guint32 p[4], c[4];
+        __m128i px, ck, a, t, lo, hi;
+
+        for (i = 0; i < 4; i++)
+        {
+            memcpy(p + i, src + fx->index[x + i] * 4, 4);
+            c[i] = check_words[(((x + i + check_x) / CHECK_SIZE)
+                                + check_row) & 1];
+        }
+        px = _mm_loadu_si128((const __m128i *) p);
+        ck = _mm_loadu_si128((const __m128i *) c);
+
+        /* color * alpha + check * (255 - alpha), divided by 255 */
+        lo = _mm_unpacklo_epi8(px, zero);
+        a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+        t = _mm_add_epi16(_mm_mullo_epi16(lo, a),
+                          _mm_mullo_epi16(_mm_unpacklo_epi8(ck, zero),
+                                          _mm_sub_epi16(full, a)));
+        t = _mm_add_epi16(t, half);
+        lo = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        hi = _mm_unpackhi_epi8(px, zero);
+        a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+        t = _mm_add_epi16(_mm_mullo_epi16(hi, a),
+                          _mm_mullo_epi16(_mm_unpackhi_epi8(ck, zero),
+                                          _mm_sub_epi16(full, a)));
+        t = _mm_add_epi16(t, half);
+        hi = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        uni_scale_store_sse2(dst, out, lo, hi, 4);
+    }
+
+    for (; x < width; x++, dst += bpp)
+        uni_scale_nearest_pixel(src, src_chans, dst, out, fx, x,
+                                checks, check_x, check_row);
+}
+
+/* All channels of a pixel are summed at once, in 32 bit lanes. RGB
+   rows are read four values at a time, the row has a spare value at
+   its end for the last pixel. */
+__attribute__((target("sse2")))
+static void
+uni_scale_horizontal_sse2(const guint16 *row, int src_chans,
+                          guint8 *dst, UniScaleOut out,
+                          const UniScaleFilter *fx, int width,
+                          const guint8 checks[2][3],
+                          int check_x, int check_row)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i full = _mm_set1_epi32(255);
+    const __m128i half = _mm_set1_epi32(128);
+    int bpp = uni_scale_out_bpp[out];
+    int n = fx->n_taps;
+    __m128i check_vecs[2];
+    int x, k;
+
+    for (k = 0; k < 2; k++)
+        check_vecs[k] = _mm_set_epi32(0, checks[k][2],
+                                      checks[k][1], checks[k][0]);
+
+    for (x = 0; x < width; x++, dst += bpp)
+    {
+        const int *index = fx->index + x * n;
+        const guint16 *weight = fx->weight + x * n;
+        __m128i acc = bias, v;
+
+        for (k = 0; k < n; k++)
+        {
+            const guint16 *p = row + (index[k] - fx->first) * src_chans;
+            __m128i px = _mm_loadl_epi64((const __m128i *) p);
+            __m128i wk = _mm_set1_epi16(weight[k]);
+            __m128i lo = _mm_mullo_epi16(px, wk);
+            __m128i hi = _mm_mulhi_epu16(px, wk);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(lo, hi));
+        }
+        v = _mm_srli_epi32(acc, 16);
+
+        if (src_chans == 4)
+        {
+            /* check * (255 - alpha) / 255 added to the premultiplied
+               color, the packing below clamps to 255. */
+            int i = (((x + check_x) / CHECK_SIZE) + check_row) & 1;
+            __m128i a = _mm_shuffle_epi32(v, 0xff);
+            __m128i t = _mm_mullo_epi16(check_vecs[i], _mm_sub_epi32(full, a));
+            t = _mm_add_epi32(t, half);
+            t = _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+            v = _mm_add_epi32(v, t);
+        }
+
+        v = _mm_packs_epi32(v, v);
+        uni_scale_store_sse2(dst, out, v, v, 1);
+    }
+}
+#endif
+
+/**
+ * uni_scale_init:
+ *
+ * Picks the widest kernels the CPU supports. The row kernels only
+ * come in SSE2, a row is too short for AVX2 to pay off. Setting
+ * UNI_SCALE_GENERIC in the environment forces the plain C ones,
+ * which is handy to compare output and timings.
+ **/
+static void
+uni_scale_init(void)
+{
+    static gsize initialized = 0;
+
+    if (!g_once_init_enter(&initialized))
+        return;
+
+    uni_scale_vertical = uni_scale_vertical_c;
+    uni_scale_vertical_premul = uni_scale_vertical_premul_c;
+    uni_scale_nearest = uni_scale_nearest_c;
+    uni_scale_horizontal = uni_scale_horizontal_c;
+
+#ifdef UNI_SCALE_X86
+    if (!g_getenv("UNI_SCALE_GENERIC"))
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+        {
+            uni_scale_nearest = uni_scale_nearest_sse2;
+            uni_scale_horizontal = uni_scale_horizontal_sse2;
+        }
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            uni_scale_vertical = uni_scale_vertical_avx2;
+            uni_scale_vertical_premul = uni_scale_vertical_premul_avx2;
+        }
+        else if (__builtin_cpu_supports("sse2"))
+        {
+            uni_scale_vertical = uni_scale_vertical_sse2;
+            uni_scale_vertical_premul = uni_scale_vertical_premul_sse2;
+        }
+    }
+#endif
+
+    g_once_init_leave(&initialized, 1);
+}
+
+/* Pixel @x, @y of the area held by @src. */
+static inline const guint8 *
+uni_scale_tiles_pixel(const UniScaleTiles *src, int x, int y)
+{
+    int ax = src->x + x;
+    int ay = src->y + y;
+    int col = ax / src->tile_width - src->x / src->tile_width;
+    int row = ay / src->tile_height - src->y / src->tile_height;
+
+    return src->tiles[row * src->tiles_x + col]
+           + (ay % src->tile_height) * src->stride
+           + (ax % src->tile_width) * src->chans;
+}
+
+/**
+ * uni_scale_blend_rows:
+ *
+ * Scales into the rows at @dst_pixels, written in the @out layout,
+ * see uni_scale_blend(). The vertical pass reads each tile column of
+ * @src separately into the row the horizontal pass samples from, so
+ * tiles are never copied. Nearest neighbour samples the source rows
+ * directly and needs @src to be a single tile wide.
+ **/
+static gboolean
+uni_scale_blend_rows(const UniScaleTiles *src,
+                     guint8 *dst_pixels,
+                     int dst_stride,
+                     UniScaleOut out,
+                     int dst_x,
+                     int dst_y,
+                     int dst_width,
+                     int dst_height,
+                     gdouble offset_x,
+                     gdouble offset_y,
+                     gdouble zoom,
+                     GdkInterpType interp, int check_x, int check_y)
+{
+    int src_chans = src->chans;
+
+    if (interp != GDK_INTERP_NEAREST && interp != GDK_INTERP_BILINEAR)
+        return FALSE;
+    if (interp == GDK_INTERP_NEAREST
+        && src->x / src->tile_width
+           != (src->x + src->width - 1) / src->tile_width)
+        return FALSE;
+    if (zoom <= 0.0)
+        return FALSE;
+    if (dst_width <= 0 || dst_height <= 0)
+        return TRUE;
+
+    UniScaleFilter fx, fy;
+    if (!uni_scale_filter_init(&fx, dst_x, dst_width, offset_x, zoom,
+                               src->width, interp))
+        return FALSE;
+    if (!uni_scale_filter_init(&fy, dst_y, dst_height, offset_y, zoom,
+                               src->height, interp))
+    {
+        uni_scale_filter_clear(&fx);
+        return FALSE;
+    }
+
+    uni_scale_init();
+
+    const guint8 checks[2][3] = {
+        {(CHECK_LIGHT >> 16) & 0xff, (CHECK_LIGHT >> 8) & 0xff, CHECK_LIGHT & 0xff},
+        {(CHECK_DARK >> 16) & 0xff, (CHECK_DARK >> 8) & 0xff, CHECK_DARK & 0xff},
+    };
+    guint8 *dst_base = dst_pixels + dst_y * dst_stride
+                       + dst_x * uni_scale_out_bpp[out];
+    int length = (fx.last - fx.first + 1) * src_chans;
+
+    const guint8 *rows[UNI_SCALE_MAX_TAPS];
+    /* One spare value for the vector horizontal pass, see there. */
+    guint16 *row = g_new0(guint16, length + 1);
+    const int *last_index = NULL;
+    const guint16 *last_weight = NULL;
+    int n = fy.n_taps;
+    int y;
+
+    for (y = 0; y < dst_height; y++)
+    {
+        const int *index = fy.index + y * n;
+        const guint16 *weight = fy.weight + y * n;
+        guint8 *dst_row = dst_base + y * dst_stride;
+        int check_row = (y + check_y) / CHECK_SIZE;
+
+        if (interp == GDK_INTERP_NEAREST)
+        {
+            uni_scale_nearest(uni_scale_tiles_pixel(src, 0, index[0]),
+                              src_chans, dst_row, out, &fx, dst_width,
+                              checks, check_x, check_row);
+            continue;
+        }
+
+        // Magnified rows often share their source rows and weights
+        // with the previous one.
+        if (!last_index
+            || memcmp(index, last_index, n * sizeof(int))
+            || memcmp(weight, last_weight, n * sizeof(guint16)))
+        {
+            int k, x, end;
+            for (x = fx.first; x <= fx.last; x = end)
+            {
+                /* Up to the end of the tile column x is in. */
+                end = ((src->x + x) / src->tile_width + 1) * src->tile_width
+                      - src->x;
+                end = MIN(end, fx.last + 1);
+
+                for (k = 0; k < n; k++)
+                    rows[k] = uni_scale_tiles_pixel(src, x, index[k]);
+
+                if (src_chans == 4)
+                    uni_scale_vertical_premul(rows, weight, n,
+                                              row + (x - fx.first) * src_chans,
+                                              (end - x) * src_chans);
+                else
+                    uni_scale_vertical(rows, weight, n,
+                                       row + (x - fx.first) * src_chans,
+                                       (end - x) * src_chans);
+            }
+
+            last_index = index;
+            last_weight = weight;
+        }
+
+        uni_scale_horizontal(row, src_chans, dst_row, out,
+                             &fx, dst_width, checks, check_x, check_row);
+    }
+
+    g_free(row);
+    uni_scale_filter_clear(&fx);
+    uni_scale_filter_clear(&fy);
+    return TRUE;
+}
+
+/* Describes all of @pixbuf as a single tile, %FALSE for the formats
+   the kernels don't read. */
+static gboolean
+uni_scale_tiles_init(UniScaleTiles *tiles, GdkPixbuf *pixbuf,
+                     const guint8 **pixels)
+{
+    int chans = gdk_pixbuf_get_n_channels(pixbuf);
+
+    if (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8
+        || chans != (gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3))
+        return FALSE;
+
+    *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    *tiles = (UniScaleTiles){
+        0, 0,
+        gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+        chans,
+        gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+        gdk_pixbuf_get_rowstride(pixbuf),
+        1, pixels};
+    return TRUE;
+}
+
+/**
+ * uni_scale_blend:
+ *
+ * Does what uni_pixbuf_scale_blend() does for the cases the viewer
+ * actually draws: 8 bit RGB or RGBA sources, nearest or bilinear
+ * interpolation. Bilinear uses linear interpolation when magnifying
+ * and a box filter when reducing, like gdk-pixbuf, and is computed
+ * as a vertical pass over whole rows followed by a horizontal pass,
+ * both with vector kernels.
+ *
+ * Nearest neighbour picks the same pixels as gdk-pixbuf, up to
+ * rounding at exact pixel boundaries. Filtered output is not bit
+ * identical to gdk-pixbuf since weights are rounded to 8 bits, a
+ * channel may be off by a level or two. The C and vector kernels
+ * give identical results.
+ *
+ * Returns: %FALSE if nothing was drawn and gdk-pixbuf should be
+ * used instead.
+ **/
+gboolean
+uni_scale_blend(GdkPixbuf *src,
+                GdkPixbuf *dst,
+                int dst_x,
+                int dst_y,
+                int dst_width,
+                int dst_height,
+                gdouble offset_x,
+                gdouble offset_y,
+                gdouble zoom,
+                GdkInterpType interp, int check_x, int check_y)
+{
+    int dst_chans = gdk_pixbuf_get_n_channels(dst);
+    UniScaleTiles tiles;
+    const guint8 *pixels;
+
+    if (gdk_pixbuf_get_bits_per_sample(dst) != 8
+        || dst_chans != (gdk_pixbuf_get_has_alpha(dst) ? 4 : 3))
+        return FALSE;
+    if (!uni_scale_tiles_init(&tiles, src, &pixels))
+        return FALSE;
+
+    return uni_scale_blend_rows(&tiles,
+                                gdk_pixbuf_get_pixels(dst),
+                                gdk_pixbuf_get_rowstride(dst),
+                                dst_chans == 4 ? UNI_SCALE_OUT_RGBA
+                                               : UNI_SCALE_OUT_RGB,
+                                dst_x, dst_y, dst_width, dst_height,
+                                offset_x, offset_y, zoom, interp,
+                                check_x, check_y);
+}
+
+/**
+ * uni_scale_blend_surface:
+ *
+ * Same as uni_scale_blend() but writes straight into the pixels of a
+ * %CAIRO_FORMAT_RGB24 image surface. The surface is neither flushed
+ * nor marked dirty, so that several threads can fill separate parts
+ * of it, the caller takes care of that.
+ **/
+gboolean
+uni_scale_blend_surface(GdkPixbuf *src,
+                        cairo_surface_t *dst,
+                        int dst_x,
+                        int dst_y,
+                        int dst_width,
+                        int dst_height,
+                        gdouble offset_x,
+                        gdouble offset_y,
+                        gdouble zoom,
+                        GdkInterpType interp, int check_x, int check_y)
+{
+    UniScaleTiles tiles;
+    const guint8 *pixels;
+
+    if (!uni_scale_tiles_init(&tiles, src, &pixels))
+        return FALSE;
+
+    return uni_scale_blend_surface_tiles(&tiles, dst,
+                                         dst_x, dst_y, dst_width, dst_height,
+                                         offset_x, offset_y, zoom, interp,
+                                         check_x, check_y);
+}
+
+/**
+ * uni_scale_blend_surface_tiles:
+ *
+ * Same as uni_scale_blend_surface() but reads the pixels straight
+ * from the tiles of @src, which must be 8 bit RGB or RGBA. Offsets
+ * are relative to the area @src holds. Only filtered scaling reads
+ * across tiles, nearest neighbour is left to the caller for sources
+ * more than one tile wide.
+ **/
+gboolean
+uni_scale_blend_surface_tiles(const UniScaleTiles *src,
+                              cairo_surface_t *dst,
+                              int dst_x,
+                              int dst_y,
+                              int dst_width,
+                              int dst_height,
+                              gdouble offset_x,
+                              gdouble offset_y,
+                              gdouble zoom,
+                              GdkInterpType interp,
+                              int check_x, int check_y)
+{
+    if (cairo_image_surface_get_format(dst) != CAIRO_FORMAT_RGB24)
+        return FALSE;
+
+    return uni_scale_blend_rows(src,
+                                cairo_image_surface_get_data(dst),
+                                cairo_image_surface_get_stride(dst),
+                                UNI_SCALE_OUT_CAIRO,
+                                dst_x, dst_y, dst_width, dst_height,
+                                offset_x, offset_y, zoom, interp,
+                                check_x, check_y);
+}
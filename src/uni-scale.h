@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UNI_SCALE_H__
+#define __UNI_SCALE_H__
+
+#include <gdk/gdk.h>
+
+/**
+ * UniScaleTiles:
+ *
+ * An area of an image stored as separate tiles of the same size,
+ * read in place by uni_scale_blend_surface_tiles(). @x and @y are
+ * the position of the area in the image, @tiles holds the tiles
+ * covering it row by row, @tiles_x of them per row, starting with
+ * the one that contains its top left pixel.
+ **/
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+    int height;
+    int chans;
+    int tile_width;
+    int tile_height;
+    int stride;
+    int tiles_x;
+    const guint8 **tiles;
+} UniScaleTiles;
+
+gboolean uni_scale_blend(GdkPixbuf *src,
+                         GdkPixbuf *dst,
+                         int dst_x,
+                         int dst_y,
+                         int dst_width,
+                         int dst_height,
+                         gdouble offset_x,
+                         gdouble offset_y,
+                         gdouble zoom,
+                         GdkInterpType interp, int check_x, int check_y);
+
+gboolean uni_scale_blend_surface(GdkPixbuf *src,
+                                 cairo_surface_t *dst,
+                                 int dst_x,
+                                 int dst_y,
+                                 int dst_width,
+                                 int dst_height,
+                                 gdouble offset_x,
+                                 gdouble offset_y,
+                                 gdouble zoom,
+                                 GdkInterpType interp,
+                                 int check_x, int check_y);
+
+gboolean uni_scale_blend_surface_tiles(const UniScaleTiles *src,
+                                       cairo_surface_t *dst,
+                                       int dst_x,
+                                       int dst_y,
+                                       int dst_width,
+                                       int dst_height,
+                                       gdouble offset_x,
+                                       gdouble offset_y,
+                                       gdouble zoom,
+                                       GdkInterpType interp,
+                                       int check_x, int check_y);
+
+#endif /* __UNI_SCALE_H__ */
@@ -21,6 +21,7 @@
  */
 
 #include "uni-utils.h"
+#include "uni-scale.h"
 
 /**
  * uni_pixbuf_scale_blend:
@@ -40,6 +41,10 @@ void uni_pixbuf_scale_blend(GdkPixbuf *src,
                             gdouble zoom,
                             GdkInterpType interp, int check_x, int check_y)
 {
+    if (uni_scale_blend(src, dst, dst_x, dst_y, dst_width, dst_height,
+                        offset_x, offset_y, zoom, interp, check_x, check_y))
+        return;
+
     if (gdk_pixbuf_get_has_alpha(src))
         gdk_pixbuf_composite_color(src, dst,
                                    dst_x, dst_y, dst_width, dst_height,
@@ -55,6 +60,58 @@ void uni_pixbuf_scale_blend(GdkPixbuf *src,
                          offset_x, offset_y, zoom, zoom, interp);
 }
 
+/**
+ * uni_surface_scale_blend:
+ *
+ * Like uni_pixbuf_scale_blend(), but the destination is a
+ * %CAIRO_FORMAT_RGB24 image surface. Its pixels are written directly
+ * and the caller must flush the surface before and mark it dirty
+ * after. Cases the fast scaler does not handle are scaled into a
+ * temporary pixbuf which is then converted.
+ **/
+void uni_surface_scale_blend(GdkPixbuf *src,
+                             cairo_surface_t *dst,
+                             int dst_x,
+                             int dst_y,
+                             int dst_width,
+                             int dst_height,
+                             gdouble offset_x,
+                             gdouble offset_y,
+                             gdouble zoom,
+                             GdkInterpType interp, int check_x, int check_y)
+{
+    int x, y;
+
+    if (dst_width <= 0 || dst_height <= 0)
+        return;
+    if (uni_scale_blend_surface(src, dst, dst_x, dst_y,
+                                dst_width, dst_height,
+                                offset_x, offset_y, zoom, interp,
+                                check_x, check_y))
+        return;
+
+    GdkPixbuf *tmp = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+                                    dst_width, dst_height);
+    uni_pixbuf_scale_blend(src, tmp, 0, 0, dst_width, dst_height,
+                           offset_x - dst_x, offset_y - dst_y,
+                           zoom, interp, check_x, check_y);
+
+    int tmp_stride = gdk_pixbuf_get_rowstride(tmp);
+    int dst_stride = cairo_image_surface_get_stride(dst);
+    guchar *tmp_base = gdk_pixbuf_get_pixels(tmp);
+    guchar *dst_base = cairo_image_surface_get_data(dst)
+                       + dst_y * dst_stride + dst_x * 4;
+
+    for (y = 0; y < dst_height; y++)
+    {
+        guchar *p = tmp_base + y * tmp_stride;
+        guint32 *q = (guint32 *)(dst_base + y * dst_stride);
+        for (x = 0; x < dst_width; x++, p += 3)
+            q[x] = 0xff000000 | (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+    g_object_unref(tmp);
+}
+
 /**
  * uni_draw_rect:
  *
@@ -47,6 +47,17 @@ void uni_pixbuf_scale_blend(GdkPixbuf *src,
                             gdouble zoom,
                             GdkInterpType interp, int check_x, int check_y);
 
+void uni_surface_scale_blend(GdkPixbuf *src,
+                             cairo_surface_t *dst,
+                             int dst_x,
+                             int dst_y,
+                             int dst_width,
+                             int dst_height,
+                             gdouble offset_x,
+                             gdouble offset_y,
+                             gdouble zoom,
+                             GdkInterpType interp, int check_x, int check_y);
+
 void uni_draw_rect(cairo_t *cr, gboolean filled, GdkRectangle *rect);
 
 void uni_rectangle_get_rects_around(GdkRectangle *outer,
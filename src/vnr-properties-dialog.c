@@ -324,45 +324,176 @@ vnr_properties_dialog_clear_metadata(VnrPropertiesDialog *dialog)
     g_list_free(children);
 }
 
+typedef struct _MetadataRows MetadataRows;
+
+struct _MetadataRows
+{
+    VnrPropertiesDialog *dialog;
+
+    // labels of the previous image not reused yet
+    GList *names;
+    GList *values;
+};
+
+static GtkWidget *
+vnr_properties_dialog_next_row(GtkWidget *box, GList **labels)
+{
+    if (*labels != NULL)
+    {
+        GtkWidget *label = GTK_WIDGET((*labels)->data);
+        *labels = g_list_next(*labels);
+
+        return label;
+    }
+
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
+    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+    gtk_widget_show(label);
+
+    return label;
+}
+
 static void
 vnr_cb_add_metadata(const char *label, const char *value, void *user_data)
 {
-    VnrPropertiesDialog *dialog = VNR_PROPERTIES_DIALOG(user_data);
+    // The labels of the previous image are reused.
+
+    MetadataRows *rows = (MetadataRows *) user_data;
+    VnrPropertiesDialog *dialog = rows->dialog;
     GtkWidget *temp_label;
     gchar *formatted_label;
 
     // value
-    temp_label = gtk_label_new(NULL);
+    temp_label = vnr_properties_dialog_next_row(dialog->meta_values_box,
+                                                &rows->values);
     gtk_label_set_text(GTK_LABEL(temp_label), value);
     gtk_label_set_selectable(GTK_LABEL(temp_label), TRUE);
-    gtk_misc_set_alignment(GTK_MISC(temp_label), 0, 0);
-    gtk_box_pack_start(GTK_BOX(dialog->meta_values_box), temp_label, FALSE, FALSE, 0);
-
-    gtk_widget_show(temp_label);
 
     // label
     formatted_label = g_strdup_printf("<b>%s:</b>", label);
 
-    temp_label = gtk_label_new(NULL);
+    temp_label = vnr_properties_dialog_next_row(dialog->meta_names_box,
+                                                &rows->names);
     gtk_label_set_markup(GTK_LABEL(temp_label), formatted_label);
-    gtk_misc_set_alignment(GTK_MISC(temp_label), 0, 0);
-    gtk_box_pack_start(GTK_BOX(dialog->meta_names_box), temp_label, FALSE, FALSE, 0);
 
     g_free(formatted_label);
-    gtk_widget_show(temp_label);
 }
 
 G_GNUC_END_IGNORE_DEPRECATIONS
 
+static void
+vnr_properties_dialog_set_metadata(VnrPropertiesDialog *dialog,
+                                   UniExiv2Metadata *metadata)
+{
+    GList *names = gtk_container_get_children(GTK_CONTAINER(dialog->meta_names_box));
+    GList *values = gtk_container_get_children(GTK_CONTAINER(dialog->meta_values_box));
+    GList *iter;
+
+    MetadataRows rows = {dialog, names, values};
+
+    if (metadata != NULL)
+        uni_exiv2_metadata_map(metadata, vnr_cb_add_metadata, (void*) &rows);
+
+    // the labels left over
+    for (iter = rows.names; iter != NULL; iter = g_list_next(iter))
+    {
+        gtk_widget_destroy(GTK_WIDGET(iter->data));
+    }
+
+    for (iter = rows.values; iter != NULL; iter = g_list_next(iter))
+    {
+        gtk_widget_destroy(GTK_WIDGET(iter->data));
+    }
+
+    g_list_free(names);
+    g_list_free(values);
+}
+
+static void
+vnr_properties_dialog_cancel_metadata(VnrPropertiesDialog *dialog)
+{
+    if (dialog->meta_cancellable == NULL)
+        return;
+
+    g_cancellable_cancel(dialog->meta_cancellable);
+    g_clear_object(&dialog->meta_cancellable);
+}
+
+static void
+vnr_properties_dialog_metadata_thread(GTask *task, gpointer source_object,
+                                      gpointer task_data,
+                                      GCancellable *cancellable)
+{
+    (void) source_object;
+    (void) cancellable;
+
+    if (g_task_return_error_if_cancelled(task))
+        return;
+
+    UniExiv2Metadata *metadata = uni_exiv2_metadata_new(task_data);
+
+    g_task_return_pointer(task, metadata,
+                          (GDestroyNotify) uni_exiv2_metadata_unref);
+}
+
+static void
+vnr_properties_dialog_on_metadata(GObject *source, GAsyncResult *result,
+                                  gpointer user_data)
+{
+    (void) user_data;
+
+    GError *error = NULL;
+    UniExiv2Metadata *metadata = g_task_propagate_pointer(G_TASK(result),
+                                                          &error);
+
+    // the user moved on to another file
+    if (error != NULL)
+    {
+        g_error_free(error);
+        return;
+    }
+
+    VnrPropertiesDialog *dialog = VNR_PROPERTIES_DIALOG(source);
+
+    g_clear_object(&dialog->meta_cancellable);
+    vnr_properties_dialog_set_metadata(dialog, metadata);
+
+    uni_exiv2_metadata_unref(metadata);
+}
+
 static void vnr_properties_dialog_update_metadata(VnrPropertiesDialog *dialog)
 {
-    vnr_properties_dialog_clear_metadata(dialog);
+    // The metadata of the image on screen was parsed when it was loaded,
+    // other files are parsed on a worker as that takes a while for large
+    // TIFF or raw files. Results for files skipped past are dropped.
+
+    vnr_properties_dialog_cancel_metadata(dialog);
 
     VnrFile *current = window_get_current_file(dialog->window);
     if (!current)
+    {
+        vnr_properties_dialog_clear_metadata(dialog);
+        return;
+    }
+
+    VnrImage *image = dialog->window->image;
+
+    if (image && g_strcmp0(image->path, current->path) == 0)
+    {
+        vnr_properties_dialog_set_metadata(dialog, image->metadata);
         return;
+    }
 
-    uni_read_exiv2_map(current->path, vnr_cb_add_metadata, (void*) dialog);
+    vnr_properties_dialog_clear_metadata(dialog);
+
+    dialog->meta_cancellable = g_cancellable_new();
+
+    GTask *task = g_task_new(dialog, dialog->meta_cancellable,
+                             vnr_properties_dialog_on_metadata, NULL);
+    g_task_set_task_data(task, g_strdup(current->path), g_free);
+    g_task_run_in_thread(task, vnr_properties_dialog_metadata_thread);
+    g_object_unref(task);
 }
 
 void vnr_properties_dialog_update_image(VnrPropertiesDialog *dialog)
@@ -397,6 +528,8 @@ void vnr_properties_dialog_update_image(VnrPropertiesDialog *dialog)
 
 void vnr_properties_dialog_clear(VnrPropertiesDialog *dialog)
 {
+    vnr_properties_dialog_cancel_metadata(dialog);
+
     set_new_pixbuf(dialog, NULL);
     vnr_properties_dialog_clear_metadata(dialog);
 
@@ -49,6 +49,7 @@ struct _VnrPropertiesDialog
     GtkWidget *image;
     GtkWidget *meta_names_box;
     GtkWidget *meta_values_box;
+    GCancellable *meta_cancellable;
 
     GtkWidget *close_button;
     GtkWidget *next_button;
@@ -0,0 +1,455 @@
+#include "thumbnails.h"
+#include "config.h"
+#include "preview.h"
+
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Thumbnails kept in memory, the least recently drawn go first.
+#define THUMBS_CACHE_MAX 1024
+
+// At most this many workers, a core is left to the main thread.
+#define THUMBS_MAX_THREADS 4
+
+typedef struct _ThumbEntry ThumbEntry;
+
+struct _ThumbEntry
+{
+    gchar *path;
+    time_t mtime;
+
+    // NULL when no thumbnail could be made
+    GdkPixbuf *pixbuf;
+};
+
+typedef struct _ThumbJob ThumbJob;
+
+struct _ThumbJob
+{
+    VnrThumbnails *thumbs;
+    gchar *path;
+    time_t mtime;
+    gint priority;
+    guint round;
+
+    // FALSE when the job was dropped
+    gboolean done;
+    GdkPixbuf *pixbuf;
+};
+
+struct _VnrThumbnails
+{
+    gint ref_count;
+
+    VnrThumbnailsFunc func;
+    gpointer user_data;
+
+    GThreadPool *pool;
+
+    // jobs of earlier rounds are dropped, see vnr_thumbnails_begin
+    guint round;
+
+    // main thread only, path -> link of the queue
+    GHashTable *links;
+    GQueue queue;
+
+    // path -> round + 1 of the job queued for it
+    GHashTable *pending;
+};
+
+static VnrThumbnails* _thumbs_ref(VnrThumbnails *thumbs);
+static void _thumbs_unref(VnrThumbnails *thumbs);
+static void _thumbs_insert(VnrThumbnails *thumbs, const gchar *path,
+                           time_t mtime, GdkPixbuf *pixbuf);
+static void _thumbs_remove_link(VnrThumbnails *thumbs, GList *link);
+static gint _thumbs_compare_jobs(gconstpointer a, gconstpointer b,
+                                 gpointer user_data);
+static void _thumbs_worker(gpointer data, gpointer user_data);
+static gboolean _thumbs_deliver(gpointer data);
+static GdkPixbuf* _thumbs_load(const gchar *path, time_t mtime);
+static GdkPixbuf* _thumbs_read(const gchar *thumb_path, const gchar *uri,
+                               const gchar *mtime);
+static GdkPixbuf* _thumbs_make(const gchar *path, const gchar *uri,
+                               const gchar *mtime, const gchar *thumb_path,
+                               const gchar *fail_path);
+static void _thumbs_save(GdkPixbuf *pixbuf, const gchar *thumb_path,
+                         const gchar *uri, const gchar *mtime,
+                         gint width, gint height);
+
+
+// create ---------------------------------------------------------------------
+
+VnrThumbnails* vnr_thumbnails_new(VnrThumbnailsFunc func, gpointer user_data)
+{
+    VnrThumbnails *thumbs = g_slice_new0(VnrThumbnails);
+
+    thumbs->ref_count = 1;
+    thumbs->func = func;
+    thumbs->user_data = user_data;
+
+    gint threads = CLAMP(g_get_num_processors() - 1, 1, THUMBS_MAX_THREADS);
+
+    thumbs->pool = g_thread_pool_new(_thumbs_worker, NULL, threads,
+                                     FALSE, NULL);
+    g_thread_pool_set_sort_function(thumbs->pool, _thumbs_compare_jobs,
+                                    NULL);
+
+    // keys are owned by the entries
+    thumbs->links = g_hash_table_new(g_str_hash, g_str_equal);
+    g_queue_init(&thumbs->queue);
+
+    thumbs->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+
+    return thumbs;
+}
+
+void vnr_thumbnails_free(VnrThumbnails *thumbs)
+{
+    // The queued jobs are dropped, their results still on their way hold
+    // a reference.
+
+    if (!thumbs)
+        return;
+
+    thumbs->func = NULL;
+    g_atomic_int_inc(&thumbs->round);
+
+    g_thread_pool_free(thumbs->pool, FALSE, TRUE);
+    thumbs->pool = NULL;
+
+    _thumbs_unref(thumbs);
+}
+
+static VnrThumbnails* _thumbs_ref(VnrThumbnails *thumbs)
+{
+    ++thumbs->ref_count;
+
+    return thumbs;
+}
+
+static void _thumbs_unref(VnrThumbnails *thumbs)
+{
+    if (--thumbs->ref_count > 0)
+        return;
+
+    while (thumbs->queue.head)
+        _thumbs_remove_link(thumbs, thumbs->queue.head);
+
+    g_hash_table_destroy(thumbs->links);
+    g_hash_table_destroy(thumbs->pending);
+    g_slice_free(VnrThumbnails, thumbs);
+}
+
+
+// memory cache ---------------------------------------------------------------
+
+GdkPixbuf* vnr_thumbnails_lookup(VnrThumbnails *thumbs, VnrFile *file,
+                                 gboolean *failed)
+{
+    // Returns the thumbnail owned by the cache, or NULL and sets failed
+    // when none can be made.
+
+    g_return_val_if_fail(thumbs != NULL && file != NULL, NULL);
+
+    if (failed)
+        *failed = FALSE;
+
+    GList *link = g_hash_table_lookup(thumbs->links, file->path);
+    if (!link)
+        return NULL;
+
+    ThumbEntry *entry = link->data;
+
+    if (entry->mtime != file->mtime)
+    {
+        _thumbs_remove_link(thumbs, link);
+        return NULL;
+    }
+
+    g_queue_unlink(&thumbs->queue, link);
+    g_queue_push_head_link(&thumbs->queue, link);
+
+    if (failed)
+        *failed = (entry->pixbuf == NULL);
+
+    return entry->pixbuf;
+}
+
+static void _thumbs_insert(VnrThumbnails *thumbs, const gchar *path,
+                           time_t mtime, GdkPixbuf *pixbuf)
+{
+    // Takes the pixbuf.
+
+    GList *link = g_hash_table_lookup(thumbs->links, path);
+    if (link)
+        _thumbs_remove_link(thumbs, link);
+
+    ThumbEntry *entry = g_slice_new(ThumbEntry);
+    entry->path = g_strdup(path);
+    entry->mtime = mtime;
+    entry->pixbuf = pixbuf;
+
+    g_queue_push_head(&thumbs->queue, entry);
+    g_hash_table_insert(thumbs->links, entry->path, thumbs->queue.head);
+
+    while (thumbs->queue.length > THUMBS_CACHE_MAX)
+        _thumbs_remove_link(thumbs, thumbs->queue.tail);
+}
+
+static void _thumbs_remove_link(VnrThumbnails *thumbs, GList *link)
+{
+    ThumbEntry *entry = link->data;
+
+    g_hash_table_remove(thumbs->links, entry->path);
+    g_queue_delete_link(&thumbs->queue, link);
+
+    if (entry->pixbuf)
+        g_object_unref(entry->pixbuf);
+
+    g_free(entry->path);
+    g_slice_free(ThumbEntry, entry);
+}
+
+
+// requests -------------------------------------------------------------------
+
+void vnr_thumbnails_begin(VnrThumbnails *thumbs)
+{
+    // Starts a new round of requests, typically when the visible files
+    // change. The jobs still queued from before are dropped.
+
+    g_return_if_fail(thumbs != NULL);
+
+    g_atomic_int_inc(&thumbs->round);
+}
+
+void vnr_thumbnails_request(VnrThumbnails *thumbs, VnrFile *file,
+                            gint priority)
+{
+    // Lower priorities are made first.
+
+    g_return_if_fail(thumbs != NULL && file != NULL);
+
+    guint round = g_atomic_int_get(&thumbs->round);
+    gpointer queued = g_hash_table_lookup(thumbs->pending, file->path);
+
+    if (GPOINTER_TO_UINT(queued) == round + 1)
+        return;
+
+    g_hash_table_insert(thumbs->pending, g_strdup(file->path),
+                        GUINT_TO_POINTER(round + 1));
+
+    ThumbJob *job = g_slice_new0(ThumbJob);
+    job->thumbs = _thumbs_ref(thumbs);
+    job->path = g_strdup(file->path);
+    job->mtime = file->mtime;
+    job->priority = priority;
+    job->round = round;
+
+    g_thread_pool_push(thumbs->pool, job, NULL);
+}
+
+static gint _thumbs_compare_jobs(gconstpointer a, gconstpointer b,
+                                 gpointer user_data)
+{
+    (void) user_data;
+
+    const ThumbJob *job_a = a;
+    const ThumbJob *job_b = b;
+
+    if (job_a->round != job_b->round)
+        return job_a->round > job_b->round ? -1 : 1;
+
+    return (job_a->priority > job_b->priority)
+           - (job_a->priority < job_b->priority);
+}
+
+static void _thumbs_worker(gpointer data, gpointer user_data)
+{
+    (void) user_data;
+
+    ThumbJob *job = data;
+
+    if (job->round == (guint) g_atomic_int_get(&job->thumbs->round))
+    {
+        job->pixbuf = _thumbs_load(job->path, job->mtime);
+        job->done = TRUE;
+    }
+
+    // after the drawing and the input events
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT_IDLE,
+                               _thumbs_deliver, job, NULL);
+}
+
+static gboolean _thumbs_deliver(gpointer data)
+{
+    ThumbJob *job = data;
+    VnrThumbnails *thumbs = job->thumbs;
+
+    gpointer queued = g_hash_table_lookup(thumbs->pending, job->path);
+
+    if (GPOINTER_TO_UINT(queued) == job->round + 1)
+        g_hash_table_remove(thumbs->pending, job->path);
+
+    if (job->done && thumbs->func)
+    {
+        _thumbs_insert(thumbs, job->path, job->mtime, job->pixbuf);
+        thumbs->func(job->path, thumbs->user_data);
+    }
+    else if (job->pixbuf)
+    {
+        g_object_unref(job->pixbuf);
+    }
+
+    g_free(job->path);
+    g_slice_free(ThumbJob, job);
+
+    _thumbs_unref(thumbs);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+// freedesktop.org store ------------------------------------------------------
+
+static GdkPixbuf* _thumbs_load(const gchar *path, time_t mtime)
+{
+    // Thumbnail Managing Standard : the thumbnail of a file is named after
+    // the MD5 of its URI and records the URI and mtime it was made from.
+    // Files which failed are marked in a fail folder of our own.
+
+    gchar *uri = g_filename_to_uri(path, NULL, NULL);
+    if (!uri)
+        return NULL;
+
+    gchar *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+    gchar *name = g_strconcat(md5, ".png", NULL);
+    gchar *mtime_str = g_strdup_printf("%" G_GINT64_FORMAT, (gint64) mtime);
+
+    const gchar *cache_dir = g_get_user_cache_dir();
+
+    gchar *thumb_path = g_build_filename(cache_dir, "thumbnails", "normal",
+                                         name, NULL);
+    gchar *fail_path = g_build_filename(cache_dir, "thumbnails", "fail",
+                                        PACKAGE "-" VERSION, name, NULL);
+
+    GdkPixbuf *pixbuf = _thumbs_read(thumb_path, uri, mtime_str);
+
+    if (!pixbuf)
+    {
+        GdkPixbuf *failed = _thumbs_read(fail_path, uri, mtime_str);
+
+        if (failed)
+            g_object_unref(failed);
+        else
+            pixbuf = _thumbs_make(path, uri, mtime_str,
+                                  thumb_path, fail_path);
+    }
+
+    g_free(fail_path);
+    g_free(thumb_path);
+    g_free(mtime_str);
+    g_free(name);
+    g_free(md5);
+    g_free(uri);
+
+    return pixbuf;
+}
+
+static GdkPixbuf* _thumbs_read(const gchar *thumb_path, const gchar *uri,
+                               const gchar *mtime)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file(thumb_path, NULL);
+    if (!pixbuf)
+        return NULL;
+
+    if (g_strcmp0(gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::URI"),
+                  uri) != 0
+        || g_strcmp0(gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::MTime"),
+                     mtime) != 0)
+    {
+        g_object_unref(pixbuf);
+        return NULL;
+    }
+
+    return pixbuf;
+}
+
+static GdkPixbuf* _thumbs_make(const gchar *path, const gchar *uri,
+                               const gchar *mtime, const gchar *thumb_path,
+                               const gchar *fail_path)
+{
+    // Images smaller than a thumbnail are used as they are and not
+    // stored, as the standard recommends.
+
+    gint width = 0;
+    gint height = 0;
+    GdkPixbuf *pixbuf = vnr_preview_load(path, VNR_THUMBNAIL_SIZE,
+                                         &width, &height);
+
+    if (!pixbuf)
+    {
+        GdkPixbuf *marker = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 1, 1);
+        gdk_pixbuf_fill(marker, 0);
+
+        _thumbs_save(marker, fail_path, uri, mtime, 0, 0);
+        g_object_unref(marker);
+
+        return NULL;
+    }
+
+    // unknown sizes are those of camera files, larger than thumbnails
+    if (width > VNR_THUMBNAIL_SIZE || height > VNR_THUMBNAIL_SIZE
+        || width == 0 || height == 0)
+        _thumbs_save(pixbuf, thumb_path, uri, mtime, width, height);
+
+    return pixbuf;
+}
+
+static void _thumbs_save(GdkPixbuf *pixbuf, const gchar *thumb_path,
+                         const gchar *uri, const gchar *mtime,
+                         gint width, gint height)
+{
+    // Written to a temporary file and renamed, other programs may read
+    // the store at the same time.
+
+    gchar *dir = g_path_get_dirname(thumb_path);
+    gint ret = g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    if (ret != 0)
+        return;
+
+    gchar *tmp_path = g_strconcat(thumb_path, ".XXXXXX", NULL);
+    gint fd = g_mkstemp_full(tmp_path, O_RDWR, 0600);
+
+    if (fd < 0)
+    {
+        g_free(tmp_path);
+        return;
+    }
+
+    close(fd);
+
+    gchar *width_str = g_strdup_printf("%d", width);
+    gchar *height_str = g_strdup_printf("%d", height);
+
+    gboolean saved = gdk_pixbuf_save(pixbuf, tmp_path, "png", NULL,
+                                     "tEXt::Thumb::URI", uri,
+                                     "tEXt::Thumb::MTime", mtime,
+                                     "tEXt::Thumb::Image::Width", width_str,
+                                     "tEXt::Thumb::Image::Height", height_str,
+                                     "tEXt::Software", PACKAGE_STRING,
+                                     NULL);
+
+    if (!saved || g_rename(tmp_path, thumb_path) != 0)
+        g_unlink(tmp_path);
+
+    g_free(height_str);
+    g_free(width_str);
+    g_free(tmp_path);
+}
+
+
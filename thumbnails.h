@@ -0,0 +1,32 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include "file.h"
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Thumbnails of the freedesktop.org store, made on worker threads when
+// missing.
+typedef struct _VnrThumbnails VnrThumbnails;
+
+// Called on the main thread once the thumbnail of path is known.
+typedef void (*VnrThumbnailsFunc)(const gchar *path, gpointer user_data);
+
+#define VNR_THUMBNAIL_SIZE 128
+
+VnrThumbnails* vnr_thumbnails_new(VnrThumbnailsFunc func,
+                                  gpointer user_data);
+void vnr_thumbnails_free(VnrThumbnails *thumbs);
+
+GdkPixbuf* vnr_thumbnails_lookup(VnrThumbnails *thumbs, VnrFile *file,
+                                 gboolean *failed);
+void vnr_thumbnails_begin(VnrThumbnails *thumbs);
+void vnr_thumbnails_request(VnrThumbnails *thumbs, VnrFile *file,
+                            gint priority);
+
+G_END_DECLS
+
+#endif // THUMBNAILS_H
+
+
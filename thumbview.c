@@ -0,0 +1,602 @@
+#include "thumbview.h"
+#include "config.h"
+#include "thumbnails.h"
+
+#define THUMB_PADDING 8
+#define THUMB_LABEL_HEIGHT 24
+#define THUMB_CELL_WIDTH (VNR_THUMBNAIL_SIZE + 2 * THUMB_PADDING)
+#define THUMB_CELL_HEIGHT (THUMB_CELL_WIDTH + THUMB_LABEL_HEIGHT)
+
+struct _VnrThumbView
+{
+    GtkDrawingArea __parent__;
+
+    // not owned, see vnr_thumb_view_set_list
+    VnrFileList *list;
+    VnrThumbnails *thumbs;
+
+    gint cursor;
+    gint columns;
+
+    // cells drawn last time, from first to last excluded
+    gint first;
+    gint last;
+
+    GtkAdjustment *hadjustment;
+    GtkAdjustment *vadjustment;
+    GtkScrollablePolicy hscroll_policy;
+    GtkScrollablePolicy vscroll_policy;
+};
+
+enum
+{
+    PROP_0,
+    PROP_HADJUSTMENT,
+    PROP_VADJUSTMENT,
+    PROP_HSCROLL_POLICY,
+    PROP_VSCROLL_POLICY,
+};
+
+enum
+{
+    SIGNAL_ACTIVATED,
+    SIGNAL_COUNT,
+};
+
+static guint _thumb_view_signals[SIGNAL_COUNT] = {0};
+
+G_DEFINE_TYPE_WITH_CODE(VnrThumbView, vnr_thumb_view, GTK_TYPE_DRAWING_AREA,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_SCROLLABLE, NULL))
+
+static void vnr_thumb_view_dispose(GObject *object);
+static void _thumb_view_set_property(GObject *object, guint prop_id,
+                                     const GValue *value,
+                                     GParamSpec *pspec);
+static void _thumb_view_get_property(GObject *object, guint prop_id,
+                                     GValue *value, GParamSpec *pspec);
+static void _thumb_view_set_adjustment(VnrThumbView *view,
+                                       GtkAdjustment **slot,
+                                       GtkAdjustment *adjustment);
+static void _thumb_view_update_adjustments(VnrThumbView *view);
+static void _thumb_view_on_ready(const gchar *path, gpointer user_data);
+static void _thumb_view_size_allocate(GtkWidget *widget,
+                                      GtkAllocation *allocation);
+static gboolean _thumb_view_draw(GtkWidget *widget, cairo_t *cr);
+static void _thumb_view_draw_cell(VnrThumbView *view, cairo_t *cr,
+                                  PangoLayout *layout, gint index,
+                                  gint x, gint y);
+static gboolean _thumb_view_button_press(GtkWidget *widget,
+                                         GdkEventButton *event);
+static gboolean _thumb_view_key_press(GtkWidget *widget, GdkEventKey *event);
+static gint _thumb_view_get_margin(VnrThumbView *view);
+static gdouble _thumb_view_get_offset(VnrThumbView *view);
+static gint _thumb_view_get_index_at(VnrThumbView *view, gdouble x, gdouble y);
+static void _thumb_view_set_cursor(VnrThumbView *view, gint index);
+static void _thumb_view_scroll_to(VnrThumbView *view, gint index);
+
+
+// creation -------------------------------------------------------------------
+
+GtkWidget* vnr_thumb_view_new()
+{
+    return (GtkWidget*) g_object_new(VNR_TYPE_THUMB_VIEW, NULL);
+}
+
+static void vnr_thumb_view_class_init(VnrThumbViewClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->dispose = vnr_thumb_view_dispose;
+    object_class->set_property = _thumb_view_set_property;
+    object_class->get_property = _thumb_view_get_property;
+
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+    widget_class->size_allocate = _thumb_view_size_allocate;
+    widget_class->draw = _thumb_view_draw;
+    widget_class->button_press_event = _thumb_view_button_press;
+    widget_class->key_press_event = _thumb_view_key_press;
+
+    g_object_class_override_property(object_class, PROP_HADJUSTMENT,
+                                     "hadjustment");
+    g_object_class_override_property(object_class, PROP_VADJUSTMENT,
+                                     "vadjustment");
+    g_object_class_override_property(object_class, PROP_HSCROLL_POLICY,
+                                     "hscroll-policy");
+    g_object_class_override_property(object_class, PROP_VSCROLL_POLICY,
+                                     "vscroll-policy");
+
+    // a file was double clicked or chosen with Return
+    _thumb_view_signals[SIGNAL_ACTIVATED] =
+        g_signal_new("activated",
+                     G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     0, NULL, NULL,
+                     g_cclosure_marshal_VOID__INT,
+                     G_TYPE_NONE, 1, G_TYPE_INT);
+}
+
+static void vnr_thumb_view_init(VnrThumbView *view)
+{
+    view->thumbs = vnr_thumbnails_new(_thumb_view_on_ready, view);
+
+    view->cursor = -1;
+    view->columns = 1;
+    view->first = -1;
+    view->last = -1;
+
+    gtk_widget_set_can_focus(GTK_WIDGET(view), TRUE);
+    gtk_widget_add_events(GTK_WIDGET(view),
+                          GDK_BUTTON_PRESS_MASK | GDK_KEY_PRESS_MASK);
+}
+
+static void vnr_thumb_view_dispose(GObject *object)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(object);
+
+    vnr_thumbnails_free(view->thumbs);
+    view->thumbs = NULL;
+    view->list = NULL;
+
+    if (view->hadjustment)
+        g_signal_handlers_disconnect_by_data(view->hadjustment, view);
+
+    if (view->vadjustment)
+        g_signal_handlers_disconnect_by_data(view->vadjustment, view);
+
+    g_clear_object(&view->hadjustment);
+    g_clear_object(&view->vadjustment);
+
+    G_OBJECT_CLASS(vnr_thumb_view_parent_class)->dispose(object);
+}
+
+
+// GtkScrollable --------------------------------------------------------------
+
+static void _thumb_view_set_property(GObject *object, guint prop_id,
+                                     const GValue *value,
+                                     GParamSpec *pspec)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(object);
+
+    switch (prop_id)
+    {
+    case PROP_HADJUSTMENT:
+        _thumb_view_set_adjustment(view, &view->hadjustment,
+                                   g_value_get_object(value));
+        break;
+
+    case PROP_VADJUSTMENT:
+        _thumb_view_set_adjustment(view, &view->vadjustment,
+                                   g_value_get_object(value));
+        break;
+
+    case PROP_HSCROLL_POLICY:
+        view->hscroll_policy = g_value_get_enum(value);
+        break;
+
+    case PROP_VSCROLL_POLICY:
+        view->vscroll_policy = g_value_get_enum(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void _thumb_view_get_property(GObject *object, guint prop_id,
+                                     GValue *value, GParamSpec *pspec)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(object);
+
+    switch (prop_id)
+    {
+    case PROP_HADJUSTMENT:
+        g_value_set_object(value, view->hadjustment);
+        break;
+
+    case PROP_VADJUSTMENT:
+        g_value_set_object(value, view->vadjustment);
+        break;
+
+    case PROP_HSCROLL_POLICY:
+        g_value_set_enum(value, view->hscroll_policy);
+        break;
+
+    case PROP_VSCROLL_POLICY:
+        g_value_set_enum(value, view->vscroll_policy);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void _thumb_view_set_adjustment(VnrThumbView *view,
+                                       GtkAdjustment **slot,
+                                       GtkAdjustment *adjustment)
+{
+    if (adjustment && *slot == adjustment)
+        return;
+
+    if (*slot)
+    {
+        g_signal_handlers_disconnect_by_data(*slot, view);
+        g_object_unref(*slot);
+    }
+
+    if (!adjustment)
+        adjustment = gtk_adjustment_new(0, 0, 0, 0, 0, 0);
+
+    *slot = g_object_ref_sink(adjustment);
+
+    g_signal_connect_swapped(adjustment, "value-changed",
+                             G_CALLBACK(gtk_widget_queue_draw), view);
+
+    _thumb_view_update_adjustments(view);
+}
+
+static void _thumb_view_update_adjustments(VnrThumbView *view)
+{
+    // The grid scrolls vertically only, one row after the other.
+
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(GTK_WIDGET(view), &allocation);
+
+    if (view->hadjustment)
+    {
+        gtk_adjustment_configure(view->hadjustment, 0, 0,
+                                 allocation.width, 1,
+                                 allocation.width, allocation.width);
+    }
+
+    if (!view->vadjustment)
+        return;
+
+    gint length = vnr_list_length(view->list);
+    gint rows = (length + view->columns - 1) / view->columns;
+
+    gdouble page = allocation.height;
+    gdouble upper = MAX(rows * THUMB_CELL_HEIGHT, page);
+    gdouble value = CLAMP(gtk_adjustment_get_value(view->vadjustment),
+                          0, upper - page);
+
+    gtk_adjustment_configure(view->vadjustment, value, 0, upper,
+                             THUMB_CELL_HEIGHT / 4.0, page * 0.9, page);
+}
+
+
+// public ---------------------------------------------------------------------
+
+void vnr_thumb_view_set_list(VnrThumbView *view, VnrFileList *list)
+{
+    // The list stays owned by the caller, who sets it again before
+    // freeing it.
+
+    g_return_if_fail(view != NULL);
+
+    view->list = list;
+    view->cursor = list ? vnr_list_get_index(list) : -1;
+
+    vnr_thumb_view_update(view);
+
+    if (view->cursor >= 0)
+        _thumb_view_scroll_to(view, view->cursor);
+}
+
+void vnr_thumb_view_update(VnrThumbView *view)
+{
+    // To be called when files were added, removed or sorted.
+
+    g_return_if_fail(view != NULL);
+
+    gint length = vnr_list_length(view->list);
+
+    if (view->cursor >= length)
+        view->cursor = length - 1;
+
+    // the files in view may not be the same anymore
+    view->first = -1;
+    view->last = -1;
+
+    _thumb_view_update_adjustments(view);
+    gtk_widget_queue_draw(GTK_WIDGET(view));
+}
+
+gint vnr_thumb_view_get_cursor(VnrThumbView *view)
+{
+    g_return_val_if_fail(view != NULL, -1);
+
+    return view->cursor;
+}
+
+static void _thumb_view_on_ready(const gchar *path, gpointer user_data)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(user_data);
+
+    gint index = vnr_list_find(view->list, path);
+
+    if (index >= view->first && index < view->last)
+        gtk_widget_queue_draw(GTK_WIDGET(view));
+}
+
+
+// drawing --------------------------------------------------------------------
+
+static void _thumb_view_size_allocate(GtkWidget *widget,
+                                      GtkAllocation *allocation)
+{
+    GTK_WIDGET_CLASS(vnr_thumb_view_parent_class)->size_allocate(widget,
+                                                                 allocation);
+
+    VnrThumbView *view = VNR_THUMB_VIEW(widget);
+    view->columns = MAX(1, allocation->width / THUMB_CELL_WIDTH);
+
+    _thumb_view_update_adjustments(view);
+}
+
+static gboolean _thumb_view_draw(GtkWidget *widget, cairo_t *cr)
+{
+    // Only the rows in view are drawn and their thumbnails requested, the
+    // next page is requested after them so that it's ready when
+    // scrolling. A new round of requests starts when the rows change.
+
+    VnrThumbView *view = VNR_THUMB_VIEW(widget);
+    GtkStyleContext *context = gtk_widget_get_style_context(widget);
+
+    gint width = gtk_widget_get_allocated_width(widget);
+    gint height = gtk_widget_get_allocated_height(widget);
+
+    gtk_render_background(context, cr, 0, 0, width, height);
+
+    gint length = vnr_list_length(view->list);
+    if (length == 0)
+        return FALSE;
+
+    gdouble offset = _thumb_view_get_offset(view);
+    gint columns = view->columns;
+
+    gint first = (gint) (offset / THUMB_CELL_HEIGHT) * columns;
+    gint last = ((gint) ((offset + height) / THUMB_CELL_HEIGHT) + 1)
+                * columns;
+    last = MIN(last, length);
+
+    if (first != view->first || last != view->last)
+    {
+        vnr_thumbnails_begin(view->thumbs);
+        view->first = first;
+        view->last = last;
+    }
+
+    PangoLayout *layout = gtk_widget_create_pango_layout(widget, NULL);
+    pango_layout_set_width(layout,
+                           (THUMB_CELL_WIDTH - 2 * THUMB_PADDING)
+                           * PANGO_SCALE);
+    pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_MIDDLE);
+    pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
+
+    gint margin = _thumb_view_get_margin(view);
+
+    for (gint i = first; i < last; ++i)
+    {
+        gint x = margin + (i % columns) * THUMB_CELL_WIDTH;
+        gint y = (i / columns) * THUMB_CELL_HEIGHT - (gint) offset;
+
+        _thumb_view_draw_cell(view, cr, layout, i, x, y);
+    }
+
+    g_object_unref(layout);
+
+    gint ahead = MIN(last + (last - first), length);
+
+    for (gint i = last; i < ahead; ++i)
+    {
+        VnrFile *file = vnr_list_get(view->list, i);
+        gboolean failed = FALSE;
+
+        if (!vnr_thumbnails_lookup(view->thumbs, file, &failed) && !failed)
+            vnr_thumbnails_request(view->thumbs, file, i - first);
+    }
+
+    return FALSE;
+}
+
+static void _thumb_view_draw_cell(VnrThumbView *view, cairo_t *cr,
+                                  PangoLayout *layout, gint index,
+                                  gint x, gint y)
+{
+    GtkStyleContext *context =
+                        gtk_widget_get_style_context(GTK_WIDGET(view));
+    VnrFile *file = vnr_list_get(view->list, index);
+
+    if (index == view->cursor)
+    {
+        GdkRGBA color = {0.2, 0.4, 0.8, 1.0};
+        gtk_style_context_lookup_color(context, "theme_selected_bg_color",
+                                       &color);
+
+        gdk_cairo_set_source_rgba(cr, &color);
+        cairo_rectangle(cr, x, y, THUMB_CELL_WIDTH, THUMB_CELL_HEIGHT);
+        cairo_fill(cr);
+    }
+
+    gboolean failed = FALSE;
+    GdkPixbuf *pixbuf = vnr_thumbnails_lookup(view->thumbs, file, &failed);
+
+    if (pixbuf)
+    {
+        gint width = gdk_pixbuf_get_width(pixbuf);
+        gint height = gdk_pixbuf_get_height(pixbuf);
+
+        gdk_cairo_set_source_pixbuf(
+                    cr, pixbuf,
+                    x + (THUMB_CELL_WIDTH - width) / 2,
+                    y + THUMB_PADDING + (VNR_THUMBNAIL_SIZE - height) / 2);
+        cairo_paint(cr);
+    }
+    else
+    {
+        if (!failed)
+            vnr_thumbnails_request(view->thumbs, file, index - view->first);
+
+        gtk_render_frame(context, cr,
+                         x + THUMB_PADDING, y + THUMB_PADDING,
+                         VNR_THUMBNAIL_SIZE, VNR_THUMBNAIL_SIZE);
+    }
+
+    pango_layout_set_text(layout, file->display_name, -1);
+    gtk_render_layout(context, cr,
+                      x + THUMB_PADDING, y + THUMB_CELL_WIDTH, layout);
+}
+
+static gint _thumb_view_get_margin(VnrThumbView *view)
+{
+    gint width = gtk_widget_get_allocated_width(GTK_WIDGET(view));
+
+    return MAX(0, (width - view->columns * THUMB_CELL_WIDTH) / 2);
+}
+
+static gdouble _thumb_view_get_offset(VnrThumbView *view)
+{
+    if (!view->vadjustment)
+        return 0;
+
+    return gtk_adjustment_get_value(view->vadjustment);
+}
+
+
+// events ---------------------------------------------------------------------
+
+static gboolean _thumb_view_button_press(GtkWidget *widget,
+                                         GdkEventButton *event)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(widget);
+
+    if (event->button != 1)
+        return FALSE;
+
+    gtk_widget_grab_focus(widget);
+
+    gint index = _thumb_view_get_index_at(view, event->x, event->y);
+    if (index < 0)
+        return TRUE;
+
+    _thumb_view_set_cursor(view, index);
+
+    if (event->type == GDK_2BUTTON_PRESS)
+        g_signal_emit(view, _thumb_view_signals[SIGNAL_ACTIVATED], 0, index);
+
+    return TRUE;
+}
+
+static gboolean _thumb_view_key_press(GtkWidget *widget, GdkEventKey *event)
+{
+    VnrThumbView *view = VNR_THUMB_VIEW(widget);
+
+    gint length = vnr_list_length(view->list);
+    if (length == 0)
+        return FALSE;
+
+    gint cursor = MAX(view->cursor, 0);
+    gint columns = view->columns;
+
+    gint height = gtk_widget_get_allocated_height(widget);
+    gint page = MAX(1, height / THUMB_CELL_HEIGHT) * columns;
+
+    switch (event->keyval)
+    {
+    case GDK_KEY_Left:
+        cursor -= 1;
+        break;
+
+    case GDK_KEY_Right:
+        cursor += 1;
+        break;
+
+    case GDK_KEY_Up:
+        cursor -= columns;
+        break;
+
+    case GDK_KEY_Down:
+        cursor += columns;
+        break;
+
+    case GDK_KEY_Page_Up:
+        cursor -= page;
+        break;
+
+    case GDK_KEY_Page_Down:
+        cursor += page;
+        break;
+
+    case GDK_KEY_Home:
+        cursor = 0;
+        break;
+
+    case GDK_KEY_End:
+        cursor = length - 1;
+        break;
+
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter:
+    case GDK_KEY_space:
+        g_signal_emit(view, _thumb_view_signals[SIGNAL_ACTIVATED], 0,
+                      cursor);
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+
+    _thumb_view_set_cursor(view, CLAMP(cursor, 0, length - 1));
+
+    return TRUE;
+}
+
+static gint _thumb_view_get_index_at(VnrThumbView *view, gdouble x, gdouble y)
+{
+    gint margin = _thumb_view_get_margin(view);
+
+    if (x < margin)
+        return -1;
+
+    gint column = (x - margin) / THUMB_CELL_WIDTH;
+    gint row = (y + _thumb_view_get_offset(view)) / THUMB_CELL_HEIGHT;
+
+    if (column >= view->columns)
+        return -1;
+
+    gint index = row * view->columns + column;
+
+    if (index >= vnr_list_length(view->list))
+        return -1;
+
+    return index;
+}
+
+static void _thumb_view_set_cursor(VnrThumbView *view, gint index)
+{
+    view->cursor = index;
+
+    _thumb_view_scroll_to(view, index);
+    gtk_widget_queue_draw(GTK_WIDGET(view));
+}
+
+static void _thumb_view_scroll_to(VnrThumbView *view, gint index)
+{
+    if (!view->vadjustment)
+        return;
+
+    gdouble top = (index / view->columns) * THUMB_CELL_HEIGHT;
+    gdouble bottom = top + THUMB_CELL_HEIGHT;
+
+    gdouble value = gtk_adjustment_get_value(view->vadjustment);
+    gdouble page = gtk_adjustment_get_page_size(view->vadjustment);
+
+    if (top < value)
+        gtk_adjustment_set_value(view->vadjustment, top);
+    else if (bottom > value + page)
+        gtk_adjustment_set_value(view->vadjustment, bottom - page);
+}
+
+
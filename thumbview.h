@@ -0,0 +1,25 @@
+#ifndef THUMBVIEW_H
+#define THUMBVIEW_H
+
+#include "list.h"
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+// Grid of the thumbnails of a file list, only the visible cells are drawn.
+// Meant to be put in a GtkScrolledWindow.
+#define VNR_TYPE_THUMB_VIEW (vnr_thumb_view_get_type())
+G_DECLARE_FINAL_TYPE(VnrThumbView, vnr_thumb_view, VNR, THUMB_VIEW,
+                     GtkDrawingArea)
+
+GtkWidget* vnr_thumb_view_new();
+
+void vnr_thumb_view_set_list(VnrThumbView *view, VnrFileList *list);
+void vnr_thumb_view_update(VnrThumbView *view);
+gint vnr_thumb_view_get_cursor(VnrThumbView *view);
+
+G_END_DECLS
+
+#endif // THUMBVIEW_H
+
+
@@ -30,6 +30,9 @@
 #include "uni-utils.h"
 #include "dialog.h"
 #include "list.h"
+#include "loader.h"
+#include "preview.h"
+#include "thumbview.h"
 
 #include <etkaction.h>
 #include <sys/stat.h>
@@ -37,6 +40,11 @@
 
 // Timeout to hide the toolbar in fullscreen mode
 #define FULLSCREEN_TIMEOUT 1000
+
+// Folder changes are applied at most this often (ms), and this many paths
+// at a time.
+#define MONITOR_DELAY 500
+#define MONITOR_BATCH 1024
 #define DARK_BACKGROUND_COLOR "#222222"
 
 G_DEFINE_TYPE(VnrWindow, window, GTK_TYPE_WINDOW)
@@ -46,6 +54,7 @@ G_DEFINE_TYPE(VnrWindow, window, GTK_TYPE_WINDOW)
 static void window_class_init(VnrWindowClass *klass);
 static void window_init(VnrWindow *window);
 static void _window_on_realize(VnrWindow *window, gpointer user_data);
+static void _window_start(VnrWindow *window);
 static void _window_load_accel_map();
 
 // dnd ------------------------------------------------------------------------
@@ -81,21 +90,62 @@ static void _view_on_zoom_changed(UniImageView *view, VnrWindow *window);
 
 // open / close ---------------------------------------------------------------
 
-static void _window_set_monitor(VnrWindow *window, GList *current);
+static void _window_set_monitor(VnrWindow *window, VnrFile *current);
+static void _window_list_scan_dir(VnrWindow *window,
+                                  const gchar *directory);
+static void _window_list_scan_stop(VnrWindow *window);
+static void _window_on_scan_batch(GPtrArray *batch, VnrListOrder order,
+                                  gpointer user_data);
+static void _window_on_list_changed(VnrWindow *window);
+static void _window_read_dates(VnrWindow *window);
+static void _window_read_dates_stop(VnrWindow *window);
+static void _window_on_dates_read(GObject *source, GAsyncResult *result,
+                                  gpointer user_data);
+static GtkWidget* _window_sort_menu_new(VnrWindow *window);
+static void _window_on_sort_toggled(GtkCheckMenuItem *item,
+                                    VnrWindow *window);
+static void _window_on_scan_done(GObject *source, GAsyncResult *result,
+                                 gpointer user_data);
 static void _window_monitor_on_change(VnrWindow *window,
                                       GFile *event_file,
                                       GFile *other_file,
                                       GFileMonitorEvent event_type,
                                       GFileMonitor *monitor);
+static void _window_monitor_queue(VnrWindow *window, gchar *path);
+static gboolean _window_on_monitor_timeout(VnrWindow *window);
 static gboolean _window_on_idle_reload(VnrWindow *window);
 static void _window_action_openfile(VnrWindow *window, GtkWidget *widget);
 static void _on_update_preview(GtkFileChooser *file_chooser, gpointer data);
+static void _update_preview_thread(GTask *task, gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable *cancellable);
+static void _on_preview_loaded(GObject *source, GAsyncResult *result,
+                               gpointer user_data);
+static void _cancel_preview(GtkWidget *preview, gpointer data);
 static gboolean _file_size_is_small(char *filename);
 static void _window_action_opendir(VnrWindow *window, GtkWidget *widget);
 static void _on_file_open_dialog_response(GtkWidget *dialog,
                                           gint response_id,
                                           VnrWindow *window);
+static void _window_on_load_progress(GdkPixbuf *pixbuf,
+                                     const GdkRectangle *area,
+                                     gpointer user_data);
+static void _window_on_file_loaded(GObject *source, GAsyncResult *result,
+                                   gpointer user_data);
+static void _window_set_zoom_mode(VnrWindow *window,
+                                  UniFittingMode last_fit_mode);
+static gint _window_get_decode_size(VnrWindow *window);
+static gboolean _window_needs_full(VnrWindow *window);
+static void _window_load_full(VnrWindow *window);
+static void _window_on_full_loaded(GObject *source, GAsyncResult *result,
+                                   gpointer user_data);
+static void _window_set_full_image(VnrWindow *window, VnrImage *image);
+static gboolean _window_ensure_full(VnrWindow *window, WindowEdit edit);
+static void _window_apply_edit(VnrWindow *window, WindowEdit edit);
+static gboolean _window_is_loading(VnrWindow *window);
 static void _window_update_fs_filename_label(VnrWindow *window);
+static void _window_prefetch(VnrWindow *window);
+static void _window_uncache(VnrWindow *window, const gchar *path);
 static void _action_resize(VnrWindow *window, GtkWidget *widget);
 static void _window_update_openwith_menu(VnrWindow *window);
 static void _on_openwith(VnrWindow *window, gpointer user_data);
@@ -145,6 +195,14 @@ static void _window_slideshow_start(VnrWindow *window);
 static void _window_slideshow_allow(VnrWindow *window);
 void window_slideshow_deny(VnrWindow *window);
 
+// thumbnails -----------------------------------------------------------------
+
+static void _window_action_thumbnails(VnrWindow *window, GtkWidget *widget);
+static void _window_thumbnails_show(VnrWindow *window);
+static void _window_thumbnails_hide(VnrWindow *window);
+static void _window_on_thumb_activated(VnrThumbView *view, gint index,
+                                       VnrWindow *window);
+
 // fullscreen -----------------------------------------------------------------
 
 static void _window_fullscreen(VnrWindow *window);
@@ -189,6 +247,7 @@ typedef enum
     WINDOW_ACTION_ZOOM_FIT,
     WINDOW_ACTION_SLIDESHOW,
     WINDOW_ACTION_FULLSCREEN,
+    WINDOW_ACTION_THUMBNAILS,
     WINDOW_ACTION_ITEM6,
     WINDOW_ACTION_ITEM7,
     WINDOW_ACTION_ITEM8,
@@ -330,6 +389,13 @@ static EtkActionEntry _window_actions[] =
      NULL,
      G_CALLBACK(window_fullscreen_toggle)},
 
+    {WINDOW_ACTION_THUMBNAILS,
+     "<Actions>/AppWindow/Thumbnails", "<Control>T",
+     ETK_MENU_ITEM, N_("_Thumbnails"),
+     N_("Browse the images as thumbnails"),
+     NULL,
+     G_CALLBACK(_window_action_thumbnails)},
+
     {0},
 };
 
@@ -364,6 +430,14 @@ static void window_init(VnrWindow *window)
     window->sl_timeout = 5;
     window->can_slideshow = TRUE;
 
+    window->cache = vnr_image_cache_new(
+                        (gsize) window->prefs->cache_size * 1024 * 1024);
+    window->prefetch = vnr_prefetch_new(window->cache);
+    window->prefetch_forward = TRUE;
+
+    window->monitor_pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free, NULL);
+
     gtk_window_set_title((GtkWindow*) window, "Viewnior");
     gtk_window_set_default_icon_name("viewnior");
 
@@ -449,6 +523,16 @@ static void window_init(VnrWindow *window)
 
     etk_menu_append_separator(GTK_MENU_SHELL(menu));
 
+    etk_menu_item_new_from_action(GTK_MENU_SHELL(menu),
+                                  WINDOW_ACTION_THUMBNAILS,
+                                  _window_actions,
+                                  G_OBJECT(window));
+
+    item = gtk_menu_item_new_with_mnemonic(_("_Sort By"));
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(item),
+                              _window_sort_menu_new(window));
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+
     etk_menu_item_new_from_action(GTK_MENU_SHELL(menu),
                                   WINDOW_ACTION_PREFERENCES,
                                   _window_actions,
@@ -489,6 +573,21 @@ static void window_init(VnrWindow *window)
                      window->scroll_view, TRUE, TRUE, 0);
     gtk_widget_show_all(GTK_WIDGET(window->scroll_view));
 
+    // thumbnail grid, shown instead of the scroll view
+    window->thumb_view = vnr_thumb_view_new();
+    window->thumb_scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(window->thumb_scroll),
+                                   GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(window->thumb_scroll),
+                      window->thumb_view);
+    gtk_widget_show(window->thumb_view);
+    gtk_widget_set_no_show_all(window->thumb_scroll, TRUE);
+    gtk_box_pack_end(GTK_BOX(window->layout_box),
+                     window->thumb_scroll, TRUE, TRUE, 0);
+
+    g_signal_connect(window->thumb_view, "activated",
+                     G_CALLBACK(_window_on_thumb_activated), window);
+
     gtk_widget_grab_focus(window->view);
 
     // Initialize slideshow timeout
@@ -539,7 +638,7 @@ static void _window_on_realize(VnrWindow *window, gpointer user_data)
     if (prefs->start_maximized)
     {
         if (window_load_file(window, FALSE))
-            _window_set_monitor(window, window->filelist);
+            _window_set_monitor(window, window_get_current_file(window));
     }
     else
     {
@@ -558,13 +657,22 @@ static void _window_on_realize(VnrWindow *window, gpointer user_data)
         //printf("w = %d, h = %d\n", geometry.width, geometry.height);
 
         if (window_load_file(window, false)) // don't fit to screen
-            _window_set_monitor(window, window->filelist);
+            _window_set_monitor(window, window_get_current_file(window));
     }
 
-    VnrFile *current = window_get_current_file(window);
-
-    if (!current)
+    // a directory opened is still being listed
+    if (!window_get_current_file(window))
+    {
+        window->open_start = (window->open_directory != NULL);
         return;
+    }
+
+    _window_start(window);
+}
+
+static void _window_start(VnrWindow *window)
+{
+    VnrPrefs *prefs = window->prefs;
 
     if (prefs->start_fullscreen)
     {
@@ -769,6 +877,14 @@ static void window_dispose(GObject *object)
     VnrWindow *window = VNR_WINDOW(object);
 
     _window_set_monitor(window, NULL);
+    _window_list_scan_stop(window);
+
+    if (window->load_cancellable)
+    {
+        g_cancellable_cancel(window->load_cancellable);
+        g_clear_object(&window->load_cancellable);
+    }
+
     window->accel_group = etk_actions_dispose(GTK_WINDOW(window),
                                               window->accel_group);
     window->list_image = etk_widget_list_free(window->list_image);
@@ -781,8 +897,13 @@ static void window_finalize(GObject *object)
     VnrWindow *window = VNR_WINDOW(object);
 
     g_free(window->destdir);
-    vnr_list_free(window->filelist);
-    window_list_set_current(window, NULL);
+    g_free(window->open_directory);
+    window->filelist = vnr_list_free(window->filelist);
+    vnr_prefetch_free(window->prefetch);
+    vnr_image_cache_free(window->cache);
+    g_clear_object(&window->image);
+    g_free(window->openwith_type);
+    g_hash_table_destroy(window->monitor_pending);
 
     G_OBJECT_CLASS(window_parent_class)->finalize(object);
 }
@@ -797,6 +918,19 @@ static gint _window_on_key_press(GtkWidget *widget, GdkEventKey *event)
     VnrWindow *window = VNR_WINDOW(widget);
     gint result = FALSE;
 
+    // the thumbnail grid handles its keys itself
+    if (gtk_widget_get_visible(window->thumb_scroll))
+    {
+        if (event->keyval == GDK_KEY_Escape)
+        {
+            _window_thumbnails_hide(window);
+            return TRUE;
+        }
+
+        return GTK_WIDGET_CLASS(window_parent_class)->key_press_event(
+                                                            widget, event);
+    }
+
     GtkWidget *toolbar_focus_child = NULL;
     GtkWidget *msg_area_focus_child = gtk_container_get_focus_child(
                                             GTK_CONTAINER(window->msg_area));
@@ -936,9 +1070,20 @@ static void _view_on_zoom_changed(UniImageView *view, VnrWindow *window)
     if (!current)
         return;
 
+    if (_window_needs_full(window))
+        _window_load_full(window);
+
     gint total = 0;
     gint position = vnr_list_get_position(window->filelist, &total);
 
+    // relative to the file when the pixels were decoded at a lower size
+    gdouble zoom = view->zoom;
+    GdkPixbuf *pixbuf = uni_image_view_get_pixbuf(view);
+
+    if (pixbuf && window->current_image_width > 0)
+        zoom = zoom * gdk_pixbuf_get_width(pixbuf)
+               / window->current_image_width;
+
     char *buf = g_strdup_printf("%s%s - %i/%i - %ix%i - %i%%",
                                 (window->modifications) ? "*" : "",
                                 current->display_name,
@@ -946,7 +1091,7 @@ static void _view_on_zoom_changed(UniImageView *view, VnrWindow *window)
                                 total,
                                 window->current_image_width,
                                 window->current_image_height,
-                                (int) (view->zoom * 100.));
+                                (int) (zoom * 100.));
 
     gtk_window_set_title(GTK_WINDOW(window), buf);
 
@@ -963,15 +1108,35 @@ static void _view_on_zoom_changed(UniImageView *view, VnrWindow *window)
 
 // file list ------------------------------------------------------------------
 
-void window_list_set(VnrWindow *window, GList *list)
+void window_list_set(VnrWindow *window, VnrFileList *list)
 {
     if (list != window->filelist)
     {
+        // the scan of a directory being opened makes the first list
+        if (window->filelist || !window->open_directory)
+            _window_list_scan_stop(window);
+
+        _window_read_dates_stop(window);
         vnr_list_free(window->filelist);
-        window_list_set_current(window, NULL);
     }
 
-    if (list && g_list_length(g_list_first(list)) > 1)
+    if (!list)
+    {
+        _window_set_monitor(window, NULL);
+        _window_thumbnails_hide(window);
+    }
+
+    vnr_thumb_view_set_list(VNR_THUMB_VIEW(window->thumb_view), list);
+
+    window->filelist = list;
+
+    if (list)
+    {
+        vnr_list_set_order(list, window->prefs->sort_order);
+        _window_read_dates(window);
+    }
+
+    if (vnr_list_length(list) > 1)
     {
         //gtk_action_group_set_sensitive(window->actions_collection, true);
 
@@ -983,62 +1148,359 @@ void window_list_set(VnrWindow *window, GList *list)
 
         window_slideshow_deny(window);
     }
-
-    window_list_set_current(window, list);
 }
 
 VnrFile* window_get_current_file(VnrWindow *window)
 {
     g_return_val_if_fail(window != NULL, NULL);
 
+    return vnr_list_get_current(window->filelist);
+}
+
+void window_list_set_current(VnrWindow *window, gint index)
+{
+    g_return_if_fail(window != NULL);
+
     if (!window->filelist)
-        return NULL;
+        return;
 
-    return VNR_FILE(window->filelist->data);
+    vnr_list_set_index(window->filelist, index);
 }
 
-void window_list_set_current(VnrWindow *window, GList *list)
+void window_list_scan(VnrWindow *window)
 {
+    // When a single file was opened, the other files of its directory are
+    // listed in the background and merged into the list as they come, the
+    // file itself is displayed without waiting for them.
+
     g_return_if_fail(window != NULL);
 
-    window->filelist = list;
+    if (vnr_list_length(window->filelist) != 1)
+        return;
+
+    VnrFile *current = window_get_current_file(window);
+    gchar *directory = g_path_get_dirname(current->path);
+
+    _window_list_scan_stop(window);
+    _window_list_scan_dir(window, directory);
+
+    g_free(directory);
 }
 
-static void _window_set_monitor(VnrWindow *window, GList *current)
+void window_open_dir(VnrWindow *window, const gchar *directory)
 {
+    // Nothing is listed here, the list is made of the first batch of the
+    // scan and its first image displayed as soon as it comes.
+
+    g_return_if_fail(window != NULL && directory != NULL);
+
+    _window_set_monitor(window, NULL);
+    _window_list_scan_stop(window);
+
+    window_close_file(window);
+    window_list_set(window, NULL);
+
+    window->open_directory = g_strdup(directory);
+
+    _window_list_scan_dir(window, directory);
+}
+
+static void _window_list_scan_dir(VnrWindow *window, const gchar *directory)
+{
+    window->scan_cancellable = g_cancellable_new();
+
+    vnr_list_scan_dir_async(directory,
+                            window->prefs->show_hidden,
+                            window->prefs->sort_order,
+                            window->scan_cancellable,
+                            _window_on_scan_batch,
+                            _window_on_scan_done,
+                            g_object_ref(window));
+}
+
+static void _window_list_scan_stop(VnrWindow *window)
+{
+    window->open_start = FALSE;
+    g_clear_pointer(&window->open_directory, g_free);
+
+    if (!window->scan_cancellable)
+        return;
+
+    g_cancellable_cancel(window->scan_cancellable);
+    g_clear_object(&window->scan_cancellable);
+}
+
+static void _window_on_scan_batch(GPtrArray *batch, VnrListOrder order,
+                                  gpointer user_data)
+{
+    VnrWindow *window = VNR_WINDOW(user_data);
+
+    if (!window->filelist && window->open_directory)
+    {
+        window_list_set(window,
+                        vnr_list_new_for_batch(batch, order,
+                                               window->open_directory));
+        g_clear_pointer(&window->open_directory, g_free);
+
+        if (window_load_file(window, FALSE))
+            _window_set_monitor(window, window_get_current_file(window));
+
+        if (window->open_start)
+        {
+            window->open_start = FALSE;
+            _window_start(window);
+        }
+
+        return;
+    }
+
+    if (!window->filelist)
+    {
+        g_ptr_array_unref(batch);
+        return;
+    }
+
+    vnr_list_merge(window->filelist, batch, order);
+
+    _window_on_list_changed(window);
+}
+
+static void _window_on_list_changed(VnrWindow *window)
+{
+    vnr_thumb_view_update(VNR_THUMB_VIEW(window->thumb_view));
+
+    if (window->mode != WINDOW_MODE_SLIDESHOW
+        && vnr_list_length(window->filelist) > 1)
+        _window_slideshow_allow(window);
+
+    // the title is set once the file is loaded otherwise
+    if (!_window_is_loading(window))
+        _view_on_zoom_changed(UNI_IMAGE_VIEW(window->view), window);
+
+    _window_update_fs_filename_label(window);
+
+    _window_read_dates(window);
+}
+
+static void _window_read_dates(VnrWindow *window)
+{
+    // Capture dates are read in the background and the list sorted again
+    // when they arrive. One reading at a time, a request made meanwhile
+    // is served once it's done.
+
+    if (!window->filelist
+        || vnr_list_get_order(window->filelist) != VNR_LIST_ORDER_TAKEN)
+        return;
+
+    if (window->dates_cancellable)
+    {
+        window->dates_again = TRUE;
+        return;
+    }
+
+    window->dates_cancellable = g_cancellable_new();
+
+    vnr_list_read_dates_async(window->filelist,
+                              window->dates_cancellable,
+                              _window_on_dates_read,
+                              g_object_ref(window));
+}
+
+static void _window_read_dates_stop(VnrWindow *window)
+{
+    window->dates_again = FALSE;
+
+    if (!window->dates_cancellable)
+        return;
+
+    g_cancellable_cancel(window->dates_cancellable);
+    g_clear_object(&window->dates_cancellable);
+}
+
+static void _window_on_dates_read(GObject *source, GAsyncResult *result,
+                                  gpointer user_data)
+{
+    (void) source;
+
+    VnrWindow *window = VNR_WINDOW(user_data);
+    GError *error = NULL;
+
+    gboolean changed = vnr_list_read_dates_finish(window->filelist, result,
+                                                  &error);
+
+    // the list was replaced meanwhile
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+        g_error_free(error);
+        g_object_unref(window);
+
+        return;
+    }
+
+    g_clear_error(&error);
+    g_clear_object(&window->dates_cancellable);
+
+    if (changed)
+    {
+        _window_on_list_changed(window);
+        _window_prefetch(window);
+    }
+
+    if (window->dates_again)
+    {
+        window->dates_again = FALSE;
+        _window_read_dates(window);
+    }
+
+    g_object_unref(window);
+}
+
+static void _window_on_scan_done(GObject *source, GAsyncResult *result,
+                                 gpointer user_data)
+{
+    (void) source;
+
+    VnrWindow *window = VNR_WINDOW(user_data);
+
+    if (vnr_list_scan_dir_finish(result, NULL))
+    {
+        g_clear_object(&window->scan_cancellable);
+
+        if (window_get_current_file(window))
+            _window_prefetch(window);
+
+        // no batch came for the directory opened
+        if (window->open_directory)
+        {
+            g_clear_pointer(&window->open_directory, g_free);
+            window->open_start = FALSE;
+
+            vnr_message_area_show(VNR_MESSAGE_AREA(window->msg_area),
+                                  TRUE,
+                                  _("The given locations contain no images."),
+                                  TRUE);
+        }
+    }
+
+    g_object_unref(window);
+}
+
+static GtkWidget* _window_sort_menu_new(VnrWindow *window)
+{
+    static const gchar *labels[] =
+    {
+        N_("_Name"),
+        N_("_Modification Date"),
+        N_("Si_ze"),
+        N_("Date _Taken"),
+    };
+
+    GtkWidget *menu = gtk_menu_new();
+    GSList *group = NULL;
+
+    for (guint i = 0; i < G_N_ELEMENTS(labels); ++i)
+    {
+        GtkWidget *item = gtk_radio_menu_item_new_with_mnemonic(
+                                                    group, _(labels[i]));
+        group = gtk_radio_menu_item_get_group(GTK_RADIO_MENU_ITEM(item));
+
+        g_object_set_data(G_OBJECT(item), "sort-order", GINT_TO_POINTER(i));
+
+        if ((gint) i == window->prefs->sort_order)
+        {
+            gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item),
+                                           TRUE);
+        }
+
+        g_signal_connect(item, "toggled",
+                         G_CALLBACK(_window_on_sort_toggled), window);
+
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+    }
+
+    return menu;
+}
+
+static void _window_on_sort_toggled(GtkCheckMenuItem *item,
+                                    VnrWindow *window)
+{
+    if (!gtk_check_menu_item_get_active(item))
+        return;
+
+    window->prefs->sort_order =
+        GPOINTER_TO_INT(g_object_get_data(G_OBJECT(item), "sort-order"));
+    vnr_prefs_save(window->prefs);
+
+    if (!window->filelist)
+        return;
+
+    vnr_list_set_order(window->filelist, window->prefs->sort_order);
+    _window_read_dates(window);
+    vnr_thumb_view_update(VNR_THUMB_VIEW(window->thumb_view));
+
+    if (!_window_is_loading(window))
+        _view_on_zoom_changed(UNI_IMAGE_VIEW(window->view), window);
+
+    _window_update_fs_filename_label(window);
+    _window_prefetch(window);
+}
+
+static void _window_set_monitor(VnrWindow *window, VnrFile *current)
+{
+    // One monitor for the folder of the current file, kept while browsing
+    // it. Its changes are queued and applied to the list in batches by
+    // _window_on_monitor_timeout.
+
     g_return_if_fail(window != NULL);
 
+    gchar *directory = current ? g_path_get_dirname(current->path) : NULL;
+
+    if (window->monitor && g_strcmp0(directory, window->monitor_dir) == 0)
+    {
+        g_free(directory);
+        return;
+    }
+
     if (window->monitor)
     {
         g_object_unref(window->monitor);
         window->monitor = NULL;
     }
 
-    if (!current)
-        return;
+    g_free(window->monitor_dir);
+    window->monitor_dir = NULL;
+
+    g_hash_table_remove_all(window->monitor_pending);
 
-    VnrFile *vnrfile = VNR_FILE(current->data);
-    GFile *gfile = g_file_new_for_path(vnrfile->path);
+    if (window->monitor_source_id)
+    {
+        g_source_remove(window->monitor_source_id);
+        window->monitor_source_id = 0;
+    }
 
-    if (!gfile)
+    if (!directory)
         return;
 
-    GFileMonitor *monitor = g_file_monitor(gfile,
-                                           G_FILE_MONITOR_WATCH_MOVES,
-                                           NULL, NULL);
+    GFile *gfile = g_file_new_for_path(directory);
+
+    GFileMonitor *monitor = g_file_monitor_directory(
+                                            gfile,
+                                            G_FILE_MONITOR_WATCH_MOVES,
+                                            NULL, NULL);
+    g_object_unref(gfile);
+
     if (!monitor)
     {
-        g_object_unref(gfile);
+        g_free(directory);
         return;
     }
 
     window->monitor = monitor;
+    window->monitor_dir = directory;
     g_signal_connect_swapped(monitor, "changed",
                              G_CALLBACK(_window_monitor_on_change), window);
 
-    //g_file_monitor_set_rate_limit(monitor, 2000);
-
-    g_object_unref(gfile);
+    g_file_monitor_set_rate_limit(monitor, MONITOR_DELAY);
 }
 
 static void _window_monitor_on_change(VnrWindow *window,
@@ -1048,17 +1510,39 @@ static void _window_monitor_on_change(VnrWindow *window,
                                       GFileMonitor *monitor)
 {
     (void) monitor;
-    (void) other_file;
 
-    if (!window_get_current_file(window))
+    VnrFile *current = window_get_current_file(window);
+    if (!current)
+        return;
+
+    char *path = g_file_get_path(event_file);
+    if (!path)
         return;
 
     switch (event_type)
     {
     case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
-        char *path = g_file_get_path(event_file);
+
+        // decoded pixels of the old contents must not be shown again
+        _window_uncache(window, path);
+
+        if (g_strcmp0(path, current->path) != 0)
+        {
+            _window_monitor_queue(window, path);
+            return;
+        }
+
         printf("_window_monitor_on_change: %s\n", path);
-        g_free(path);
+
+        // its mtime and size now, and its place in the order
+        GPtrArray *paths = g_ptr_array_new();
+        g_ptr_array_add(paths, path);
+
+        if (vnr_list_sync_paths(window->filelist, paths,
+                                window->prefs->show_hidden, FALSE))
+            _window_on_list_changed(window);
+
+        g_ptr_array_unref(paths);
 
         if (!window->need_reload)
         {
@@ -1067,9 +1551,90 @@ static void _window_monitor_on_change(VnrWindow *window,
         }
         break;
 
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+        _window_monitor_queue(window, path);
+        return;
+
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        if (other_file)
+            _window_monitor_queue(window, g_file_get_path(other_file));
+
+        // fall through
+
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        _window_uncache(window, path);
+        _window_monitor_queue(window, path);
+        return;
+
     default:
         break;
     }
+
+    g_free(path);
+}
+
+static void _window_monitor_queue(VnrWindow *window, gchar *path)
+{
+    // Takes the path, events on the same file are coalesced until the
+    // next timeout.
+
+    if (!path)
+        return;
+
+    g_hash_table_add(window->monitor_pending, path);
+
+    if (window->monitor_source_id)
+        return;
+
+    window->monitor_source_id =
+        g_timeout_add(MONITOR_DELAY,
+                      (GSourceFunc) _window_on_monitor_timeout,
+                      window);
+}
+
+static gboolean _window_on_monitor_timeout(VnrWindow *window)
+{
+    // New files are only added to the list of a folder, not to a list of
+    // selected files.
+
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+
+    GHashTableIter iter;
+    gpointer path;
+
+    g_hash_table_iter_init(&iter, window->monitor_pending);
+
+    while (paths->len < MONITOR_BATCH
+           && g_hash_table_iter_next(&iter, &path, NULL))
+    {
+        g_hash_table_iter_steal(&iter);
+        g_ptr_array_add(paths, path);
+    }
+
+    if (window->filelist)
+    {
+        gboolean add_new = g_strcmp0(
+                                vnr_list_get_directory(window->filelist),
+                                window->monitor_dir) == 0;
+
+        if (vnr_list_sync_paths(window->filelist, paths,
+                                window->prefs->show_hidden, add_new))
+        {
+            _window_on_list_changed(window);
+            _window_prefetch(window);
+        }
+    }
+
+    g_ptr_array_unref(paths);
+
+    if (g_hash_table_size(window->monitor_pending) > 0)
+        return G_SOURCE_CONTINUE;
+
+    window->monitor_source_id = 0;
+
+    return G_SOURCE_REMOVE;
 }
 
 static gboolean _window_on_idle_reload(VnrWindow *window)
@@ -1087,6 +1652,10 @@ static gboolean _window_on_idle_reload(VnrWindow *window)
 
     printf("_window_on_idle_reload: reload\n");
 
+    VnrFile *current = window_get_current_file(window);
+    if (current)
+        _window_uncache(window, current->path);
+
     window_load_file(window, FALSE);
 
     return G_SOURCE_REMOVE;
@@ -1130,6 +1699,8 @@ static void _window_action_openfile(VnrWindow *window, GtkWidget *widget)
     gtk_file_chooser_set_preview_widget(GTK_FILE_CHOOSER(dialog), preview);
     g_signal_connect(GTK_FILE_CHOOSER(dialog), "update-preview",
                      G_CALLBACK(_on_update_preview), preview);
+    g_signal_connect(preview, "destroy",
+                     G_CALLBACK(_cancel_preview), NULL);
 
     VnrFile *current = window_get_current_file(window);
     if (current)
@@ -1151,25 +1722,88 @@ static void _window_action_openfile(VnrWindow *window, GtkWidget *widget)
 
 static void _on_update_preview(GtkFileChooser *file_chooser, gpointer data)
 {
+    // Previews are made on a worker, large files only from the preview a
+    // camera stored in them. The one still being made for the file
+    // selected before is dropped.
+
+    GtkWidget *preview = GTK_WIDGET(data);
+
+    _cancel_preview(preview, NULL);
+
     char *filename = gtk_file_chooser_get_preview_filename(file_chooser);
-    gboolean has_preview = FALSE;
 
-    if (_file_size_is_small(filename))
+    if (!filename)
     {
-        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_size(filename,
-                                                             256, 256, NULL);
-        has_preview = (pixbuf != NULL);
+        gtk_file_chooser_set_preview_widget_active(file_chooser, FALSE);
+        return;
+    }
 
-        GtkWidget *preview = GTK_WIDGET(data);
+    GCancellable *cancellable = g_cancellable_new();
+    g_object_set_data_full(G_OBJECT(preview), "preview-cancellable",
+                           cancellable, g_object_unref);
 
-        gtk_image_set_from_pixbuf(GTK_IMAGE(preview), pixbuf);
-        if (pixbuf)
-            g_object_unref(pixbuf);
+    GTask *task = g_task_new(file_chooser, cancellable,
+                             _on_preview_loaded, preview);
+    g_task_set_task_data(task, filename, g_free);
+    g_task_run_in_thread(task, _update_preview_thread);
+    g_object_unref(task);
+}
+
+static void _update_preview_thread(GTask *task, gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable *cancellable)
+{
+    (void) source_object;
+    (void) cancellable;
+
+    if (g_task_return_error_if_cancelled(task))
+        return;
+
+    gchar *filename = task_data;
+    gint width = 0;
+    gint height = 0;
+    GdkPixbuf *pixbuf;
+
+    if (_file_size_is_small(filename))
+        pixbuf = vnr_preview_load(filename, 256, &width, &height);
+    else
+        pixbuf = vnr_preview_load_embedded(filename, 256, &width, &height);
+
+    g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+static void _on_preview_loaded(GObject *source, GAsyncResult *result,
+                               gpointer user_data)
+{
+    GError *error = NULL;
+    GdkPixbuf *pixbuf = g_task_propagate_pointer(G_TASK(result), &error);
+
+    // another file was selected, or the dialog closed
+    if (error != NULL)
+    {
+        g_error_free(error);
+        return;
     }
 
-    gtk_file_chooser_set_preview_widget_active(file_chooser, has_preview);
+    GtkWidget *preview = GTK_WIDGET(user_data);
+
+    gtk_image_set_from_pixbuf(GTK_IMAGE(preview), pixbuf);
+    gtk_file_chooser_set_preview_widget_active(GTK_FILE_CHOOSER(source),
+                                               pixbuf != NULL);
+    if (pixbuf)
+        g_object_unref(pixbuf);
+}
+
+static void _cancel_preview(GtkWidget *preview, gpointer data)
+{
+    (void) data;
+
+    GCancellable *cancellable = g_object_get_data(G_OBJECT(preview),
+                                                  "preview-cancellable");
+    if (cancellable)
+        g_cancellable_cancel(cancellable);
 
-    g_free(filename);
+    g_object_set_data(G_OBJECT(preview), "preview-cancellable", NULL);
 }
 
 static gboolean _file_size_is_small(char *filename)
@@ -1243,9 +1877,17 @@ void window_open_list(VnrWindow *window, GSList *uri_list)
     if (!uri_list)
         return;
 
+    if (g_slist_length(uri_list) == 1
+        && g_file_test(uri_list->data, G_FILE_TEST_IS_DIR))
+    {
+        window_open_dir(window, uri_list->data);
+        return;
+    }
+
     _window_set_monitor(window, NULL);
+    _window_list_scan_stop(window);
 
-    GList *file_list = NULL;
+    VnrFileList *file_list = NULL;
     GError *error = NULL;
 
     if (g_slist_length(uri_list) == 1)
@@ -1291,16 +1933,12 @@ void window_open_list(VnrWindow *window, GSList *uri_list)
 
     window_list_set(window, file_list);
 
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
-
     window_close_file(window);
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, file_list);
+        _window_set_monitor(window, window_get_current_file(window));
 
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+    window_list_scan(window);
 }
 
 gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
@@ -1308,14 +1946,93 @@ gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
     g_return_val_if_fail(window != NULL, false);
 
     VnrFile *current = window_get_current_file(window);
-    if (!current)
-        return false;
+    if (!current)
+        return false;
+
+    _window_update_fs_filename_label(window);
+
+    // a newer request supersedes a pending one
+    if (window->load_cancellable)
+    {
+        g_cancellable_cancel(window->load_cancellable);
+        g_object_unref(window->load_cancellable);
+    }
+
+    window->load_cancellable = g_cancellable_new();
+    window->load_fit_to_screen = fit_to_screen;
+    window->loading_full = FALSE;
+    window->pending_edit = WINDOW_EDIT_NONE;
+
+    if (!window->cursor_is_hidden)
+        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, false);
+
+    vnr_loader_load_async(window->cache, window->prefetch, current,
+                          _window_get_decode_size(window),
+                          window->load_cancellable,
+                          _window_on_load_progress,
+                          _window_on_file_loaded, window);
+
+    return TRUE;
+}
+
+static void _window_on_load_progress(GdkPixbuf *pixbuf,
+                                     const GdkRectangle *area,
+                                     gpointer user_data)
+{
+    VnrWindow *window = VNR_WINDOW(user_data);
+    UniImageView *view = UNI_IMAGE_VIEW(window->view);
+
+    if (view->pixbuf == pixbuf)
+    {
+        uni_image_view_damage_pixels(view, (GdkRectangle*) area);
+        return;
+    }
+
+    // first rows of a new image, show the partial pixbuf
+    UniFittingMode last_fit_mode = view->fitting;
+
+    window->current_image_width = gdk_pixbuf_get_width(pixbuf);
+    window->current_image_height = gdk_pixbuf_get_height(pixbuf);
+
+    uni_anim_view_set_static(UNI_ANIM_VIEW(window->view),
+                             g_object_ref(pixbuf));
+
+    _window_set_zoom_mode(window, last_fit_mode);
+}
+
+static void _window_on_file_loaded(GObject *source, GAsyncResult *result,
+                                   gpointer user_data)
+{
+    (void) source;
+
+    GError *error = NULL;
+    VnrImage *image = vnr_loader_load_finish(result, &error);
+
+    // the window may be gone already, don't touch it
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+        g_error_free(error);
+        return;
+    }
+
+    VnrWindow *window = VNR_WINDOW(user_data);
+
+    g_clear_object(&window->load_cancellable);
+
+    if (!window->cursor_is_hidden)
+        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+
+    VnrFile *current = window_get_current_file(window);
 
-    _window_update_fs_filename_label(window);
+    if (!current || (image && g_strcmp0(image->path, current->path) != 0))
+    {
+        g_clear_error(&error);
 
-    GError *error = NULL;
-    GdkPixbufAnimation *pixbuf =
-            gdk_pixbuf_animation_new_from_file(current->path, &error);
+        if (image)
+            g_object_unref(image);
+
+        return;
+    }
 
     if (error != NULL)
     {
@@ -1328,9 +2045,19 @@ gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
             vnr_properties_dialog_clear(
                         VNR_PROPERTIES_DIALOG(window->props_dlg));
 
-        return FALSE;
+        g_error_free(error);
+        _window_prefetch(window);
+
+        return;
     }
 
+    vnr_image_cache_insert(window->cache, image);
+
+    g_clear_object(&window->image);
+    window->image = image;
+
+    GdkPixbufAnimation *pixbuf = image->anim;
+
     if (vnr_message_area_is_visible(VNR_MESSAGE_AREA(window->msg_area)))
     {
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
@@ -1340,24 +2067,19 @@ gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
     //gtk_action_group_set_sensitive(window->actions_image, TRUE);
     //gtk_action_group_set_sensitive(window->action_wallpaper, TRUE);
 
-    GdkPixbufFormat *format = gdk_pixbuf_get_file_info(current->path,
-                                                       NULL, NULL);
-
     g_free(window->writable_format_name);
 
-    if (gdk_pixbuf_format_is_writable(format))
-        window->writable_format_name = gdk_pixbuf_format_get_name(format);
+    if (image->writable)
+        window->writable_format_name = g_strdup(image->format_name);
     else
         window->writable_format_name = NULL;
 
-    vnr_tools_apply_embedded_orientation(&pixbuf);
-
-    window->current_image_width = gdk_pixbuf_animation_get_width(pixbuf);
-    window->current_image_height = gdk_pixbuf_animation_get_height(pixbuf);
+    window->current_image_width = image->width;
+    window->current_image_height = image->height;
 
     window->modifications = 0;
 
-    if (fit_to_screen)
+    if (window->load_fit_to_screen)
     {
         // Width and Height of the pixbuf
 
@@ -1378,6 +2100,24 @@ gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
     window->can_edit = uni_anim_view_set_anim(UNI_ANIM_VIEW(window->view),
                                               pixbuf);
 
+    _window_set_zoom_mode(window, last_fit_mode);
+
+    if (window->prefs->auto_resize)
+    {
+        _action_resize(window, NULL);
+    }
+
+    if (gtk_widget_get_visible(window->props_dlg))
+        vnr_properties_dialog_update(VNR_PROPERTIES_DIALOG(window->props_dlg));
+
+    _window_update_openwith_menu(window);
+
+    _window_prefetch(window);
+}
+
+static void _window_set_zoom_mode(VnrWindow *window,
+                                  UniFittingMode last_fit_mode)
+{
     if (window->mode != WINDOW_MODE_NORMAL && window->prefs->fit_on_fullscreen)
     {
         uni_image_view_set_zoom_mode(UNI_IMAGE_VIEW(window->view),
@@ -1394,20 +2134,222 @@ gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen)
         uni_image_view_set_zoom_mode(UNI_IMAGE_VIEW(window->view),
                                      window->prefs->zoom);
     }
+}
 
-    if (window->prefs->auto_resize)
+// Fitted images much larger than the view are decoded at about the size of
+// the view, a square box so that either orientation fits.
+static gint _window_get_decode_size(VnrWindow *window)
+{
+    VnrPrefs *prefs = window->prefs;
+
+    gboolean fit = (window->mode != WINDOW_MODE_NORMAL
+                    && prefs->fit_on_fullscreen)
+                   || prefs->zoom == VNR_PREFS_ZOOM_FIT
+                   || prefs->zoom == VNR_PREFS_ZOOM_SMART;
+    if (!fit)
+        return 0;
+
+    GtkAllocation alloc;
+    gtk_widget_get_allocation(window->scroll_view, &alloc);
+
+    // not allocated yet
+    if (alloc.width <= 1 || alloc.height <= 1)
+        return 0;
+
+    gint size = MAX(alloc.width, alloc.height);
+
+    // the window may grow to the size of the image
+    if (window->load_fit_to_screen || prefs->auto_resize)
+        size = MAX(size, MAX(window->max_width, window->max_height));
+
+    return size;
+}
+
+// Whether the view shows the pixels of a reduced decode larger than 1:1.
+static gboolean _window_needs_full(VnrWindow *window)
+{
+    VnrImage *image = window->image;
+
+    if (!image || image->scale >= 1.0 || _window_is_loading(window))
+        return FALSE;
+
+    UniImageView *view = UNI_IMAGE_VIEW(window->view);
+    GdkPixbuf *pixbuf = uni_image_view_get_pixbuf(view);
+
+    if (!pixbuf)
+        return FALSE;
+
+    if (view->fitting != UNI_FITTING_NORMAL)
+        return view->zoom >= 1.0;
+
+    // smart fitting stops at 1:1, check whether the view could show more
+    GtkAllocation alloc;
+    gtk_widget_get_allocation(window->scroll_view, &alloc);
+
+    return alloc.width > gdk_pixbuf_get_width(pixbuf)
+           && alloc.height > gdk_pixbuf_get_height(pixbuf);
+}
+
+static void _window_load_full(VnrWindow *window)
+{
+    VnrFile *current = window_get_current_file(window);
+    if (!current)
+        return;
+
+    window->load_cancellable = g_cancellable_new();
+    window->loading_full = TRUE;
+
+    if (!window->cursor_is_hidden)
+        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, false);
+
+    vnr_loader_load_async(window->cache, window->prefetch, current, 0,
+                          window->load_cancellable, NULL,
+                          _window_on_full_loaded, window);
+}
+
+static void _window_on_full_loaded(GObject *source, GAsyncResult *result,
+                                   gpointer user_data)
+{
+    (void) source;
+
+    GError *error = NULL;
+    VnrImage *image = vnr_loader_load_finish(result, &error);
+
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
-        _action_resize(window, NULL);
+        g_error_free(error);
+        return;
     }
 
-    if (gtk_widget_get_visible(window->props_dlg))
-        vnr_properties_dialog_update(VNR_PROPERTIES_DIALOG(window->props_dlg));
+    VnrWindow *window = VNR_WINDOW(user_data);
 
-    _window_update_openwith_menu(window);
+    g_clear_object(&window->load_cancellable);
 
-    g_object_unref(pixbuf);
+    WindowEdit edit = window->pending_edit;
 
-    return TRUE;
+    window->loading_full = FALSE;
+    window->pending_edit = WINDOW_EDIT_NONE;
+
+    if (!window->cursor_is_hidden)
+        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+
+    // keep showing the reduced pixels
+    if (error != NULL)
+    {
+        vnr_message_area_show(VNR_MESSAGE_AREA(window->msg_area),
+                              TRUE,
+                              error->message,
+                              FALSE);
+        g_error_free(error);
+
+        return;
+    }
+
+    if (!window->image || g_strcmp0(image->path, window->image->path) != 0)
+    {
+        g_object_unref(image);
+        return;
+    }
+
+    vnr_image_cache_insert(window->cache, image);
+    _window_set_full_image(window, image);
+
+    _window_apply_edit(window, edit);
+}
+
+// Replaces the reduced pixels on screen, keeping the part of the image in
+// view where it is.
+static void _window_set_full_image(VnrWindow *window, VnrImage *image)
+{
+    UniImageView *view = UNI_IMAGE_VIEW(window->view);
+
+    gdouble scale = window->image->scale;
+    gdouble zoom = view->zoom;
+    UniFittingMode fitting = view->fitting;
+
+    GtkAllocation alloc;
+    gtk_widget_get_allocation(GTK_WIDGET(view), &alloc);
+
+    gdouble center_x = (view->offset_x + alloc.width / 2.0) / zoom / scale;
+    gdouble center_y = (view->offset_y + alloc.height / 2.0) / zoom / scale;
+
+    g_object_unref(window->image);
+    window->image = image;
+
+    window->can_edit = uni_anim_view_set_anim(UNI_ANIM_VIEW(window->view),
+                                              image->anim);
+
+    if (fitting != UNI_FITTING_NONE)
+    {
+        uni_image_view_set_fitting(view, fitting);
+        return;
+    }
+
+    // 1:1 was asked for, not the zoom of the reduced pixels
+    uni_image_view_set_zoom(view, zoom == 1.0 ? 1.0 : zoom * scale);
+
+    uni_image_view_set_offset(view,
+                              center_x * view->zoom - alloc.width / 2.0,
+                              center_y * view->zoom - alloc.height / 2.0,
+                              FALSE);
+}
+
+// Edits work on the pixels of the file, not on a reduced decode. Returns
+// FALSE when the edit can't be done right away: while another image loads
+// it is dropped, while the full pixels are decoded it is kept and done
+// once they are shown. The last edit asked for meanwhile wins.
+static gboolean _window_ensure_full(VnrWindow *window, WindowEdit edit)
+{
+    if (_window_is_loading(window))
+    {
+        if (window->loading_full)
+            window->pending_edit = edit;
+
+        return FALSE;
+    }
+
+    if (!window->image || window->image->scale >= 1.0)
+        return TRUE;
+
+    window->pending_edit = edit;
+    _window_load_full(window);
+
+    return FALSE;
+}
+
+static void _window_apply_edit(VnrWindow *window, WindowEdit edit)
+{
+    switch (edit)
+    {
+    case WINDOW_EDIT_ROTATE_LEFT:
+        _window_rotate_pixbuf(window, GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE);
+        break;
+
+    case WINDOW_EDIT_ROTATE_RIGHT:
+        _window_rotate_pixbuf(window, GDK_PIXBUF_ROTATE_CLOCKWISE);
+        break;
+
+    case WINDOW_EDIT_FLIP_HORIZONTAL:
+        _window_flip_pixbuf(window, TRUE);
+        break;
+
+    case WINDOW_EDIT_FLIP_VERTICAL:
+        _window_flip_pixbuf(window, FALSE);
+        break;
+
+    case WINDOW_EDIT_CROP:
+        _window_action_crop(window, NULL);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static gboolean _window_is_loading(VnrWindow *window)
+{
+    // the view still shows the previous image
+    return (window->load_cancellable != NULL);
 }
 
 static void _window_update_fs_filename_label(VnrWindow *window)
@@ -1431,6 +2373,24 @@ static void _window_update_fs_filename_label(VnrWindow *window)
     g_free(buf);
 }
 
+static void _window_prefetch(VnrWindow *window)
+{
+    VnrPrefs *prefs = window->prefs;
+
+    vnr_prefetch_update(window->prefetch,
+                        window->filelist,
+                        window->prefetch_forward,
+                        prefs->prefetch_next,
+                        prefs->prefetch_prev,
+                        _window_get_decode_size(window));
+}
+
+static void _window_uncache(VnrWindow *window, const gchar *path)
+{
+    vnr_prefetch_remove(window->prefetch, path);
+    vnr_image_cache_remove(window->cache, path);
+}
+
 static void _action_resize(VnrWindow *window, GtkWidget *widget)
 {
     (void) widget;
@@ -1459,7 +2419,18 @@ static void _action_resize(VnrWindow *window, GtkWidget *widget)
 
 void window_close_file(VnrWindow *window)
 {
-    _window_set_monitor(window, NULL);
+    if (window->load_cancellable)
+    {
+        g_cancellable_cancel(window->load_cancellable);
+        g_clear_object(&window->load_cancellable);
+        window->loading_full = FALSE;
+        window->pending_edit = WINDOW_EDIT_NONE;
+
+        if (!window->cursor_is_hidden)
+            vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+    }
+
+    g_clear_object(&window->image);
 
     gtk_window_set_title(GTK_WINDOW(window), "Viewnior");
     uni_anim_view_set_anim(UNI_ANIM_VIEW(window->view), NULL);
@@ -1477,32 +2448,22 @@ static void _window_update_openwith_menu(VnrWindow *window)
 {
     // Modified version of eog's eog_window_update_openwith_menu
 
-    gtk_widget_hide(window->openwith_item);
+    const gchar *mime_type = window->image ? window->image->content_type
+                                           : NULL;
 
-    VnrFile *current = window_get_current_file(window);
-    if (!current)
+    // consecutive images of the same type share the menu
+    if (g_strcmp0(mime_type, window->openwith_type) == 0)
         return;
 
-    GFile *file = g_file_new_for_path((gchar*) current->path);
-    GFileInfo *file_info = g_file_query_info(
-                            file,
-                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
-                            0, NULL, NULL);
-    g_object_unref(file);
-
-    if (!file_info)
-        return;
+    gtk_widget_hide(window->openwith_item);
 
-    const gchar *mime_type = g_file_info_get_content_type(file_info);
+    g_free(window->openwith_type);
+    window->openwith_type = g_strdup(mime_type);
 
     if (mime_type == NULL)
-    {
-        g_object_unref(file_info);
         return;
-    }
 
     GList *apps = g_app_info_get_all_for_type(mime_type);
-    g_object_unref(file_info);
 
     if (!apps)
         return;
@@ -1607,28 +2568,20 @@ void window_action_next(VnrWindow *window, GtkWidget *widget)
 gboolean window_prev(VnrWindow *window)
 {
     // don't reload if there's less than 2 images
-    if (g_list_length(g_list_first(window->filelist)) < 2)
+    if (vnr_list_length(window->filelist) < 2)
         return FALSE;
 
-    _window_set_monitor(window, NULL);
-
     if (window->mode == WINDOW_MODE_SLIDESHOW)
         g_source_remove(window->sl_source_id);
 
-    GList *prev = g_list_previous(window->filelist);
-    if (!prev)
-        prev = g_list_last(window->filelist);
+    gint prev = vnr_list_wrap_index(window->filelist,
+                                    vnr_list_get_index(window->filelist) - 1);
 
     window_list_set_current(window, prev);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
+    window->prefetch_forward = FALSE;
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, prev);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+        _window_set_monitor(window, window_get_current_file(window));
 
     if (window->mode == WINDOW_MODE_SLIDESHOW)
     {
@@ -1644,28 +2597,20 @@ gboolean window_prev(VnrWindow *window)
 gboolean window_next(VnrWindow *window, gboolean reset_timer)
 {
     // don't reload if there's less than 2 images
-    if (g_list_length(g_list_first(window->filelist)) < 2)
+    if (vnr_list_length(window->filelist) < 2)
         return FALSE;
 
-    _window_set_monitor(window, NULL);
-
     if (window->mode == WINDOW_MODE_SLIDESHOW && reset_timer)
         g_source_remove(window->sl_source_id);
 
-    GList *next = g_list_next(window->filelist);
-    if (!next)
-        next = g_list_first(window->filelist);
+    gint next = vnr_list_wrap_index(window->filelist,
+                                    vnr_list_get_index(window->filelist) + 1);
 
     window_list_set_current(window, next);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
+    window->prefetch_forward = TRUE;
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, next);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+        _window_set_monitor(window, window_get_current_file(window));
 
     if (window->mode == WINDOW_MODE_SLIDESHOW && reset_timer)
     {
@@ -1680,7 +2625,7 @@ gboolean window_next(VnrWindow *window, gboolean reset_timer)
 
 static gboolean _window_on_sl_timeout(VnrWindow *window)
 {
-    if (g_list_length(g_list_first(window->filelist)) < 2)
+    if (vnr_list_length(window->filelist) < 2)
         return G_SOURCE_REMOVE;
     else
         window_next(window, FALSE);
@@ -1695,9 +2640,7 @@ static gboolean _window_on_sl_timeout(VnrWindow *window)
 
 gboolean window_first(VnrWindow *window)
 {
-    _window_set_monitor(window, NULL);
-
-    GList *first = g_list_first(window->filelist);
+    gint first = 0;
 
     if (vnr_message_area_is_critical(VNR_MESSAGE_AREA(window->msg_area)))
     {
@@ -1705,24 +2648,17 @@ gboolean window_first(VnrWindow *window)
     }
 
     window_list_set_current(window, first);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
+    window->prefetch_forward = TRUE;
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, first);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+        _window_set_monitor(window, window_get_current_file(window));
 
     return TRUE;
 }
 
 gboolean window_last(VnrWindow *window)
 {
-    _window_set_monitor(window, NULL);
-
-    GList *last = g_list_last(window->filelist);
+    gint last = vnr_list_length(window->filelist) - 1;
 
     if (vnr_message_area_is_critical(VNR_MESSAGE_AREA(window->msg_area)))
     {
@@ -1730,15 +2666,10 @@ gboolean window_last(VnrWindow *window)
     }
 
     window_list_set_current(window, last);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
+    window->prefetch_forward = FALSE;
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, last);
-
-    if (!window->cursor_is_hidden)
-        vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
+        _window_set_monitor(window, window_get_current_file(window));
 
     return TRUE;
 }
@@ -1754,13 +2685,32 @@ static void _window_action_reload(VnrWindow *window, GtkWidget *widget)
     if (!vnrfile)
         return;
 
-    GList *list = vnr_list_new_for_file(vnrfile->path,
-                                        window->prefs->show_hidden,
-                                        true);
+    _window_uncache(window, vnrfile->path);
+
+    // the file first, the rest of its directory is scanned again in the
+    // background
+    gchar *path = g_strdup(vnrfile->path);
+    VnrFileList *list = vnr_list_new_for_path(path,
+                                              window->prefs->show_hidden,
+                                              NULL);
+    if (!list)
+    {
+        gchar *directory = g_path_get_dirname(path);
+        window_open_dir(window, directory);
+        g_free(directory);
+        g_free(path);
+
+        return;
+    }
+
+    g_free(path);
+
     window_list_set(window, list);
 
     if (window_load_file(window, FALSE))
-        _window_set_monitor(window, window->filelist);
+        _window_set_monitor(window, window_get_current_file(window));
+
+    window_list_scan(window);
 }
 
 static void _window_action_resetdir(VnrWindow *window, GtkWidget *widget)
@@ -1893,12 +2843,8 @@ static void _window_copy(VnrWindow *window)
         {
             //printf("%s\n", outpath);
 
-            VnrFile *newfile = vnr_file_new_for_path(
-                                                outpath,
-                                                window->prefs->show_hidden);
-
-            if (!vnr_list_insert(window->filelist, newfile))
-                g_object_unref(newfile);
+            vnr_list_insert_path(window->filelist, outpath,
+                                 window->prefs->show_hidden);
 
             g_free(outpath);
         }
@@ -1950,12 +2896,11 @@ static void _window_move(VnrWindow *window)
 
     if (ret)
     {
-        _window_set_monitor(window, NULL);
         _window_delete_item(window);
         window_close_file(window);
 
         if (window_load_file(window, FALSE))
-            _window_set_monitor(window, window->filelist);
+            _window_set_monitor(window, window_get_current_file(window));
     }
 
 cleanup:
@@ -1973,13 +2918,21 @@ static void _window_action_rename(VnrWindow *window, GtkWidget *widget)
     if (!current || window->mode != WINDOW_MODE_NORMAL)
         return;
 
+    gchar *oldpath = g_strdup(current->path);
     gboolean result = dialog_file_rename(GTK_WINDOW(window), current);
 
+    if (result)
+    {
+        vnr_list_update(window->filelist,
+                        vnr_list_get_index(window->filelist),
+                        oldpath);
+    }
+
+    g_free(oldpath);
+
     if (!result)
         return;
 
-    vnr_list_sort(window->filelist);
-
     _view_on_zoom_changed(UNI_IMAGE_VIEW(window->view), window);
 }
 
@@ -2064,7 +3017,6 @@ static void _window_action_delete(VnrWindow *window, GtkWidget *widget)
         }
         else
         {
-            _window_set_monitor(window, NULL);
             gboolean ret = _window_delete_item(window);
 
             if (!ret)
@@ -2079,7 +3031,8 @@ static void _window_action_delete(VnrWindow *window, GtkWidget *widget)
                 window_close_file(window);
 
                 if (window_load_file(window, FALSE))
-                    _window_set_monitor(window, window->filelist);
+                    _window_set_monitor(window,
+                                        window_get_current_file(window));
 
                 if (window->prefs->confirm_delete && !window->cursor_is_hidden)
                     vnr_tools_set_cursor(GTK_WIDGET(dlg), GDK_LEFT_PTR, false);
@@ -2108,12 +3061,9 @@ static void _window_action_delete(VnrWindow *window, GtkWidget *widget)
 
 static gboolean _window_delete_item(VnrWindow *window)
 {
-    GList *next = vnr_list_delete_item(window->filelist);
+    gint index = vnr_list_get_index(window->filelist);
 
-    // ensure we won't free the list
-    window_list_set_current(window, NULL);
-
-    if (!next)
+    if (index < 0 || !vnr_list_remove(window->filelist, index))
     {
         window_close_file(window);
         //gtk_action_group_set_sensitive(window->actions_collection, FALSE);
@@ -2137,7 +3087,8 @@ static gboolean _window_delete_item(VnrWindow *window)
         return false;
     }
 
-    window_list_set(window, next);
+    // the next file is current now
+    window_list_set(window, window->filelist);
 
     return true;
 }
@@ -2183,6 +3134,12 @@ static void _window_action_preferences(VnrWindow *window, GtkWidget *widget)
 static void _window_rotate_pixbuf(VnrWindow *window,
                                   GdkPixbufRotation angle)
 {
+    WindowEdit edit = (angle == GDK_PIXBUF_ROTATE_CLOCKWISE)
+                      ? WINDOW_EDIT_ROTATE_RIGHT : WINDOW_EDIT_ROTATE_LEFT;
+
+    if (!_window_ensure_full(window, edit))
+        return;
+
     if (!window->cursor_is_hidden)
         vnr_tools_set_cursor(GTK_WIDGET(window), GDK_WATCH, true);
 
@@ -2261,7 +3218,10 @@ static void _window_rotate_pixbuf(VnrWindow *window,
 
 static void _window_flip_pixbuf(VnrWindow *window, gboolean horizontal)
 {
-    if (!window->can_edit)
+    WindowEdit edit = horizontal ? WINDOW_EDIT_FLIP_HORIZONTAL
+                                 : WINDOW_EDIT_FLIP_VERTICAL;
+
+    if (!window->can_edit || !_window_ensure_full(window, edit))
         return;
 
     if (!window->cursor_is_hidden)
@@ -2332,7 +3292,7 @@ static void _window_action_crop(VnrWindow *window, GtkWidget *widget)
 {
     (void) widget;
 
-    if (!window->can_edit)
+    if (!window->can_edit || !_window_ensure_full(window, WINDOW_EDIT_CROP))
         return;
 
     VnrCrop *crop = (VnrCrop*) vnr_crop_new(window);
@@ -2401,7 +3361,7 @@ static void _window_action_save_image(VnrWindow *window, GtkWidget *widget)
     (void) widget;
 
     VnrFile *current = window_get_current_file(window);
-    if (!current)
+    if (!current || _window_is_loading(window))
         return;
 
     if (!window->cursor_is_hidden)
@@ -2410,8 +3370,12 @@ static void _window_action_save_image(VnrWindow *window, GtkWidget *widget)
     if (window->prefs->behavior_modify == VNR_PREFS_MODIFY_ASK)
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
 
-    // Store exiv2 metadata to cache, so we can restore it afterwards
-    uni_read_exiv2_to_cache(current->path);
+    // the metadata parsed with the image is restored afterwards, saving
+    // pixels drops it
+    UniExiv2Metadata *metadata = NULL;
+
+    if (window->image && window->image->metadata)
+        metadata = uni_exiv2_metadata_ref(window->image->metadata);
 
     GError *error = NULL;
 
@@ -2446,7 +3410,16 @@ static void _window_action_save_image(VnrWindow *window, GtkWidget *widget)
                 window->writable_format_name, &error, NULL);
     }
 
-    uni_write_exiv2_from_cache(current->path);
+    if (metadata)
+    {
+        if (error == NULL)
+            uni_exiv2_metadata_write(metadata, current->path);
+
+        uni_exiv2_metadata_unref(metadata);
+    }
+
+    // the decoded image kept for this path is outdated now
+    _window_uncache(window, current->path);
 
     if (!window->cursor_is_hidden)
         vnr_tools_set_cursor(GTK_WIDGET(window), GDK_LEFT_PTR, false);
@@ -2732,6 +3705,60 @@ void window_slideshow_deny(VnrWindow *window)
 }
 
 
+// thumbnails -----------------------------------------------------------------
+
+static void _window_action_thumbnails(VnrWindow *window, GtkWidget *widget)
+{
+    (void) widget;
+
+    if (gtk_widget_get_visible(window->thumb_scroll))
+        _window_thumbnails_hide(window);
+    else
+        _window_thumbnails_show(window);
+}
+
+static void _window_thumbnails_show(VnrWindow *window)
+{
+    if (!window->filelist || window->mode == WINDOW_MODE_SLIDESHOW)
+        return;
+
+    // the cursor starts on the current file
+    vnr_thumb_view_set_list(VNR_THUMB_VIEW(window->thumb_view),
+                            window->filelist);
+
+    gtk_widget_hide(window->scroll_view);
+    gtk_widget_show(window->thumb_scroll);
+    gtk_widget_grab_focus(window->thumb_view);
+}
+
+static void _window_thumbnails_hide(VnrWindow *window)
+{
+    if (!gtk_widget_get_visible(window->thumb_scroll))
+        return;
+
+    gtk_widget_hide(window->thumb_scroll);
+    gtk_widget_show(window->scroll_view);
+    gtk_widget_grab_focus(window->view);
+}
+
+static void _window_on_thumb_activated(VnrThumbView *view, gint index,
+                                       VnrWindow *window)
+{
+    (void) view;
+
+    _window_thumbnails_hide(window);
+
+    if (index == vnr_list_get_index(window->filelist))
+        return;
+
+    window->prefetch_forward = index > vnr_list_get_index(window->filelist);
+    window_list_set_current(window, index);
+
+    if (window_load_file(window, FALSE))
+        _window_set_monitor(window, window_get_current_file(window));
+}
+
+
 // fullscreen -----------------------------------------------------------------
 
 void window_fullscreen_toggle(VnrWindow *window)
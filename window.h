@@ -23,6 +23,8 @@
 #include <etkwidgetlist.h>
 #include "preferences.h"
 #include "file.h"
+#include "list.h"
+#include "prefetch.h"
 
 G_BEGIN_DECLS
 
@@ -39,12 +41,23 @@ typedef enum
 
 } WindowMode;
 
+typedef enum
+{
+    WINDOW_EDIT_NONE,
+    WINDOW_EDIT_ROTATE_LEFT,
+    WINDOW_EDIT_ROTATE_RIGHT,
+    WINDOW_EDIT_FLIP_HORIZONTAL,
+    WINDOW_EDIT_FLIP_VERTICAL,
+    WINDOW_EDIT_CROP,
+
+} WindowEdit;
+
 struct _VnrWindow
 {
     GtkWindow __parent__;
 
     // data
-    GList *filelist;
+    VnrFileList *filelist;
     gchar *destdir;
     WindowMode mode;
     GtkAccelGroup *accel_group;
@@ -60,8 +73,26 @@ struct _VnrWindow
     guint8 modifications;
     gchar *writable_format_name;
 
+    // loading
+    VnrImage *image;
+    GCancellable *load_cancellable;
+    GCancellable *scan_cancellable;
+    gchar *open_directory;
+    gboolean open_start;
+    GCancellable *dates_cancellable;
+    gboolean dates_again;
+    gboolean load_fit_to_screen;
+    gboolean loading_full;
+    WindowEdit pending_edit;
+    VnrImageCache *cache;
+    VnrPrefetch *prefetch;
+    gboolean prefetch_forward;
+
     // reload
     GFileMonitor *monitor;
+    gchar *monitor_dir;
+    GHashTable *monitor_pending;
+    guint monitor_source_id;
     gboolean need_reload;
     gboolean no_reload;
 
@@ -70,8 +101,11 @@ struct _VnrWindow
     GtkWidget *msg_area;
     GtkWidget *view;
     GtkWidget *scroll_view;
+    GtkWidget *thumb_view;
+    GtkWidget *thumb_scroll;
     GtkWidget *popup_menu;
     GtkWidget *openwith_item;
+    gchar *openwith_type;
     GtkWidget *props_dlg;
 
     // fullscreen variables
@@ -93,12 +127,14 @@ GType window_get_type() G_GNUC_CONST;
 // creation
 VnrWindow* window_new();
 
-void window_list_set(VnrWindow *window, GList *list);
+void window_list_set(VnrWindow *window, VnrFileList *list);
 VnrFile *window_get_current_file(VnrWindow *window);
-void window_list_set_current(VnrWindow *window, GList *list);
+void window_list_set_current(VnrWindow *window, gint index);
+void window_list_scan(VnrWindow *window);
 
 // open / close
 void window_open_list(VnrWindow *window, GSList *uri_list);
+void window_open_dir(VnrWindow *window, const gchar *directory);
 gboolean window_load_file(VnrWindow *window, gboolean fit_to_screen);
 void window_close_file(VnrWindow *window);
 